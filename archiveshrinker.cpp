@@ -0,0 +1,259 @@
+#include "archiveshrinker.h"
+#include "backgroundscheduler.h"
+#include "mhtmlarchive.h"
+#include "timinglog.h"
+#include <QBuffer>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QSettings>
+
+struct Transcoded
+{
+	int index = -1;
+	QByteArray contentType;
+	QByteArray data;               // empty when the part is left as it is
+};
+
+ArchiveShrinker::Policy ArchiveShrinker::Policy::load()
+{
+	Policy policy;
+	QSettings settings;
+	settings.beginGroup("shrink");
+	policy.quality = qBound(1, settings.value("quality", policy.quality).toInt(), 100);
+	policy.maxDimension = qMax(64, settings.value("maxDimension", policy.maxDimension).toInt());
+	policy.minPartBytes = settings.value("minPartBytes", policy.minPartBytes).toLongLong();
+	policy.minSavingPercent = qBound(0, settings.value("minSavingPercent", policy.minSavingPercent).toInt(), 99);
+	settings.endGroup();
+	return policy;
+}
+
+ArchiveShrinker::ArchiveShrinker(QObject *parent)
+	: QObject(parent)
+	, m_total(0)
+	, m_done(0)
+	, m_shrunk(0)
+	, m_bytesBefore(0)
+	, m_bytesAfter(0)
+{
+	connect(&m_listing, &QFutureWatcher<QStringList>::finished, this, [this]() {
+		if (!m_listing.isCanceled())
+			shrink(m_listing.result());
+	});
+	connect(&m_watcher, &QFutureWatcher<Result>::finished, this, &ArchiveShrinker::handleFileDone);
+}
+
+ArchiveShrinker::~ArchiveShrinker()
+{
+	// A file being rewritten is committed or left alone, the job needs nothing from here
+	m_pending.clear();
+	m_watcher.cancel();
+	m_listing.cancel();
+}
+
+bool ArchiveShrinker::isWebpAvailable()
+{
+	static const bool available = QImageWriter::supportedImageFormats().contains("webp");
+	return available;
+}
+
+void ArchiveShrinker::shrink(const QStringList &filePaths)
+{
+	for (const QString &filePath : filePaths) {
+		if (!m_pending.contains(filePath)) {
+			m_pending.append(filePath);
+			m_total++;
+		}
+	}
+	if (m_total > 0)
+		emit progress(m_done, m_total);
+	if (!m_watcher.isRunning())
+		startNext();
+}
+
+void ArchiveShrinker::shrinkFolder(const QString &folder)
+{
+	m_listing.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Idle, "shrink.list",
+		[folder](BackgroundJob &) {
+			QStringList files;
+			QDirIterator it(folder, QStringList() << "*.mhtml" << "*.mht", QDir::Files, QDirIterator::Subdirectories);
+			while (it.hasNext())
+				files.append(it.next());
+			return files;
+		}));
+}
+
+void ArchiveShrinker::startNext()
+{
+	if (m_pending.isEmpty()) {
+		if (m_total > 0)
+			emit finished(m_shrunk, m_bytesBefore, m_bytesAfter);
+		m_total = m_done = m_shrunk = 0;
+		m_bytesBefore = m_bytesAfter = 0;
+		return;
+	}
+	// Read when the file is taken, a setting changed mid-batch applies to the rest
+	const Policy policy = Policy::load();
+	const QString filePath = m_pending.takeFirst();
+	// Files go one by one, the next one is queued when this one is done
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Idle, "shrink",
+		[filePath, policy](BackgroundJob &job) { return shrinkFile(filePath, policy, &job); }));
+}
+
+void ArchiveShrinker::handleFileDone()
+{
+	if (m_watcher.isCanceled())
+		return;
+	const Result result = m_watcher.result();
+	m_done++;
+	if (result.error.isEmpty() && result.images > 0) {
+		m_shrunk++;
+		m_bytesBefore += result.bytesBefore;
+		m_bytesAfter += result.bytesAfter;
+		emit fileShrunk(result.filePath);
+	}
+	TimingLog::write("shrink", result.elapsedMs, QString("file=%1 images=%2 before=%3 after=%4%5")
+		.arg(QFileInfo(result.filePath).fileName()).arg(result.images).arg(result.bytesBefore).arg(result.bytesAfter)
+		.arg(result.error.isEmpty() ? QString() : " error=" + result.error));
+	emit progress(m_done, m_total);
+	startNext();
+}
+
+static Transcoded transcode(const MhtmlArchive &archive, int index, const ArchiveShrinker::Policy &policy)
+{
+	Transcoded result;
+	result.index = index;
+	const qint64 encodedSize = archive.parts().at(index).bodySize;
+	QByteArray original = archive.body(index);
+	QBuffer input(&original);
+	QImageReader reader(&input);
+	QImage image = reader.read();
+	if (image.isNull())
+		return result;
+	if (qMax(image.width(), image.height()) > policy.maxDimension)
+		image = image.scaled(policy.maxDimension, policy.maxDimension, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	// WebP keeps transparency; without it photos go to JPEG and transparent images stay PNG
+	QByteArray format;
+	if (ArchiveShrinker::isWebpAvailable())
+		format = "webp";
+	else if (image.hasAlphaChannel())
+		format = "png";
+	else
+		format = "jpeg";
+	if (format == "jpeg")
+		image = image.convertToFormat(QImage::Format_RGB32);
+
+	QByteArray encoded;
+	QBuffer output(&encoded);
+	output.open(QIODevice::WriteOnly);
+	QImageWriter writer(&output, format);
+	writer.setQuality(policy.quality);
+	if (format == "png")
+		writer.setCompression(9);
+	if (!writer.write(image))
+		return result;
+
+	// Compared as stored, base64 adds the same third to both sides
+	const qint64 newSize = (encoded.size() + 2) / 3 * 4;
+	if (newSize * 100 > encodedSize * (100 - policy.minSavingPercent))
+		return result;
+	result.contentType = "image/" + format;
+	result.data = encoded;
+	return result;
+}
+
+ArchiveShrinker::Result ArchiveShrinker::shrinkFile(const QString &filePath, const Policy &policy, BackgroundJob *job)
+{
+	Result result;
+	result.filePath = filePath;
+	QElapsedTimer timer;
+	timer.start();
+
+	const QDateTime modified = QFileInfo(filePath).lastModified();
+	MhtmlArchive archive;
+	if (!archive.load(filePath)) {
+		result.error = archive.errorString();
+		return result;
+	}
+	const QByteArray &data = archive.data();
+	result.bytesBefore = result.bytesAfter = data.size();
+
+	QVector<int> candidates;
+	const QVector<MhtmlPart> &parts = archive.parts();
+	for (int i = 0; i < parts.size(); ++i) {
+		const MhtmlPart &part = parts.at(i);
+		// Single part documents have no part headers to rewrite
+		if (part.headerOffset > 0 && part.bodySize >= policy.minPartBytes
+			&& (part.contentType == "image/jpeg" || part.contentType == "image/png"))
+			candidates.append(i);
+	}
+	if (candidates.isEmpty()) {
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+
+	// Decoding and encoding dominate, every image of the archive gets its own core.
+	// Each image waits on its own, activity pauses a large archive midway.
+	QVector<Transcoded> transcoded(candidates.size());
+	const std::function<void(int)> transcodeAt = [&](int i) {
+		transcoded[i] = transcode(archive, candidates.at(i), policy);
+	};
+	if (job) {
+		job->forEach(candidates.size(), transcodeAt);
+	} else {
+		for (int i = 0; i < candidates.size(); ++i)
+			transcodeAt(i);
+	}
+	if (job && job->isCancelled()) {
+		result.error = QStringLiteral("Cancelled");
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+
+	QMap<int, MhtmlPartEdit> edits;
+	for (const Transcoded &image : transcoded) {
+		if (image.data.isEmpty())
+			continue;
+		MhtmlPartEdit &edit = edits[image.index];
+		edit.contentType = image.contentType;
+		edit.body = image.data;
+	}
+	if (edits.isEmpty()) {
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+	const QByteArray rebuilt = archive.rewrite(edits);
+
+	// The rebuilt archive must read back with the same parts before it replaces the original
+	MhtmlArchive check;
+	bool valid = check.parse(rebuilt) && check.parts().size() == parts.size();
+	for (auto it = edits.constBegin(); valid && it != edits.constEnd(); ++it)
+		valid = check.parts().at(it.key()).contentType == it->contentType;
+	if (!valid) {
+		result.error = QStringLiteral("Rebuilt archive did not parse back");
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+	if (QFileInfo(filePath).lastModified() != modified) {
+		result.error = QStringLiteral("File changed while it was shrunk");
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+
+	QSaveFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly) || file.write(rebuilt) != rebuilt.size() || !file.commit()) {
+		result.error = file.errorString();
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+	result.images = edits.size();
+	result.bytesAfter = rebuilt.size();
+	result.elapsedMs = timer.elapsed();
+	return result;
+}
@@ -0,0 +1,73 @@
+#ifndef ARCHIVESHRINKER_H
+#define ARCHIVESHRINKER_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+
+class BackgroundJob;
+
+// Re-encodes the oversized JPEG/PNG parts of archives to save disk space.
+// Files are idle background jobs, one at a time; the images of one archive are
+// transcoded on all cores. The archive is rebuilt around the new parts, parsed
+// again as a check and replaced atomically, so a failure at any point leaves
+// the original file untouched.
+class ArchiveShrinker : public QObject
+{
+	Q_OBJECT
+
+public:
+	struct Policy
+	{
+		int quality = 80;
+		int maxDimension = 1920;       // longer image side, larger images are scaled down
+		qint64 minPartBytes = 16 * 1024;
+		int minSavingPercent = 10;     // a new encoding is kept only when it saves this much
+
+		static Policy load();
+	};
+
+	struct Result
+	{
+		QString filePath;
+		qint64 bytesBefore = 0;
+		qint64 bytesAfter = 0;
+		int images = 0;                // parts that were re-encoded
+		QString error;
+		qint64 elapsedMs = 0;
+	};
+
+	explicit ArchiveShrinker(QObject *parent = nullptr);
+	~ArchiveShrinker();
+
+	bool isRunning() const { return m_total > 0; }
+	void shrink(const QStringList &filePaths);
+	// Every archive of the folder tree; the tree is listed off the GUI thread
+	void shrinkFolder(const QString &folder);
+
+	// A job, if given, holds the transcoding back while the user is busy
+	static Result shrinkFile(const QString &filePath, const Policy &policy, BackgroundJob *job = nullptr);
+	// WebP comes from the Qt image formats plugin, JPEG and PNG are the fallback
+	static bool isWebpAvailable();
+
+signals:
+	void progress(int done, int total);
+	void finished(int files, qint64 bytesBefore, qint64 bytesAfter);
+	// The file was rewritten with smaller images
+	void fileShrunk(const QString &filePath);
+
+private:
+	void startNext();
+	void handleFileDone();
+
+	QFutureWatcher<QStringList> m_listing;
+	QFutureWatcher<Result> m_watcher;
+	QStringList m_pending;
+	int m_total;
+	int m_done;
+	int m_shrunk;
+	qint64 m_bytesBefore;
+	qint64 m_bytesAfter;
+};
+
+#endif // ARCHIVESHRINKER_H
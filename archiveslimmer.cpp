@@ -0,0 +1,415 @@
+#include "archiveslimmer.h"
+#include "backgroundscheduler.h"
+#include "mhtmlarchive.h"
+#include "timinglog.h"
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSet>
+#include <QSettings>
+#include <QUrl>
+
+// Ad and analytics hosts, subdomains included; more can be listed in slim/trackerHosts
+static const char *const TrackerHosts[] = {
+	"doubleclick.net", "googlesyndication.com", "googleadservices.com", "google-analytics.com",
+	"googletagmanager.com", "googletagservices.com", "adservice.google.com", "amazon-adsystem.com",
+	"adnxs.com", "criteo.com", "criteo.net", "taboola.com", "outbrain.com", "scorecardresearch.com",
+	"quantserve.com", "moatads.com", "mc.yandex.ru", "an.yandex.ru", "top-fwz1.mail.ru",
+	"connect.facebook.net", "ads.twitter.com", "hotjar.com", "adfox.ru", "adriver.ru",
+};
+
+static bool isScriptType(const QByteArray &contentType)
+{
+	return contentType.endsWith("/javascript") || contentType.endsWith("/x-javascript")
+		|| contentType.endsWith("/ecmascript");
+}
+
+// Parts whose text may refer to other parts
+static bool isReferrerType(const QByteArray &contentType)
+{
+	return contentType == "text/html" || contentType == "text/css" || contentType == "image/svg+xml";
+}
+
+bool ArchiveSlimmer::isTrackerUrl(const QUrl &url)
+{
+	static const QStringList hosts = [] {
+		QStringList result;
+		for (const char *host : TrackerHosts)
+			result.append(QLatin1String(host));
+		result += QSettings().value("slim/trackerHosts").toStringList();
+		return result;
+	}();
+	const QString host = url.host().toLower();
+	if (host.isEmpty())
+		return false;
+	for (const QString &tracker : hosts) {
+		if (host == tracker || host.endsWith(QLatin1Char('.') + tracker))
+			return true;
+	}
+	return false;
+}
+
+QString ArchiveSlimmer::describe(Action action)
+{
+	switch (action) {
+	case StripScripts: return tr("Strip scripts");
+	case RemoveScript: return tr("Remove script");
+	case RemoveTracker: return tr("Remove tracker");
+	case RemoveOrphan: return tr("Remove unused");
+	default: return QString();
+	}
+}
+
+ArchiveSlimmer::ArchiveSlimmer(QObject *parent)
+	: QObject(parent)
+{
+	connect(&m_watcher, &QFutureWatcher<Report>::progressValueChanged, this, [this](int done) {
+		emit progress(done, m_watcher.progressMaximum());
+	});
+	connect(&m_watcher, &QFutureWatcher<Report>::finished, this, [this]() {
+		if (!m_watcher.isCanceled())
+			emit finished(m_watcher.result());
+	});
+}
+
+ArchiveSlimmer::~ArchiveSlimmer()
+{
+	// Files are replaced atomically, an abandoned job leaves each one slimmed or untouched
+	m_watcher.cancel();
+}
+
+void ArchiveSlimmer::slimFolder(const QString &folder, bool apply)
+{
+	if (isRunning())
+		return;
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Idle, apply ? "slim" : "slim.dryRun",
+		[folder, apply](BackgroundJob &job) { return slimFolderJob(folder, apply, job); }));
+}
+
+ArchiveSlimmer::Report ArchiveSlimmer::slimFolderJob(const QString &folder, bool apply, BackgroundJob &job)
+{
+	QStringList files;
+	QDirIterator it(folder, QStringList() << "*.mhtml" << "*.mht", QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext())
+		files.append(it.next());
+
+	const int count = files.size();
+	QAtomicInt done;
+	job.setProgress(0, count);
+	// Every file waits on its own, so the whole folder pauses while the user is busy
+	QVector<Report> reports(count);
+	for (Report &report : reports)
+		report.error = QStringLiteral("Cancelled");
+	job.forEach(count, [&files, &reports, apply, count, &done, &job](int i) {
+		Report report = slimFile(files.at(i), apply);
+		// Only the totals are kept for a folder
+		report.parts.clear();
+		reports[i] = report;
+		job.setProgress(done.fetchAndAddOrdered(1) + 1, count);
+	});
+
+	Report total;
+	total.filePath = folder;
+	total.applied = apply;
+	for (const Report &report : reports) {
+		if (!report.error.isEmpty())
+			continue;
+		if (report.bytesAfter < report.bytesBefore)
+			total.files++;
+		total.bytesBefore += report.bytesBefore;
+		total.bytesAfter += report.bytesAfter;
+		total.scriptBytes += report.scriptBytes;
+		total.trackerBytes += report.trackerBytes;
+		total.orphanBytes += report.orphanBytes;
+		total.elapsedMs += report.elapsedMs;
+	}
+	return total;
+}
+
+// Text of the referring parts, searched as bytes; saved URLs are ASCII or percent-encoded
+typedef QHash<int, QByteArray> PartTexts;
+// Parts by every form they can be named in
+typedef QHash<QByteArray, QVector<int>> FormIndex;
+
+// Ways a part can be named by another part: its full URL, cid: link, path or file name.
+// Matching on the shorter forms may keep an unused part, it never drops a used one.
+static QList<QByteArray> referenceForms(const MhtmlPart &part)
+{
+	QList<QByteArray> forms;
+	if (!part.contentLocation.isEmpty()) {
+		forms.append(part.contentLocation);
+		if (part.contentLocation.contains('&')) {
+			QByteArray escaped = part.contentLocation;
+			forms.append(escaped.replace("&", "&amp;"));
+		}
+		const QUrl url = QUrl::fromEncoded(part.contentLocation);
+		const QByteArray path = url.path(QUrl::FullyEncoded).toLatin1();
+		if (path.size() > 1)
+			forms.append(path);
+		const QByteArray fileName = path.mid(path.lastIndexOf('/') + 1);
+		if (fileName.size() >= 4)
+			forms.append(fileName);
+	}
+	if (!part.contentId.isEmpty()) {
+		QByteArray id = part.contentId;
+		if (id.startsWith('<') && id.endsWith('>'))
+			id = id.mid(1, id.size() - 2);
+		forms.append("cid:" + id);
+	}
+	return forms;
+}
+
+// Longer tokens are not URLs a page would use, their tails are not taken apart
+static const int MaxNameBytes = 4096;
+
+// Adds a token and every tail of it that starts at or after a slash, with and without
+// query and fragment, so the token is found under each form referenceForms() gives
+static void addNameTails(QSet<QByteArray> &names, QByteArray token)
+{
+	// Left over from url(...) and similar wrappers
+	while (token.endsWith(')') && token.count(')') > token.count('('))
+		token.chop(1);
+	// Inline data names nothing, and base64 is full of slashes
+	if (token.isEmpty() || token.startsWith("data:"))
+		return;
+	const int fragment = token.indexOf('#');
+	if (fragment >= 0) {
+		names.insert(token);
+		token.truncate(fragment);
+	}
+	const int query = token.indexOf('?');
+	if (query >= 0) {
+		names.insert(token);
+		token.truncate(query);
+	}
+	names.insert(token);
+	if (token.size() > MaxNameBytes)
+		return;
+	for (int slash = token.indexOf('/'); slash >= 0; slash = token.indexOf('/', slash + 1)) {
+		names.insert(token.mid(slash));
+		names.insert(token.mid(slash + 1));
+	}
+}
+
+// Everything in the text that may name a part. Tokens end where a URL cannot go on;
+// parentheses stay in, saved paths such as File:Foo_(bar).jpg keep them unescaped.
+static QSet<QByteArray> referencedNames(QByteArray text)
+{
+	text.replace("&amp;", "&").replace("&quot;", "\"").replace("&#39;", "'").replace("&apos;", "'");
+	text.replace("url(", " ").replace("URL(", " ");
+	QSet<QByteArray> names;
+	const char *data = text.constData();
+	const int size = text.size();
+	int start = 0;
+	for (int i = 0; i <= size; ++i) {
+		const char c = i < size ? data[i] : ' ';
+		const bool delimiter = c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '"' || c == '\''
+			|| c == '<' || c == '>' || c == '\\' || c == ',' || c == ';' || c == '{' || c == '}' || c == '`';
+		if (!delimiter)
+			continue;
+		if (i > start)
+			addNameTails(names, QByteArray(data + start, i - start));
+		start = i + 1;
+	}
+	return names;
+}
+
+// Parts reachable from the root through the given texts; each referring text is
+// tokenized once and its names looked up, instead of searching it for every part
+static QVector<bool> reachable(int partCount, int root, const PartTexts &texts, const FormIndex &index)
+{
+	QVector<bool> result(partCount, false);
+	QVector<int> pending;
+	result[root] = true;
+	pending.append(root);
+	while (!pending.isEmpty()) {
+		const int referrer = pending.takeLast();
+		auto text = texts.constFind(referrer);
+		if (text == texts.constEnd())
+			continue;
+		const QSet<QByteArray> names = referencedNames(*text);
+		for (const QByteArray &name : names) {
+			auto named = index.constFind(name);
+			if (named == index.constEnd())
+				continue;
+			for (int i : *named) {
+				if (!result.at(i)) {
+					result[i] = true;
+					pending.append(i);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+static QString stripHtml(const QString &html, const QList<QByteArray> &removedFrames)
+{
+	static const QRegularExpression scriptPattern("<script\\b[^>]*>.*?</script\\s*>",
+		QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+	static const QRegularExpression framePattern("<iframe\\b([^>]*)>(.*?</iframe\\s*>)?",
+		QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+	static const QRegularExpression linkPattern("<link\\b[^>]*>", QRegularExpression::CaseInsensitiveOption);
+	static const QRegularExpression srcPattern("\\bsrc\\s*=\\s*[\"']?([^\"'\\s>]*)", QRegularExpression::CaseInsensitiveOption);
+	static const QRegularExpression scriptPreloadPattern("\\brel\\s*=\\s*[\"']?modulepreload|\\bas\\s*=\\s*[\"']?script\\b",
+		QRegularExpression::CaseInsensitiveOption);
+
+	QString result = html;
+	result.remove(scriptPattern);
+	// Preloads of the removed scripts
+	int pos = 0;
+	QRegularExpressionMatch match;
+	while ((match = linkPattern.match(result, pos)).hasMatch()) {
+		if (scriptPreloadPattern.match(match.captured(0)).hasMatch()) {
+			result.remove(match.capturedStart(), match.capturedLength());
+			pos = match.capturedStart();
+		} else {
+			pos = match.capturedEnd();
+		}
+	}
+	// Frames of tracking hosts, saved or not
+	pos = 0;
+	while ((match = framePattern.match(result, pos)).hasMatch()) {
+		const QString src = srcPattern.match(match.captured(1)).captured(1);
+		bool tracker = ArchiveSlimmer::isTrackerUrl(QUrl(src));
+		for (int i = 0; i < removedFrames.size() && !tracker && !src.isEmpty(); ++i)
+			tracker = src.toLatin1() == removedFrames.at(i);
+		if (tracker) {
+			result.remove(match.capturedStart(), match.capturedLength());
+			pos = match.capturedStart();
+		} else {
+			pos = match.capturedEnd();
+		}
+	}
+	return result;
+}
+
+ArchiveSlimmer::Report ArchiveSlimmer::slimFile(const QString &filePath, bool apply)
+{
+	Report report;
+	report.filePath = filePath;
+	QElapsedTimer timer;
+	timer.start();
+
+	const QDateTime modified = QFileInfo(filePath).lastModified();
+	MhtmlArchive archive;
+	if (!archive.load(filePath)) {
+		report.error = archive.errorString();
+		return report;
+	}
+	report.bytesBefore = report.bytesAfter = archive.data().size();
+	const QVector<MhtmlPart> &parts = archive.parts();
+	const int root = archive.rootIndex();
+	if (root < 0)
+		return report;
+
+	QVector<QList<QByteArray>> forms;
+	FormIndex formIndex;
+	report.parts.resize(parts.size());
+	for (int i = 0; i < parts.size(); ++i) {
+		const MhtmlPart &part = parts.at(i);
+		Part &info = report.parts[i];
+		info.contentType = part.contentType;
+		info.location = part.contentLocation;
+		info.size = part.bodySize;
+		forms.append(referenceForms(part));
+		for (const QByteArray &form : forms.last())
+			formIndex[form].append(i);
+		// Single part documents have no part boundaries to cut at
+		if (i == root || part.headerOffset == 0)
+			continue;
+		if (isScriptType(part.contentType))
+			info.action = RemoveScript;
+		else if (isTrackerUrl(QUrl::fromEncoded(part.contentLocation)))
+			info.action = RemoveTracker;
+	}
+
+	// Frames that go away are also cut out of the pages that embed them
+	QList<QByteArray> removedFrames;
+	for (int i = 0; i < parts.size(); ++i) {
+		if (report.parts.at(i).action == RemoveTracker && parts.at(i).contentType == "text/html")
+			removedFrames += forms.at(i);
+	}
+
+	PartTexts savedTexts;
+	PartTexts slimTexts;
+	QMap<int, MhtmlPartEdit> edits;
+	for (int i = 0; i < parts.size(); ++i) {
+		if (!isReferrerType(parts.at(i).contentType))
+			continue;
+		savedTexts.insert(i, archive.body(i));
+		if (report.parts.at(i).action != Keep)
+			continue;
+		if (parts.at(i).contentType != "text/html" || parts.at(i).headerOffset == 0) {
+			slimTexts.insert(i, savedTexts.value(i));
+			continue;
+		}
+		const QString html = archive.text(i);
+		const QString stripped = stripHtml(html, removedFrames);
+		if (stripped.size() == html.size()) {
+			slimTexts.insert(i, savedTexts.value(i));
+			continue;
+		}
+		// Stored as UTF-8 from now on, the header charset overrides any <meta charset>
+		report.parts[i].action = StripScripts;
+		MhtmlPartEdit &edit = edits[i];
+		edit.contentType = "text/html; charset=utf-8";
+		edit.body = stripped.toUtf8();
+		slimTexts.insert(i, edit.body);
+	}
+
+	const QVector<bool> referenced = reachable(parts.size(), root, savedTexts, formIndex);
+	const QVector<bool> used = reachable(parts.size(), root, slimTexts, formIndex);
+	for (int i = 0; i < parts.size(); ++i) {
+		Part &info = report.parts[i];
+		info.referenced = referenced.at(i);
+		if ((info.action == Keep || info.action == StripScripts) && !used.at(i) && parts.at(i).headerOffset > 0)
+			info.action = RemoveOrphan;
+		switch (info.action) {
+		case RemoveScript: report.scriptBytes += info.size; break;
+		case RemoveTracker: report.trackerBytes += info.size; break;
+		case RemoveOrphan: report.orphanBytes += info.size; break;
+		default: continue;
+		}
+		edits[i].remove = true;
+	}
+	if (edits.isEmpty()) {
+		report.elapsedMs = timer.elapsed();
+		return report;
+	}
+
+	// The dry run rebuilds too, so the reported size is exact
+	const QByteArray rebuilt = archive.rewrite(edits);
+	MhtmlArchive check;
+	int removed = 0;
+	for (const MhtmlPartEdit &edit : qAsConst(edits))
+		removed += edit.remove ? 1 : 0;
+	if (!check.parse(rebuilt) || check.parts().size() != parts.size() - removed) {
+		report.error = QStringLiteral("Slimmed archive did not parse back");
+		report.elapsedMs = timer.elapsed();
+		return report;
+	}
+	report.bytesAfter = rebuilt.size();
+
+	if (apply) {
+		QSaveFile file(filePath);
+		if (QFileInfo(filePath).lastModified() != modified) {
+			report.error = QStringLiteral("File changed while it was slimmed");
+		} else if (!file.open(QIODevice::WriteOnly) || file.write(rebuilt) != rebuilt.size() || !file.commit()) {
+			report.error = file.errorString();
+		} else {
+			report.applied = true;
+		}
+	}
+	report.elapsedMs = timer.elapsed();
+	TimingLog::write(report.applied ? "slim" : "slimDryRun", report.elapsedMs,
+		QString("file=%1 before=%2 after=%3 scripts=%4 trackers=%5 orphans=%6%7")
+			.arg(QFileInfo(filePath).fileName()).arg(report.bytesBefore).arg(report.bytesAfter)
+			.arg(report.scriptBytes).arg(report.trackerBytes).arg(report.orphanBytes)
+			.arg(report.error.isEmpty() ? QString() : " error=" + report.error));
+	return report;
+}
@@ -0,0 +1,68 @@
+#ifndef ARCHIVESLIMMER_H
+#define ARCHIVESLIMMER_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+class BackgroundJob;
+class QUrl;
+
+// Removes what a saved article does not need to be read: script parts and
+// <script> elements (Chromium never runs scripts in archives anyway), parts and
+// frames from tracking hosts, and parts nothing left in the page refers to.
+// A dry run reports the same numbers without touching the file.
+class ArchiveSlimmer : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Action { Keep, StripScripts, RemoveScript, RemoveTracker, RemoveOrphan };
+
+	struct Part
+	{
+		QByteArray contentType;
+		QByteArray location;
+		qint64 size = 0;               // encoded size in the archive
+		bool referenced = false;
+		Action action = Keep;
+	};
+
+	struct Report
+	{
+		QString filePath;
+		QVector<Part> parts;
+		int files = 0;                 // files that get smaller, for folder totals
+		qint64 bytesBefore = 0;
+		qint64 bytesAfter = 0;
+		qint64 scriptBytes = 0;
+		qint64 trackerBytes = 0;
+		qint64 orphanBytes = 0;
+		bool applied = false;
+		QString error;
+		qint64 elapsedMs = 0;
+	};
+
+	explicit ArchiveSlimmer(QObject *parent = nullptr);
+	~ArchiveSlimmer();
+
+	bool isRunning() const { return m_watcher.isRunning(); }
+	// Every archive of the folder tree as one idle job on all cores; apply false is the dry run
+	void slimFolder(const QString &folder, bool apply);
+
+	static Report slimFile(const QString &filePath, bool apply);
+	static bool isTrackerUrl(const QUrl &url);
+	static QString describe(Action action);
+
+signals:
+	void progress(int done, int total);
+	void finished(const ArchiveSlimmer::Report &total);
+
+private:
+	static Report slimFolderJob(const QString &folder, bool apply, BackgroundJob &job);
+
+	QFutureWatcher<Report> m_watcher;
+};
+
+#endif // ARCHIVESLIMMER_H
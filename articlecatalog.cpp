@@ -0,0 +1,188 @@
+#include "articlecatalog.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+bool ArticleRecord::isCurrent() const
+{
+	QFileInfo info(filePath);
+	return info.exists() && info.size() == size && info.lastModified() == modified;
+}
+
+ArticleCatalog::ArticleCatalog()
+{
+}
+
+QString ArticleCatalog::cacheFolder()
+{
+	static const QString path = [] {
+		QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/ingest";
+		QDir().mkpath(dir + "/thumbs");
+		QDir().mkpath(dir + "/text");
+		return dir;
+	}();
+	return path;
+}
+
+bool ArticleCatalog::find(const QString &filePath, ArticleRecord *record) const
+{
+	QMutexLocker locker(&m_mutex);
+	auto it = m_records.constFind(filePath);
+	if (it == m_records.constEnd())
+		return false;
+	if (record)
+		*record = it.value();
+	return true;
+}
+
+void ArticleCatalog::insert(const ArticleRecord &record)
+{
+	QMutexLocker locker(&m_mutex);
+	m_records.insert(record.filePath, record);
+	if (!record.sha1.isEmpty() && !m_bySha1.contains(record.sha1))
+		m_bySha1.insert(record.sha1, record.filePath);
+}
+
+void ArticleCatalog::remove(const QString &filePath)
+{
+	QMutexLocker locker(&m_mutex);
+	ArticleRecord record = m_records.take(filePath);
+	if (m_bySha1.value(record.sha1) == filePath)
+		m_bySha1.remove(record.sha1);
+}
+
+void ArticleCatalog::removeIfUnchanged(const ArticleRecord &record)
+{
+	QMutexLocker locker(&m_mutex);
+	auto it = m_records.find(record.filePath);
+	if (it == m_records.end() || it->size != record.size || it->modified != record.modified)
+		return;
+	if (m_bySha1.value(it->sha1) == record.filePath)
+		m_bySha1.remove(it->sha1);
+	m_records.erase(it);
+}
+
+void ArticleCatalog::move(const QString &from, const QString &to)
+{
+	QList<QPair<QString, QString>> moves;
+	const QStringList files = filesUnder(from);
+	for (const QString &filePath : files) {
+		// The disk is checked outside the lock
+		const QString target = to + filePath.mid(from.size());
+		if (QFileInfo::exists(target))
+			moves.append(qMakePair(filePath, target));
+	}
+	QMutexLocker locker(&m_mutex);
+	for (const auto &move : qAsConst(moves)) {
+		auto it = m_records.find(move.first);
+		if (it == m_records.end())
+			continue;
+		ArticleRecord record = *it;
+		m_records.erase(it);
+		record.filePath = move.second;
+		if (m_bySha1.value(record.sha1) == move.first)
+			m_bySha1.insert(record.sha1, move.second);
+		m_records.insert(move.second, record);
+	}
+}
+
+QStringList ArticleCatalog::filesUnder(const QString &path) const
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_records.contains(path))
+		return QStringList(path);
+	QStringList files;
+	const QString prefix = path + '/';
+	for (auto it = m_records.constBegin(); it != m_records.constEnd(); ++it) {
+		if (it.key().startsWith(prefix))
+			files.append(it.key());
+	}
+	return files;
+}
+
+QString ArticleCatalog::findBySha1(const QByteArray &sha1, const QString &except) const
+{
+	QMutexLocker locker(&m_mutex);
+	QString path = m_bySha1.value(sha1);
+	return path == except ? QString() : path;
+}
+
+QList<ArticleRecord> ArticleCatalog::records() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_records.values();
+}
+
+QJsonObject ArticleCatalog::toJson(const ArticleRecord &record)
+{
+	QJsonObject object;
+	object.insert("filePath", record.filePath);
+	object.insert("size", double(record.size));
+	object.insert("modified", record.modified.toString(Qt::ISODateWithMs));
+	object.insert("valid", record.valid);
+	object.insert("error", record.error);
+	object.insert("sha1", QString::fromLatin1(record.sha1));
+	object.insert("duplicateOf", record.duplicateOf);
+	object.insert("title", record.title);
+	object.insert("origin", record.origin);
+	object.insert("date", record.date);
+	object.insert("parts", record.parts);
+	object.insert("scripts", record.scripts);
+	object.insert("partsComplete", record.partsComplete);
+	object.insert("thumbnail", record.thumbnailPath);
+	object.insert("text", record.textPath);
+	object.insert("excerpt", record.excerpt);
+	return object;
+}
+
+ArticleRecord ArticleCatalog::fromJson(const QJsonObject &object)
+{
+	ArticleRecord record;
+	record.filePath = object.value("filePath").toString();
+	record.size = qint64(object.value("size").toDouble());
+	record.modified = QDateTime::fromString(object.value("modified").toString(), Qt::ISODateWithMs);
+	record.valid = object.value("valid").toBool();
+	record.error = object.value("error").toString();
+	record.sha1 = object.value("sha1").toString().toLatin1();
+	record.duplicateOf = object.value("duplicateOf").toString();
+	record.title = object.value("title").toString();
+	record.origin = object.value("origin").toString();
+	record.date = object.value("date").toString();
+	record.parts = object.value("parts").toInt();
+	record.scripts = object.value("scripts").toInt(-1);
+	record.partsComplete = object.value("partsComplete").toBool();
+	record.thumbnailPath = object.value("thumbnail").toString();
+	record.textPath = object.value("text").toString();
+	record.excerpt = object.value("excerpt").toString();
+	return record;
+}
+
+void ArticleCatalog::load()
+{
+	QFile file(cacheFolder() + "/catalog.json");
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+	const QJsonArray records = QJsonDocument::fromJson(file.readAll()).array();
+	for (const QJsonValue &value : records)
+		insert(fromJson(value.toObject()));
+}
+
+void ArticleCatalog::save() const
+{
+	QJsonArray records;
+	{
+		QMutexLocker locker(&m_mutex);
+		for (const ArticleRecord &record : m_records)
+			records.append(toJson(record));
+	}
+	QSaveFile file(cacheFolder() + "/catalog.json");
+	if (file.open(QIODevice::WriteOnly)) {
+		file.write(QJsonDocument(records).toJson(QJsonDocument::Compact));
+		file.commit();
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef ARTICLECATALOG_H
+#define ARTICLECATALOG_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+// Everything the ingestion pipeline learned about one archive
+struct ArticleRecord
+{
+	QString filePath;
+	qint64 size = 0;
+	QDateTime modified;
+	bool valid = false;
+	QString error;
+	QByteArray sha1;           // hex
+	QString duplicateOf;       // earlier file with the same content
+	QString title;
+	QString origin;
+	QString date;
+	int parts = 0;
+	int scripts = -1;            // not counted, e.g. read from an older catalog
+	bool partsComplete = false;  // LoadPolicy counted the parts of the whole file
+	QString thumbnailPath;     // empty when the archive has no usable image
+	QString textPath;
+	QString excerpt;
+
+	// Still describes the file on disk
+	bool isCurrent() const;
+};
+
+// Thread-safe store of ingested records, persisted as JSON in the cache folder
+class ArticleCatalog
+{
+public:
+	ArticleCatalog();
+
+	bool find(const QString &filePath, ArticleRecord *record) const;
+	void insert(const ArticleRecord &record);
+	void remove(const QString &filePath);
+	// Drops the record unless it was replaced since it was read
+	void removeIfUnchanged(const ArticleRecord &record);
+	// Re-keys the record of a moved file, or those of every file under a moved folder;
+	// records whose file is not at the new place are left alone
+	void move(const QString &from, const QString &to);
+	// Paths of the file, or of every file under the folder, that have a record
+	QStringList filesUnder(const QString &path) const;
+	QString findBySha1(const QByteArray &sha1, const QString &except) const;
+	QList<ArticleRecord> records() const;
+
+	// Records are taken as saved, the ingest pipeline checks them against the disk
+	void load();
+	void save() const;
+
+	static QString cacheFolder();
+	static QJsonObject toJson(const ArticleRecord &record);
+	static ArticleRecord fromJson(const QJsonObject &object);
+
+private:
+	mutable QMutex m_mutex;
+	QHash<QString, ArticleRecord> m_records;
+	QHash<QByteArray, QString> m_bySha1;
+};
+
+#endif // ARTICLECATALOG_H
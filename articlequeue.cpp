@@ -0,0 +1,102 @@
+#include "articlequeue.h"
+#include "backgroundscheduler.h"
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+
+ArticleQueue::ArticleQueue(QObject *parent)
+	: QObject(parent)
+	, m_rescanPending(false)
+{
+	connect(&m_scanWatcher, &QFutureWatcher<QStringList>::finished, this, &ArticleQueue::handleScanFinished);
+}
+
+void ArticleQueue::setSourceFolder(const QString &folder)
+{
+	if (m_sourceFolder == folder)
+		return;
+	m_sourceFolder = folder;
+	m_files.clear();
+	emit changed();
+}
+
+QString ArticleQueue::head() const
+{
+	// The snapshot may be stale, skip files that were moved away meanwhile
+	for (const QString &filePath : m_files) {
+		if (QFile::exists(filePath))
+			return filePath;
+	}
+	return QString();
+}
+
+QStringList ArticleQueue::upcoming(int count) const
+{
+	return m_files.mid(0, count);
+}
+
+void ArticleQueue::remove(const QString &filePath)
+{
+	if (m_files.removeAll(filePath) > 0)
+		emit changed();
+}
+
+void ArticleQueue::restoreSnapshot()
+{
+	QSettings settings;
+	settings.beginGroup("queueSnapshot");
+	if (settings.value("sourceFolder").toString() == m_sourceFolder)
+		m_files = settings.value("files").toStringList();
+	settings.endGroup();
+	emit changed();
+}
+
+void ArticleQueue::saveSnapshot() const
+{
+	QSettings settings;
+	settings.beginGroup("queueSnapshot");
+	settings.setValue("sourceFolder", m_sourceFolder);
+	settings.setValue("files", m_files);
+	settings.endGroup();
+}
+
+void ArticleQueue::rescan()
+{
+	if (m_sourceFolder.isEmpty())
+		return;
+	if (m_scanWatcher.isRunning()) {
+		m_rescanPending = true;
+		return;
+	}
+	m_scanningFolder = m_sourceFolder;
+	const QString folder = m_sourceFolder;
+	// The next article to triage comes from this list, it is not held back
+	m_scanWatcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "queue.scan",
+		[folder](BackgroundJob &) { return scanFolder(folder); }));
+}
+
+QStringList ArticleQueue::scanFolder(const QString &folder)
+{
+	QDir dir(folder);
+	QStringList files;
+	const QStringList names = dir.entryList(QStringList() << "*.mhtml" << "*.mht", QDir::Files, QDir::Name);
+	for (const QString &name : names)
+		files.append(dir.filePath(name));
+	return files;
+}
+
+void ArticleQueue::handleScanFinished()
+{
+	if (m_rescanPending || m_scanningFolder != m_sourceFolder) {
+		// The folder changed during the scan, the result is obsolete
+		m_rescanPending = false;
+		rescan();
+		return;
+	}
+	QStringList files = m_scanWatcher.result();
+	if (files != m_files) {
+		m_files = files;
+		emit changed();
+	}
+	emit scanFinished();
+}
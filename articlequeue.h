@@ -0,0 +1,47 @@
+#ifndef ARTICLEQUEUE_H
+#define ARTICLEQUEUE_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+
+// Ordered list of unprocessed MHTML files in the source folder.
+// The list is persisted as a snapshot so the first article can be opened
+// at startup without scanning the folder; rescan() reconciles it in the background.
+class ArticleQueue : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ArticleQueue(QObject *parent = nullptr);
+
+	void setSourceFolder(const QString &folder);
+	QString sourceFolder() const { return m_sourceFolder; }
+
+	QString head() const;
+	QStringList upcoming(int count) const;
+	QStringList files() const { return m_files; }
+	void remove(const QString &filePath);
+
+	void restoreSnapshot();
+	void saveSnapshot() const;
+	void rescan();
+
+	static QStringList scanFolder(const QString &folder);
+
+signals:
+	void changed();
+	// A rescan() is complete, whether or not the list changed
+	void scanFinished();
+
+private:
+	void handleScanFinished();
+
+	QString m_sourceFolder;
+	QString m_scanningFolder;
+	QStringList m_files;
+	bool m_rescanPending;
+	QFutureWatcher<QStringList> m_scanWatcher;
+};
+
+#endif // ARTICLEQUEUE_H
@@ -0,0 +1,289 @@
+#include "backgroundscheduler.h"
+#include "timinglog.h"
+#include <QApplication>
+#include <QEvent>
+#include <QSettings>
+#include <QThread>
+#include <QtConcurrent>
+
+// The user counts as idle after this long without input and with no page loading
+static const int IdleAfterMs = 3000;
+// Held back jobs also look at their cancel flag this often
+static const int PollMs = 100;
+static const int DefaultBusyIoMBps = 8;
+// Workers only interactive jobs may use, on top of one per core
+static const int InteractiveWorkers = 1;
+
+BackgroundScheduler *BackgroundScheduler::instance()
+{
+	static BackgroundScheduler *scheduler = new BackgroundScheduler(qApp);
+	return scheduler;
+}
+
+BackgroundScheduler::BackgroundScheduler(QObject *parent)
+	: QObject(parent)
+	, m_workers(0)
+	, m_userActive(false)
+	, m_stopping(false)
+	, m_ioTokens(0)
+{
+	for (int &running : m_running)
+		running = 0;
+	m_pool.setMaxThreadCount(QThread::idealThreadCount() + InteractiveWorkers);
+	m_busyIoBytesPerSecond = qint64(QSettings().value("scheduler/busyIoMBps", DefaultBusyIoMBps).toInt()) * 1024 * 1024;
+	m_ioRefilled.start();
+
+	m_idleTimer.setSingleShot(true);
+	m_idleTimer.setInterval(IdleAfterMs);
+	connect(&m_idleTimer, &QTimer::timeout, this, [this]() {
+		if (m_loading.isEmpty())
+			setUserActive(false);
+	});
+	if (qApp)
+		qApp->installEventFilter(this);
+}
+
+BackgroundScheduler::~BackgroundScheduler()
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		m_stopping = true;
+		for (QQueue<Task> &queue : m_queues) {
+			for (Task &task : queue) {
+				task.future.cancel();
+				task.future.reportFinished();
+			}
+			queue.clear();
+		}
+		m_resumed.wakeAll();
+	}
+	m_pool.waitForDone();
+}
+
+void BackgroundScheduler::enqueue(Priority priority, const QString &name, const QFutureInterfaceBase &future,
+	const std::function<void(BackgroundJob &)> &body)
+{
+	Task task;
+	task.priority = priority;
+	task.name = name;
+	task.future = future;
+	task.body = body;
+	task.queued.start();
+	{
+		QMutexLocker locker(&m_mutex);
+		if (m_stopping) {
+			task.future.cancel();
+			task.future.reportFinished();
+			return;
+		}
+		m_queues[priority].enqueue(task);
+	}
+	dispatch();
+}
+
+bool BackgroundScheduler::canStart(Priority priority) const
+{
+	if (m_stopping)
+		return false;
+	if (priority == Interactive)
+		return true;
+	// Held back jobs keep their worker, the last ones stay free for interactive work
+	if (m_running[Normal] + m_running[Idle] >= m_pool.maxThreadCount() - InteractiveWorkers)
+		return false;
+	if (priority == Normal)
+		return !m_userActive || m_running[Normal] == 0;
+	return !m_userActive;
+}
+
+void BackgroundScheduler::dispatch()
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		int startable = 0;
+		for (int priority = 0; priority < PriorityCount; ++priority) {
+			if (canStart(Priority(priority)))
+				startable += m_queues[priority].size();
+		}
+		// Workers take the most urgent task they may run and keep going until none is left
+		for (; startable > 0 && m_workers < m_pool.maxThreadCount(); --startable) {
+			++m_workers;
+			QtConcurrent::run(&m_pool, [this]() { work(); });
+		}
+	}
+	reportStatus();
+}
+
+bool BackgroundScheduler::takeTask(Task &task)
+{
+	QMutexLocker locker(&m_mutex);
+	// Cancelled tasks finish right away, whatever their priority
+	for (QQueue<Task> &queue : m_queues) {
+		for (int i = queue.size() - 1; i >= 0; --i) {
+			if (queue.at(i).future.isCanceled()) {
+				queue[i].future.reportFinished();
+				queue.removeAt(i);
+			}
+		}
+	}
+	for (int priority = 0; priority < PriorityCount; ++priority) {
+		if (!m_queues[priority].isEmpty() && canStart(Priority(priority))) {
+			task = m_queues[priority].dequeue();
+			++m_running[priority];
+			return true;
+		}
+	}
+	--m_workers;
+	return false;
+}
+
+void BackgroundScheduler::work()
+{
+	Task task;
+	while (takeTask(task)) {
+		const qint64 waitedMs = task.queued.elapsed();
+		QElapsedTimer timer;
+		timer.start();
+		// Idle work also yields the processor to the renderer processes
+		if (task.priority == Idle)
+			QThread::currentThread()->setPriority(QThread::LowPriority);
+		BackgroundJob job(this, task.priority, task.future);
+		task.body(job);
+		task.future.reportFinished();
+		if (task.priority == Idle)
+			QThread::currentThread()->setPriority(QThread::NormalPriority);
+		TimingLog::write("job." + task.name, timer.elapsed(), QString("priority=%1 waited=%2ms%3")
+			.arg(int(task.priority)).arg(waitedMs).arg(task.future.isCanceled() ? " cancelled" : ""));
+		{
+			QMutexLocker locker(&m_mutex);
+			--m_running[task.priority];
+		}
+		task = Task();
+		reportStatus();
+	}
+}
+
+bool BackgroundScheduler::throttle(Priority priority, qint64 ioBytes, const std::function<bool()> &cancelled)
+{
+	QMutexLocker locker(&m_mutex);
+	for (;;) {
+		if (m_stopping || (cancelled && cancelled()))
+			return false;
+		if (priority == Interactive || !m_userActive)
+			return true;
+		if (priority == Normal) {
+			// Token bucket holding at most one second of the budget; a large read
+			// goes through at once and makes the following ones wait
+			const double elapsed = double(m_ioRefilled.restart());
+			m_ioTokens = qMin(double(m_busyIoBytesPerSecond), m_ioTokens + elapsed * m_busyIoBytesPerSecond / 1000.0);
+			if (m_ioTokens > 0) {
+				m_ioTokens -= ioBytes;
+				return true;
+			}
+		}
+		m_resumed.wait(&m_mutex, PollMs);
+	}
+}
+
+bool BackgroundScheduler::isUserActive() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_userActive;
+}
+
+void BackgroundScheduler::setUserActive(bool active)
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		if (m_userActive == active)
+			return;
+		m_userActive = active;
+		if (!active)
+			m_resumed.wakeAll();
+	}
+	if (active)
+		reportStatus();
+	else
+		dispatch();
+}
+
+void BackgroundScheduler::noteActivity()
+{
+	setUserActive(true);
+	if (m_loading.isEmpty())
+		m_idleTimer.start();
+}
+
+void BackgroundScheduler::setLoading(QObject *view, bool loading)
+{
+	if (loading) {
+		m_loading.insert(view);
+		connect(view, &QObject::destroyed, this, &BackgroundScheduler::forgetView, Qt::UniqueConnection);
+		m_idleTimer.stop();
+		setUserActive(true);
+	} else if (m_loading.remove(view) && m_loading.isEmpty()) {
+		m_idleTimer.start();
+	}
+}
+
+void BackgroundScheduler::forgetView(QObject *view)
+{
+	setLoading(view, false);
+}
+
+bool BackgroundScheduler::eventFilter(QObject *watched, QEvent *event)
+{
+	switch (event->type()) {
+	case QEvent::KeyPress:
+	case QEvent::MouseButtonPress:
+	case QEvent::Wheel:
+		noteActivity();
+		break;
+	default:
+		break;
+	}
+	return QObject::eventFilter(watched, event);
+}
+
+void BackgroundScheduler::reportStatus()
+{
+	int running = 0;
+	int queued = 0;
+	bool userActive;
+	{
+		QMutexLocker locker(&m_mutex);
+		for (int priority = 0; priority < PriorityCount; ++priority) {
+			running += m_running[priority];
+			queued += m_queues[priority].size();
+		}
+		userActive = m_userActive;
+	}
+	QMetaObject::invokeMethod(this, [this, running, queued, userActive]() {
+		emit statusChanged(running, queued, userActive);
+	}, Qt::QueuedConnection);
+}
+
+void BackgroundJob::setProgress(int done, int total)
+{
+	m_future.setProgressRange(0, total);
+	m_future.setProgressValue(done);
+}
+
+bool BackgroundJob::checkpoint(qint64 ioBytes)
+{
+	return m_scheduler->throttle(m_priority, ioBytes, [this]() { return isCancelled(); });
+}
+
+void BackgroundJob::forEach(int count, const std::function<void(int)> &function)
+{
+	QThreadPool pool;
+	pool.setMaxThreadCount(QThread::idealThreadCount());
+	for (int i = 0; i < count; ++i) {
+		QtConcurrent::run(&pool, [this, &function, i]() {
+			if (m_priority == BackgroundScheduler::Idle)
+				QThread::currentThread()->setPriority(QThread::LowPriority);
+			if (checkpoint())
+				function(i);
+		});
+	}
+	pool.waitForDone();
+}
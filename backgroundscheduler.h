@@ -0,0 +1,158 @@
+#ifndef BACKGROUNDSCHEDULER_H
+#define BACKGROUNDSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QWaitCondition>
+#include <functional>
+#include <utility>
+
+class BackgroundJob;
+
+// One pool for the background work of all windows, ordered by priority.
+// While the user is triaging (input in the last seconds or a page still
+// loading) idle work is held back and normal work is limited to one job and a
+// disk budget; both ramp up to every core once the user is idle. One worker is
+// kept for interactive jobs, held back work can never take all of them.
+// Jobs are plain functions returning a QFuture, so existing QFutureWatchers
+// keep working and cancel() or progress go through the future as usual.
+class BackgroundScheduler : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Priority
+	{
+		Interactive,                   // the user waits for it, never held back
+		Normal,                        // indexing the user will need soon
+		Idle,                          // maintenance, only while the user is idle
+		PriorityCount
+	};
+
+	// The first call has to come from the GUI thread, main() makes it
+	static BackgroundScheduler *instance();
+	~BackgroundScheduler();
+
+	// function(BackgroundJob &) runs on a worker; its result is the result of the future
+	template <typename Function>
+	auto run(Priority priority, const QString &name, Function function)
+		-> QFuture<decltype(function(std::declval<BackgroundJob &>()))>;
+
+	// For long-running loops on threads of their own: waits while work of this
+	// priority is held back and charges ioBytes against the disk budget.
+	// Returns false once cancelled says so.
+	bool throttle(Priority priority, qint64 ioBytes = 0, const std::function<bool()> &cancelled = nullptr);
+
+	bool isUserActive() const;
+	// Views report their loads, any unfinished load counts as activity
+	void setLoading(QObject *view, bool loading);
+
+signals:
+	void statusChanged(int running, int queued, bool userActive);
+
+protected:
+	bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+	struct Task
+	{
+		Priority priority;
+		QString name;
+		QFutureInterfaceBase future;
+		std::function<void(BackgroundJob &)> body;
+		QElapsedTimer queued;
+	};
+
+	explicit BackgroundScheduler(QObject *parent = nullptr);
+	void enqueue(Priority priority, const QString &name, const QFutureInterfaceBase &future,
+		const std::function<void(BackgroundJob &)> &body);
+	void dispatch();
+	void work();
+	bool takeTask(Task &task);
+	bool canStart(Priority priority) const;
+	void setUserActive(bool active);
+	void noteActivity();
+	void forgetView(QObject *view);
+	void reportStatus();
+
+	QThreadPool m_pool;
+	mutable QMutex m_mutex;
+	QWaitCondition m_resumed;
+	QQueue<Task> m_queues[PriorityCount];
+	int m_running[PriorityCount];
+	int m_workers;
+	bool m_userActive;
+	bool m_stopping;
+	qint64 m_busyIoBytesPerSecond;
+	double m_ioTokens;               // bytes normal work may read now while the user is active
+	QElapsedTimer m_ioRefilled;
+	QSet<QObject *> m_loading;       // GUI thread only
+	QTimer m_idleTimer;
+};
+
+// Handed to every job; all of it is safe to call from any thread the job uses
+class BackgroundJob
+{
+public:
+	bool isCancelled() const { return m_future.isCanceled(); }
+	void setProgress(int done, int total);
+	// Waits while the priority of the job is held back; false once the job is cancelled
+	bool checkpoint(qint64 ioBytes = 0);
+	// Calls function(0) ... function(count - 1) on every core, each call after a checkpoint.
+	// The threads belong to the job, held back calls do not block the global pool.
+	void forEach(int count, const std::function<void(int)> &function);
+	BackgroundScheduler::Priority priority() const { return m_priority; }
+
+private:
+	friend class BackgroundScheduler;
+	BackgroundJob(BackgroundScheduler *scheduler, BackgroundScheduler::Priority priority, const QFutureInterfaceBase &future)
+		: m_scheduler(scheduler), m_priority(priority), m_future(future) {}
+
+	BackgroundScheduler *m_scheduler;
+	BackgroundScheduler::Priority m_priority;
+	QFutureInterfaceBase m_future;
+};
+
+template <typename T>
+struct BackgroundResult
+{
+	template <typename Function>
+	static void run(QFutureInterface<T> &future, Function &function, BackgroundJob &job)
+	{
+		const T result = function(job);
+		future.reportResult(result);
+	}
+};
+
+template <>
+struct BackgroundResult<void>
+{
+	template <typename Function>
+	static void run(QFutureInterface<void> &, Function &function, BackgroundJob &job)
+	{
+		function(job);
+	}
+};
+
+template <typename Function>
+auto BackgroundScheduler::run(Priority priority, const QString &name, Function function)
+	-> QFuture<decltype(function(std::declval<BackgroundJob &>()))>
+{
+	typedef decltype(function(std::declval<BackgroundJob &>())) Result;
+	QFutureInterface<Result> future;
+	// Started while queued, like QtConcurrent::run, so watchers see it running
+	future.reportStarted();
+	enqueue(priority, name, future, [future, function](BackgroundJob &job) mutable {
+		BackgroundResult<Result>::run(future, function, job);
+	});
+	return future.future();
+}
+
+#endif // BACKGROUNDSCHEDULER_H
@@ -0,0 +1,250 @@
+#include "batchexporter.h"
+#include "timinglog.h"
+#include "webpage.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QPageLayout>
+#include <QPageSize>
+#include <QThread>
+#include <QTimer>
+#include <QWebEngineView>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+// A rendered article page costs roughly this much in the render process
+static const qint64 MemoryPerPage = 256LL * 1024 * 1024;
+static const int MaxAttempts = 2;
+static const int LoadTimeoutMs = 60000;
+static const int ImageWidth = 1280;
+static const int MaxImageHeight = 16384;
+// Lets the compositor paint the resized view before it is grabbed
+static const int PaintDelayMs = 250;
+
+BatchExporter::BatchExporter(QWebEngineProfile *profile, QObject *parent)
+	: QObject(parent)
+	, m_profile(profile)
+	, m_format(Pdf)
+	, m_generation(0)
+	, m_total(0)
+	, m_done(0)
+	, m_failed(0)
+	, m_skipped(0)
+	, m_bytes(0)
+{
+}
+
+BatchExporter::~BatchExporter()
+{
+	cancel();
+}
+
+int BatchExporter::concurrencyForMemory()
+{
+	qint64 available = 0;
+#if defined(Q_OS_WIN)
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status))
+		available = qint64(status.ullAvailPhys);
+#elif defined(Q_OS_LINUX)
+	QFile meminfo(QStringLiteral("/proc/meminfo"));
+	if (meminfo.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		while (!meminfo.atEnd()) {
+			QByteArray line = meminfo.readLine();
+			if (line.startsWith("MemAvailable:")) {
+				available = line.mid(13).trimmed().split(' ').value(0).toLongLong() * 1024;
+				break;
+			}
+		}
+	}
+#endif
+	if (available <= 0)
+		return 2;
+	// Keep half of the free memory for the rest of the system
+	int pages = int(available / 2 / MemoryPerPage);
+	return qBound(1, pages, QThread::idealThreadCount());
+}
+
+QString BatchExporter::targetPath(const QString &source) const
+{
+	QString relative = QDir(m_sourceFolder).relativeFilePath(source);
+	QFileInfo info(m_outputFolder + '/' + relative);
+	return info.absolutePath() + '/' + info.completeBaseName() + (m_format == Pdf ? ".pdf" : ".png");
+}
+
+bool BatchExporter::start(const QString &sourceFolder, const QString &outputFolder, Format format)
+{
+	if (isRunning())
+		return false;
+	m_sourceFolder = QDir(sourceFolder).absolutePath();
+	m_outputFolder = QDir(outputFolder).absolutePath();
+	m_format = format;
+	m_pending.clear();
+	m_attempts.clear();
+	m_total = m_done = m_failed = m_skipped = 0;
+	m_bytes = 0;
+	m_timer.start();
+
+	QDirIterator it(m_sourceFolder, QStringList() << "*.mhtml" << "*.mht", QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		const QString source = it.next();
+		// Resume: outputs newer than their archive are already done
+		QFileInfo target(targetPath(source));
+		if (target.exists() && target.lastModified() >= it.fileInfo().lastModified()) {
+			++m_skipped;
+			continue;
+		}
+		m_pending.append(source);
+	}
+	m_total = m_pending.size();
+	if (m_pending.isEmpty()) {
+		emit finished(0, m_skipped, 0, m_timer.elapsed());
+		return true;
+	}
+
+	const int count = qMin(concurrencyForMemory(), m_pending.size());
+	for (int i = 0; i < count; ++i) {
+		Slot *slot = new Slot;
+		slot->page = new WebPage(m_profile, this);
+		// Archives are static snapshots, their scripts only slow the export down
+		slot->page->setTriageMode(true);
+		if (m_format == Png) {
+			slot->view = new QWebEngineView;
+			slot->view->setAttribute(Qt::WA_DontShowOnScreen);
+			slot->view->setPage(slot->page);
+			slot->view->resize(ImageWidth, 800);
+			slot->view->show();
+		}
+		slot->timeout = new QTimer(this);
+		slot->timeout->setSingleShot(true);
+		slot->timeout->setInterval(LoadTimeoutMs);
+		connect(slot->timeout, &QTimer::timeout, this, [this, slot]() { complete(slot, false); });
+		connect(slot->page, &QWebEnginePage::loadStarted, this, [slot]() { slot->loading = true; });
+		// A navigation abandoned after a timeout reports its end before the next one starts
+		connect(slot->page, &QWebEnginePage::loadFinished, this, [this, slot](bool ok) {
+			if (slot->loading)
+				handleLoadFinished(slot, ok);
+		});
+		connect(slot->page, &QWebEnginePage::pdfPrintingFinished, this, [this, slot](const QString &filePath, bool ok) {
+			if (!slot->source.isEmpty() && filePath == slot->target + ".part")
+				complete(slot, ok);
+		});
+		m_slots.append(slot);
+		loadNext(slot);
+	}
+	TimingLog::write("export.start", 0, QString("%1 files, %2 pages").arg(m_total).arg(count));
+	return true;
+}
+
+void BatchExporter::cancel()
+{
+	m_pending.clear();
+	while (!m_slots.isEmpty())
+		releaseSlot(m_slots.first());
+}
+
+void BatchExporter::loadNext(Slot *slot)
+{
+	if (m_pending.isEmpty()) {
+		releaseSlot(slot);
+		if (m_slots.isEmpty()) {
+			qint64 elapsed = m_timer.elapsed();
+			TimingLog::write("export.finished", elapsed, QString("%1 files, %2 failed, %3 MB, %4 files/min")
+				.arg(m_done).arg(m_failed).arg(m_bytes / (1024 * 1024))
+				.arg(elapsed > 0 ? m_done * 60000.0 / elapsed : 0.0, 0, 'f', 1));
+			emit finished(m_done, m_skipped, m_failed, elapsed);
+		}
+		return;
+	}
+	slot->source = m_pending.takeFirst();
+	slot->target = targetPath(slot->source);
+	slot->generation = ++m_generation;
+	slot->loading = false;
+	QDir().mkpath(QFileInfo(slot->target).absolutePath());
+	slot->timeout->start();
+	slot->page->setUrl(QUrl::fromLocalFile(slot->source));
+}
+
+void BatchExporter::handleLoadFinished(Slot *slot, bool ok)
+{
+	if (slot->source.isEmpty())
+		return;
+	slot->loading = false;
+	if (!ok) {
+		complete(slot, false);
+		return;
+	}
+	if (m_format == Pdf) {
+		slot->page->printToPdf(slot->target + ".part", QPageLayout(QPageSize(QPageSize::A4),
+			QPageLayout::Portrait, QMarginsF(10, 10, 10, 10), QPageLayout::Millimeter));
+		return;
+	}
+	// Grow the view to the whole document before grabbing it
+	QSizeF contents = slot->page->contentsSize();
+	slot->view->resize(ImageWidth, qBound(1, int(contents.height()), MaxImageHeight));
+	const int generation = slot->generation;
+	QTimer::singleShot(PaintDelayMs, this, [this, slot, generation]() {
+		if (isCurrent(slot, generation))
+			grabImage(slot);
+	});
+}
+
+void BatchExporter::grabImage(Slot *slot)
+{
+	if (slot->source.isEmpty())
+		return;
+	complete(slot, slot->view->grab().save(slot->target + ".part", "PNG"));
+}
+
+void BatchExporter::complete(Slot *slot, bool ok)
+{
+	if (slot->source.isEmpty())
+		return;
+	slot->timeout->stop();
+	const QString source = slot->source;
+	const QString part = slot->target + ".part";
+	slot->source.clear();
+
+	if (ok) {
+		QFile::remove(slot->target);
+		ok = QFile::rename(part, slot->target);
+	}
+	if (ok) {
+		++m_done;
+		m_bytes += QFileInfo(source).size();
+	} else {
+		QFile::remove(part);
+		// One more try at the end of the queue, a busy render process is the usual cause
+		if (++m_attempts[source] < MaxAttempts)
+			m_pending.append(source);
+		else
+			++m_failed;
+	}
+	emit progress(m_done, m_failed, m_total);
+	loadNext(slot);
+}
+
+void BatchExporter::releaseSlot(Slot *slot)
+{
+	m_slots.removeOne(slot);
+	slot->source.clear();
+	// Nothing may reach the slot once it is deleted
+	disconnect(slot->page, nullptr, this, nullptr);
+	disconnect(slot->timeout, nullptr, this, nullptr);
+	slot->timeout->stop();
+	slot->timeout->deleteLater();
+	// The view does not own its page; deleting the view first keeps the page valid for it
+	if (slot->view)
+		slot->view->deleteLater();
+	slot->page->deleteLater();
+	delete slot;
+}
+
+bool BatchExporter::isCurrent(const Slot *slot, int generation) const
+{
+	// Generations are unique over all slots, a new slot at the same address does not match
+	return m_slots.contains(const_cast<Slot*>(slot)) && slot->generation == generation;
+}
@@ -0,0 +1,77 @@
+#ifndef BATCHEXPORTER_H
+#define BATCHEXPORTER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+class QWebEngineProfile;
+class QWebEngineView;
+QT_END_NAMESPACE
+
+class WebPage;
+
+// Renders every archive of a folder tree to PDF or PNG with a small pool of
+// offscreen pages. Outputs are written under a temporary name and renamed when
+// complete, so an interrupted export resumes by skipping finished files.
+class BatchExporter : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Format { Pdf, Png };
+
+	BatchExporter(QWebEngineProfile *profile, QObject *parent = nullptr);
+	~BatchExporter();
+
+	bool isRunning() const { return !m_slots.isEmpty(); }
+	bool start(const QString &sourceFolder, const QString &outputFolder, Format format);
+	void cancel();
+
+	// Pages that fit into the available physical memory, at least one
+	static int concurrencyForMemory();
+
+signals:
+	void progress(int done, int failed, int total);
+	void finished(int exported, int skipped, int failed, qint64 ms);
+
+private:
+	struct Slot
+	{
+		WebPage *page = nullptr;
+		QWebEngineView *view = nullptr;
+		QTimer *timeout = nullptr;
+		QString source;
+		QString target;
+		int generation = 0;            // new for every file, callbacks for an earlier one are dropped
+		bool loading = false;          // the load of the current file has started
+	};
+
+	void loadNext(Slot *slot);
+	void handleLoadFinished(Slot *slot, bool ok);
+	void grabImage(Slot *slot);
+	void complete(Slot *slot, bool ok);
+	void releaseSlot(Slot *slot);
+	bool isCurrent(const Slot *slot, int generation) const;
+	QString targetPath(const QString &source) const;
+
+	QWebEngineProfile *m_profile;
+	Format m_format;
+	QString m_sourceFolder;
+	QString m_outputFolder;
+	QStringList m_pending;
+	QHash<QString, int> m_attempts;
+	QList<Slot*> m_slots;
+	int m_generation;
+	int m_total;
+	int m_done;
+	int m_failed;
+	int m_skipped;
+	qint64 m_bytes;
+	QElapsedTimer m_timer;
+};
+
+#endif // BATCHEXPORTER_H
@@ -0,0 +1,67 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+// Blocking FIFO with a fixed capacity, connects the stages of a pipeline.
+// A full queue stalls the producer, so a slow stage limits the memory held
+// by the stages in front of it.
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(int capacity) : m_capacity(capacity), m_closed(false) {}
+
+	// Returns false once the queue is closed
+	bool push(const T &item)
+	{
+		QMutexLocker locker(&m_mutex);
+		while (m_items.size() >= m_capacity && !m_closed)
+			m_notFull.wait(&m_mutex);
+		if (m_closed)
+			return false;
+		m_items.enqueue(item);
+		m_notEmpty.wakeOne();
+		return true;
+	}
+
+	// Returns false when the queue is closed and drained
+	bool pop(T &item)
+	{
+		QMutexLocker locker(&m_mutex);
+		while (m_items.isEmpty() && !m_closed)
+			m_notEmpty.wait(&m_mutex);
+		if (m_items.isEmpty())
+			return false;
+		item = m_items.dequeue();
+		m_notFull.wakeOne();
+		return true;
+	}
+
+	void close()
+	{
+		QMutexLocker locker(&m_mutex);
+		m_closed = true;
+		m_notEmpty.wakeAll();
+		m_notFull.wakeAll();
+	}
+
+	void clear()
+	{
+		QMutexLocker locker(&m_mutex);
+		m_items.clear();
+		m_notFull.wakeAll();
+	}
+
+private:
+	QMutex m_mutex;
+	QWaitCondition m_notEmpty;
+	QWaitCondition m_notFull;
+	QQueue<T> m_items;
+	const int m_capacity;
+	bool m_closed;
+};
+
+#endif // BOUNDEDQUEUE_H
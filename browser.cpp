@@ -1,16 +1,18 @@
 
 #include "browser.h"
 #include "browserwindow.h"
+#include "profileconfig.h"
 
 Browser::Browser()
 {
+    ProfileConfig::load().apply(QWebEngineProfile::defaultProfile());
 }
 
 BrowserWindow *Browser::createWindow(bool offTheRecord)
 {
     if (offTheRecord && !m_otrProfile) {
         m_otrProfile.reset(new QWebEngineProfile);
-        
+        ProfileConfig::load().apply(m_otrProfile.get());
     }
     auto profile = offTheRecord ? m_otrProfile.get() : QWebEngineProfile::defaultProfile();
     auto mainWindow = new BrowserWindow(this, profile, false);
@@ -1,6 +1,7 @@
 
 #include "browser.h"
 #include "browserwindow.h"
+#include "tablist.h"
 #include "tabwidget.h"
 #include "webview.h"
 #include <QApplication>
@@ -14,6 +15,7 @@
 #include <QProgressBar>
 #include <QScreen>
 #include <QStatusBar>
+#include <QTabBar>
 #include <QToolBar>
 #include <QVBoxLayout>
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
@@ -26,9 +28,39 @@
 #include <QFileSystemModel>
 #include <QLabel>
 #include <QSettings>
+#include <QStandardPaths>
 #include <QTimer>
+#include <QJsonArray>
 
 #include "EmptyFoldersFileSystemModel.h"
+#include "archiveshrinker.h"
+#include "archiveslimmer.h"
+#include "backgroundscheduler.h"
+#include "articlequeue.h"
+#include "batchexporter.h"
+#include "categoryclassifier.h"
+#include "categoryindex.h"
+#include "categoryoperations.h"
+#include "categorypalette.h"
+#include "controlserver.h"
+#include "findpanel.h"
+#include "ingestpipeline.h"
+#include "lazyarchivehandler.h"
+#include "pagecapture.h"
+#include "partinspector.h"
+#include "previewpane.h"
+#include "readablepage.h"
+#include "readahead.h"
+#include "resourcemonitor.h"
+#include "timinglog.h"
+#include "tracerecorder.h"
+#include "webpage.h"
+#include "workclaims.h"
+#include <QtConcurrent>
+#include <memory>
+
+// Time from main() to the first article being rendered
+static const qint64 StartupBudgetMs = 2000;
 
 BrowserWindow::BrowserWindow(Browser *browser, QWebEngineProfile *profile, bool forDevTools)
     : m_browser(browser)
@@ -42,6 +74,19 @@ BrowserWindow::BrowserWindow(Browser *browser, QWebEngineProfile *profile, bool
     , m_stopReloadAction(nullptr)
     , m_urlLineEdit(nullptr)
     , m_favAction(nullptr)
+    , m_fastTriageAction(nullptr)
+    , m_readableAction(nullptr)
+    , m_previewOnDemandAction(nullptr)
+    , m_fastTriage(false)
+    , m_readableTriage(false)
+    , m_previewOnDemand(false)
+    , m_ownsSession(false)
+    , m_awaitingScan(false)
+    , m_loadGeneration(0)
+    , m_ingest(nullptr)
+    , m_controlServer(nullptr)
+    , m_traceRecorder(TraceRecorder::port() ? new TraceRecorder(this) : nullptr)
+    , m_imageBudget(0)
 {
 
 	//  -   
@@ -60,6 +105,18 @@ BrowserWindow::BrowserWindow(Browser *browser, QWebEngineProfile *profile, bool
 	m_tagsEdit->setPlaceholderText(tr("Comma-separated tags"));
 
 	sidebarLayout->addWidget(moveArticleBtn);
+	// Categories suggested by the classifier, Alt+1..3 files the article there
+	QLabel *suggestionsLabel = new QLabel(tr("Suggested:"));
+	sidebarLayout->addWidget(suggestionsLabel);
+	for (int i = 0; i < SuggestionCount; ++i) {
+		m_suggestionButtons[i] = new QPushButton;
+		m_suggestionButtons[i]->setStyleSheet("text-align: left");
+		m_suggestionButtons[i]->hide();
+		sidebarLayout->addWidget(m_suggestionButtons[i]);
+		connect(m_suggestionButtons[i], &QPushButton::clicked, this, [this, i]() {
+			moveCurrentArticleTo(m_suggestionButtons[i]->property("category").toString());
+		});
+	}
 	sidebarLayout->addWidget(new QLabel(tr("Themes:")));
 	sidebarLayout->addWidget(m_categoryTree, 1);
 	sidebarLayout->addWidget(newCategoryBtn);	
@@ -75,23 +132,195 @@ BrowserWindow::BrowserWindow(Browser *browser, QWebEngineProfile *profile, bool
 	
 	//     
 	m_categoriesModel = new EmptyFoldersFileSystemModel(this);
-	m_categoriesModel->setRootPath(QDir::homePath());
 	m_categoriesModel->setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
-	
-	//     ,  
-	QSettings settings;
-	m_categoriesRootFolder = settings.value("categoriesRootFolder").toString();
-
-	if (m_categoriesRootFolder.isEmpty()) {
-		//        
-		m_categoriesRootFolder = QDir::homePath() + "/MHTML_Categories";
-		QDir().mkpath(m_categoriesRootFolder);
-	}
-
-	//   
-	m_categoriesModel->setRootPath(m_categoriesRootFolder);
 	m_categoryTree->setModel(m_categoriesModel);
-	m_categoryTree->setRootIndex(m_categoriesModel->index(m_categoriesRootFolder));
+	// The root path is set from readSettings() on the first event loop pass after construction
+
+	m_queue = new ArticleQueue(this);
+	// Other windows and processes on the same inbox skip the article this one has open
+	m_claims = new WorkClaims(this);
+	// Archives of the inbox opened from a dialog, the find panel or another instance are claimed too
+	connect(m_tabWidget, &TabWidget::tabsUpdated, this, &BrowserWindow::holdOpenArticles);
+	connect(m_tabWidget, &TabWidget::tabClosed, this, &BrowserWindow::holdOpenArticles);
+	// Articles held elsewhere are tried again when a lease can have run out or the queue changed
+	m_claimRetryTimer = new QTimer(this);
+	m_claimRetryTimer->setSingleShot(true);
+	m_claimRetryTimer->setInterval(WorkClaims::LeaseMs);
+	connect(m_claimRetryTimer, &QTimer::timeout, this, [this]() {
+		if (m_currentArticlePath.isEmpty())
+			loadNextUnprocessedFile();
+	});
+	connect(m_queue, &ArticleQueue::scanFinished, this, [this]() {
+		if (m_awaitingScan && m_currentArticlePath.isEmpty())
+			loadNextUnprocessedFile();
+	});
+	connect(m_queue, &ArticleQueue::changed, this, [this]() {
+		if (m_claimRetryTimer->isActive() && m_currentArticlePath.isEmpty()) {
+			m_claimRetryTimer->stop();
+			loadNextUnprocessedFile();
+		}
+	});
+	m_readAhead = new ReadAhead(this);
+
+	// Quick-jump palette over all category folders
+	m_categoryIndex = new CategoryIndex(this);
+	m_categoryPalette = new CategoryPalette(m_categoryIndex, this);
+	connect(m_categoryPalette, &CategoryPalette::categoryChosen, this, &BrowserWindow::moveCurrentArticleTo);
+
+	// Rename, move and merge of whole themes; the indexes follow incrementally
+	m_categoryOps = new CategoryOperations(this);
+	connect(m_categoryOps, &CategoryOperations::progress, this, [this](int done, int total) {
+		statusBar()->showMessage(tr("Reorganizing categories: %1 of %2 files").arg(done).arg(total));
+	});
+	connect(m_categoryOps, &CategoryOperations::finished, this, &BrowserWindow::handleCategoryOperationFinished);
+	m_exporter = new BatchExporter(m_profile, this);
+	connect(m_exporter, &BatchExporter::progress, this, [this](int done, int failed, int total) {
+		statusBar()->showMessage(tr("Exporting: %1 of %2 files, %3 failed").arg(done).arg(total).arg(failed));
+	});
+	connect(m_exporter, &BatchExporter::finished, this, [this](int exported, int skipped, int failed, qint64 ms) {
+		double perMinute = ms > 0 ? exported * 60000.0 / ms : 0.0;
+		QMessageBox::information(this, tr("Export Finished"),
+			tr("Exported %1 files in %2 s (%3 files/min).\n%4 were already up to date, %5 failed.")
+				.arg(exported).arg(ms / 1000.0, 0, 'f', 1).arg(perMinute, 0, 'f', 1).arg(skipped).arg(failed));
+	});
+	m_slimmer = new ArchiveSlimmer(this);
+	connect(m_slimmer, &ArchiveSlimmer::progress, this, [this](int done, int total) {
+		statusBar()->showMessage(tr("Slimming archives: %1 of %2 files").arg(done).arg(total));
+	});
+	connect(m_slimmer, &ArchiveSlimmer::finished, this, [this](const ArchiveSlimmer::Report &total) {
+		statusBar()->clearMessage();
+		const QString report = tr("%1 files: %2 MB, %3 MB after slimming.\nScripts %4 MB, trackers %5 MB, unused parts %6 MB.")
+			.arg(total.files).arg(total.bytesBefore / 1048576.0, 0, 'f', 1).arg(total.bytesAfter / 1048576.0, 0, 'f', 1)
+			.arg(total.scriptBytes / 1048576.0, 0, 'f', 1).arg(total.trackerBytes / 1048576.0, 0, 'f', 1)
+			.arg(total.orphanBytes / 1048576.0, 0, 'f', 1);
+		if (total.applied) {
+			reloadAfterRewrite();
+			if (m_ingest)
+				m_ingest->refreshRecords(total.filePath);
+			QMessageBox::information(this, tr("Slimming Finished"), tr("Slimmed ") + report);
+			return;
+		}
+		// The dry run comes first, nothing is removed until the report is confirmed
+		if (total.files > 0 && QMessageBox::question(this, tr("Slim Archives"),
+				tr("Can slim ") + report + tr("\n\nSlim these archives now?")) == QMessageBox::Yes) {
+			releaseForRewrite(total.filePath);
+			m_slimmer->slimFolder(total.filePath, true);
+		}
+		else if (total.files == 0)
+			QMessageBox::information(this, tr("Slim Archives"), tr("Nothing to slim in %1").arg(total.filePath));
+	});
+	m_shrinker = new ArchiveShrinker(this);
+	connect(m_shrinker, &ArchiveShrinker::progress, this, [this](int done, int total) {
+		statusBar()->showMessage(tr("Shrinking images: %1 of %2 files").arg(done).arg(total));
+	});
+	connect(m_shrinker, &ArchiveShrinker::fileShrunk, this, [this](const QString &filePath) {
+		if (m_ingest)
+			m_ingest->refreshRecords(filePath);
+	});
+	connect(m_shrinker, &ArchiveShrinker::finished, this, [this](int files, qint64 before, qint64 after) {
+		reloadAfterRewrite();
+		// Single files shrunk on move only report to the status bar
+		if (files <= 1) {
+			statusBar()->showMessage(tr("Images shrunk, %1 KB saved").arg((before - after) / 1024), 3000);
+			return;
+		}
+		QMessageBox::information(this, tr("Shrink Finished"),
+			tr("Shrank %1 files from %2 MB to %3 MB.").arg(files)
+				.arg(before / 1048576.0, 0, 'f', 1).arg(after / 1048576.0, 0, 'f', 1));
+	});
+	// Background jobs of all windows, held back while the user triages
+	QLabel *backgroundLabel = new QLabel;
+	backgroundLabel->hide();
+	statusBar()->addPermanentWidget(backgroundLabel);
+	connect(BackgroundScheduler::instance(), &BackgroundScheduler::statusChanged, backgroundLabel,
+		[backgroundLabel](int running, int queued, bool userActive) {
+			backgroundLabel->setVisible(running + queued > 0);
+			backgroundLabel->setText(userActive && queued > 0
+				? tr("Background: %1 running, %2 waiting for idle").arg(running).arg(queued)
+				: tr("Background: %1 running, %2 queued").arg(running).arg(queued));
+		});
+	// Saved pages land in the source folder and join the queue
+	m_capture = new PageCapture(m_profile, this);
+	connect(m_capture, &PageCapture::captured, this, [this](const QString &filePath) {
+		if (!m_sourceFolder.isEmpty() && filePath.startsWith(m_sourceFolder))
+			m_queue->rescan();
+	});
+	connect(m_capture, &PageCapture::progress, this, [this](int done, int failed, int total) {
+		statusBar()->showMessage(tr("Capturing: %1 of %2 pages, %3 failed").arg(done).arg(total).arg(failed));
+	});
+	connect(m_capture, &PageCapture::finished, this, [this](int captured, int failed, qint64 ms) {
+		statusBar()->showMessage(tr("Captured %1 pages in %2 s, %3 failed")
+			.arg(captured).arg(ms / 1000.0, 0, 'f', 1).arg(failed), 5000);
+	});
+	m_categoryTree->setContextMenuPolicy(Qt::CustomContextMenu);
+	connect(m_categoryTree, &QWidget::customContextMenuRequested, this, &BrowserWindow::showCategoryContextMenu);
+
+	m_classifier = new CategoryClassifier(this);
+	connect(m_classifier, &CategoryClassifier::suggestionsReady, this, &BrowserWindow::showCategorySuggestions);
+	connect(m_classifier, &CategoryClassifier::trained, this, [this]() {
+		if (!m_currentArticlePath.isEmpty())
+			m_classifier->suggest(m_currentArticlePath, SuggestionCount);
+	});
+
+	// Cross-archive find panel, shown on demand
+	m_findPanel = new FindPanel(m_tabWidget, m_queue);
+	m_findDock = new QDockWidget(tr("Find in Archives"), this);
+	m_findDock->setObjectName("findDock");
+	m_findDock->setWidget(m_findPanel);
+	addDockWidget(Qt::BottomDockWidgetArea, m_findDock);
+	m_findDock->hide();
+	connect(m_findPanel, &FindPanel::fileRequested, this, &BrowserWindow::openFileAndFind);
+
+	// Native preview of the current article, filled before Chromium renders it
+	m_previewPane = new PreviewPane;
+	m_previewDock = new QDockWidget(tr("Preview"), this);
+	m_previewDock->setObjectName("previewDock");
+	m_previewDock->setWidget(m_previewPane);
+	addDockWidget(Qt::RightDockWidgetArea, m_previewDock);
+	m_previewDock->hide();
+	connect(m_previewPane, &PreviewPane::fullPageRequested, this, &BrowserWindow::loadFullPage);
+	connect(m_previewDock, &QDockWidget::visibilityChanged, this, [this](bool visible) {
+		if (visible && !m_currentArticlePath.isEmpty())
+			m_previewPane->showFile(m_currentArticlePath);
+	});
+
+	// Vertical tab list for windows with more tabs than the tab bar can show
+	m_tabListDock = new QDockWidget(tr("Tabs"), this);
+	m_tabListDock->setObjectName("tabListDock");
+	m_tabListDock->setWidget(new TabList(m_tabWidget));
+	addDockWidget(Qt::LeftDockWidgetArea, m_tabListDock);
+	m_tabListDock->hide();
+
+	// Per-tab renderer memory and CPU, sampled only while the dock is visible
+	m_resourceMonitor = new ResourceMonitor(m_tabWidget);
+	m_resourceDock = new QDockWidget(tr("Resources"), this);
+	m_resourceDock->setObjectName("resourceDock");
+	m_resourceDock->setWidget(m_resourceMonitor);
+	addDockWidget(Qt::BottomDockWidgetArea, m_resourceDock);
+	m_resourceDock->hide();
+	connect(m_resourceDock, &QDockWidget::visibilityChanged, m_resourceMonitor, &ResourceMonitor::setActive);
+
+	// Parts of the current archive and what slimming would remove
+	m_partInspector = new PartInspector;
+	m_partDock = new QDockWidget(tr("Archive Parts"), this);
+	m_partDock->setObjectName("partDock");
+	m_partDock->setWidget(m_partInspector);
+	addDockWidget(Qt::RightDockWidgetArea, m_partDock);
+	m_partDock->hide();
+	connect(m_partDock, &QDockWidget::visibilityChanged, this, [this](bool visible) {
+		if (visible && !m_currentArticlePath.isEmpty())
+			m_partInspector->showFile(m_currentArticlePath);
+	});
+	// Windows refuses to replace a file that is still mapped
+	connect(m_partInspector, &PartInspector::aboutToSlim, this, [this](const QString &filePath) {
+		LazyArchiveHandler::forProfile(m_profile)->release(filePath);
+	});
+	connect(m_partInspector, &PartInspector::slimmed, this, [this](const QString &filePath) {
+		if (m_ingest)
+			m_ingest->refreshRecords(filePath);
+		if (filePath == m_currentArticlePath)
+			loadArticle(filePath, false);
+	});
 	
 	//  
 	connect(newCategoryBtn, &QPushButton::clicked, this, &BrowserWindow::createNewCategory);
@@ -177,6 +406,25 @@ BrowserWindow::BrowserWindow(Browser *browser, QWebEngineProfile *profile, bool
     handleWebViewTitleChanged(QString());
     m_tabWidget->createTab();
 
+	if (!forDevTools && TimingLog::startupTimer().isValid()) {
+		TimingLog::write("startup.windowConstructed", TimingLog::startupTimer().elapsed());
+		QTimer::singleShot(0, this, []() {
+			if (TimingLog::startupTimer().isValid())
+				TimingLog::write("startup.eventLoop", TimingLog::startupTimer().elapsed());
+		});
+		connect(currentTab(), &QWebEngineView::loadFinished, this, [](bool ok) {
+			QElapsedTimer &timer = TimingLog::startupTimer();
+			if (!timer.isValid())
+				return;
+			qint64 elapsed = timer.elapsed();
+			timer.invalidate();
+			TimingLog::write("startup.firstLoad", elapsed,
+				QString("budget=%1 ok=%2").arg(StartupBudgetMs).arg(ok));
+			if (elapsed > StartupBudgetMs)
+				qWarning("Startup took %lld ms, budget is %lld ms", elapsed, StartupBudgetMs);
+		});
+	}
+
 	//  
 	readSettings();
 
@@ -185,6 +433,8 @@ BrowserWindow::BrowserWindow(Browser *browser, QWebEngineProfile *profile, bool
 BrowserWindow::~BrowserWindow()
 {
 	writeSettings();
+	// Its thread reads the catalog, which goes away with the ingest pipeline created before it
+	delete m_controlServer;
 }
 
 QSize BrowserWindow::sizeHint() const
@@ -222,6 +472,50 @@ QMenu *BrowserWindow::createFileMenu(TabWidget *tabWidget)
 	connect(openCategoriesRootAction, &QAction::triggered, this, &BrowserWindow::selectCategoriesRootFolder);
 	fileMenu->addAction(openCategoriesRootAction);
 
+	QAction *captureAction = new QAction(tr("Ca&pture Pages..."), this);
+	connect(captureAction, &QAction::triggered, this, [this]() {
+		QString current = currentTab() ? currentTab()->url().toString() : QString();
+		bool ok;
+		QString text = QInputDialog::getMultiLineText(this, tr("Capture Pages"),
+			tr("URLs to save into the source folder, one per line:"), current, &ok);
+		if (!ok)
+			return;
+		QList<QUrl> urls;
+		for (const QString &line : text.split('\n', QString::SkipEmptyParts)) {
+			if (!line.trimmed().isEmpty())
+				urls.append(QUrl::fromUserInput(line.trimmed()));
+		}
+		capturePages(urls);
+	});
+	fileMenu->addAction(captureAction);
+
+	QAction *captureTabsAction = new QAction(tr("Capture Open &Tabs"), this);
+	connect(captureTabsAction, &QAction::triggered, this, [this]() {
+		QList<QUrl> urls;
+		for (int i = 0; i < m_tabWidget->count(); ++i) {
+			QUrl url = m_tabWidget->webView(i)->sessionUrl();
+			if (url.scheme() == QLatin1String("http") || url.scheme() == QLatin1String("https"))
+				urls.append(url);
+		}
+		capturePages(urls);
+	});
+	fileMenu->addAction(captureTabsAction);
+
+	QAction *moveToAction = new QAction(tr("&Move Article To..."), this);
+	moveToAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_K));
+	connect(moveToAction, &QAction::triggered, m_categoryPalette, &CategoryPalette::popup);
+	fileMenu->addAction(moveToAction);
+
+	QAction *shrinkOnMoveAction = new QAction(tr("Shrink Images When &Moving"), this);
+	shrinkOnMoveAction->setCheckable(true);
+	shrinkOnMoveAction->setChecked(QSettings().value("shrink/onMove", false).toBool());
+	shrinkOnMoveAction->setToolTip(ArchiveShrinker::isWebpAvailable() ? tr("Re-encode large images of moved articles to WebP")
+		: tr("Re-encode large images of moved articles to JPEG"));
+	connect(shrinkOnMoveAction, &QAction::toggled, [](bool checked) {
+		QSettings().setValue("shrink/onMove", checked);
+	});
+	fileMenu->addAction(shrinkOnMoveAction);
+
     fileMenu->addSeparator();
 
     QAction *closeTabAction = new QAction(tr("&Close Tab"), this);
@@ -252,6 +546,14 @@ QMenu *BrowserWindow::createEditMenu()
     findAction->setShortcuts(QKeySequence::Find);
     connect(findAction, &QAction::triggered, this, &BrowserWindow::handleFindActionTriggered);
 
+    QAction *findAllAction = editMenu->addAction(tr("Find in All &Archives..."));
+    findAllAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F));
+    connect(findAllAction, &QAction::triggered, [this]() {
+        m_findDock->show();
+        m_findDock->raise();
+        m_findPanel->setSearchText(m_lastSearch);
+    });
+
     QAction *findNextAction = editMenu->addAction(tr("Find &Next"));
     findNextAction->setShortcut(QKeySequence::FindNext);
     connect(findNextAction, &QAction::triggered, [this]() {
@@ -310,6 +612,43 @@ QMenu *BrowserWindow::createViewMenu(QToolBar *toolbar)
             currentTab()->setZoomFactor(1.0);
     });
 
+    viewMenu->addSeparator();
+    m_fastTriageAction = viewMenu->addAction(tr("Fast &Triage Mode"));
+    m_fastTriageAction->setCheckable(true);
+    m_fastTriageAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_T));
+    m_fastTriageAction->setToolTip(tr("Open articles without scripts, plugins and autoplay"));
+    m_readableAction = viewMenu->addAction(tr("&Readable Rewrite"));
+    m_readableAction->setCheckable(true);
+    m_readableAction->setEnabled(false);
+    m_readableAction->setToolTip(tr("Show articles as plain text with a limited image budget"));
+    connect(m_fastTriageAction, &QAction::toggled, [this](bool checked) {
+        m_fastTriage = checked;
+        m_readableAction->setEnabled(checked);
+    });
+    connect(m_readableAction, &QAction::toggled, [this](bool checked) {
+        m_readableTriage = checked;
+    });
+
+    viewMenu->addSeparator();
+    viewMenu->addAction(m_previewDock->toggleViewAction());
+    viewMenu->addAction(m_tabListDock->toggleViewAction());
+    viewMenu->addAction(m_resourceDock->toggleViewAction());
+    viewMenu->addAction(m_partDock->toggleViewAction());
+    m_previewOnDemandAction = viewMenu->addAction(tr("Load Full Page on &Demand"));
+    m_previewOnDemandAction->setCheckable(true);
+    m_previewOnDemandAction->setToolTip(tr("Show only the preview until the full page is requested"));
+    connect(m_previewOnDemandAction, &QAction::toggled, [this](bool checked) {
+        m_previewOnDemand = checked;
+        if (checked)
+            m_previewDock->show();
+    });
+    QAction *loadFullPageAction = viewMenu->addAction(tr("Load &Full Page"));
+    loadFullPageAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_Return));
+    connect(loadFullPageAction, &QAction::triggered, [this]() {
+        if (!m_currentArticlePath.isEmpty())
+            loadFullPage(m_currentArticlePath);
+    });
+
 
     viewMenu->addSeparator();
     QAction *viewToolbarAction = new QAction(tr("Toolbar"),this);
@@ -629,6 +968,7 @@ void BrowserWindow::createNewCategory()
 				tr("Failed to create folder"));
 		}
 		else {
+			m_categoryIndex->addFolder(parentDir.filePath(categoryName));
 			statusBar()->showMessage(tr("Category created: %1").arg(categoryName), 2000);
 		}
 	}
@@ -652,18 +992,165 @@ void BrowserWindow::moveCurrentArticle()
 		destinationPath = destInfo.path();
 	}
 
+	moveCurrentArticleTo(destinationPath);
+}
+
+void BrowserWindow::capturePages(const QList<QUrl> &urls)
+{
+	if (m_sourceFolder.isEmpty()) {
+		QMessageBox::warning(this, tr("Error"), tr("Select a source folder first"));
+		return;
+	}
+	if (!urls.isEmpty())
+		m_capture->capture(urls, m_sourceFolder);
+}
+
+void BrowserWindow::showCategoryContextMenu(const QPoint &pos)
+{
+	QModelIndex index = m_categoryTree->indexAt(pos);
+	if (!index.isValid())
+		return;
+	const QString folder = m_categoriesModel->filePath(index);
+
+	QMenu menu;
+	QAction *renameAction = menu.addAction(tr("&Rename..."));
+	QAction *moveAction = menu.addAction(tr("&Move To..."));
+	QAction *mergeAction = menu.addAction(tr("Mer&ge Into..."));
+	renameAction->setEnabled(!m_categoryOps->isBusy());
+	moveAction->setEnabled(!m_categoryOps->isBusy());
+	mergeAction->setEnabled(!m_categoryOps->isBusy());
+	menu.addSeparator();
+	QAction *pdfAction = menu.addAction(tr("Export to &PDF..."));
+	QAction *pngAction = menu.addAction(tr("Export to P&NG..."));
+	pdfAction->setEnabled(!m_exporter->isRunning());
+	pngAction->setEnabled(!m_exporter->isRunning());
+	QAction *shrinkAction = menu.addAction(tr("Shrink &Images"));
+	QAction *slimAction = menu.addAction(tr("S&lim Archives..."));
+	slimAction->setEnabled(!m_slimmer->isRunning());
+	QAction *chosen = menu.exec(m_categoryTree->viewport()->mapToGlobal(pos));
+	if (!chosen)
+		return;
+
+	if (chosen == pdfAction || chosen == pngAction) {
+		QString output = QFileDialog::getExistingDirectory(this, tr("Export Category To"),
+			QDir::homePath(), QFileDialog::ShowDirsOnly);
+		if (!output.isEmpty())
+			m_exporter->start(folder, output, chosen == pdfAction ? BatchExporter::Pdf : BatchExporter::Png);
+		return;
+	}
+
+	if (chosen == shrinkAction) {
+		releaseForRewrite(folder);
+		m_shrinker->shrinkFolder(folder);
+		return;
+	}
+	if (chosen == slimAction) {
+		m_slimmer->slimFolder(folder, false);
+		return;
+	}
+
+	bool started = false;
+	if (chosen == renameAction) {
+		bool ok;
+		QString name = QInputDialog::getText(this, tr("Rename Category"), tr("New name:"),
+			QLineEdit::Normal, QFileInfo(folder).fileName(), &ok);
+		if (!ok || name.isEmpty())
+			return;
+		started = m_categoryOps->rename(folder, name);
+	} else {
+		QString target = QFileDialog::getExistingDirectory(this,
+			chosen == moveAction ? tr("Move Category Into") : tr("Merge Category Into"),
+			m_categoriesRootFolder, QFileDialog::ShowDirsOnly);
+		if (target.isEmpty())
+			return;
+		started = chosen == moveAction ? m_categoryOps->moveSubtree(folder, target)
+			: m_categoryOps->merge(folder, target);
+	}
+	if (!started)
+		QMessageBox::warning(this, tr("Error"), tr("Failed to reorganize category"));
+}
+
+void BrowserWindow::handleCategoryOperationFinished(const QString &from, const QString &to, int failed)
+{
+	if (failed > 0) {
+		// Part of the source stayed behind, let the index see the real tree
+		m_categoryIndex->rebuild(m_categoriesRootFolder);
+		QMessageBox::warning(this, tr("Error"),
+			tr("%1 files could not be moved from %2").arg(failed).arg(from));
+	} else {
+		m_categoryIndex->moveFolder(from, to);
+	}
+	// Only records of files that reached the target move with them
+	if (m_ingest)
+		m_ingest->moveRecords(from, to);
+	m_classifier->moveCategory(from, to);
+	statusBar()->showMessage(tr("Categories reorganized: %1").arg(QDir(m_categoriesRootFolder).relativeFilePath(to)), 3000);
+}
+
+void BrowserWindow::releaseForRewrite(const QString &folder)
+{
+	if (!m_currentArticlePath.startsWith(folder + '/'))
+		return;
+	// Windows refuses to replace a file that is still mapped
+	LazyArchiveHandler::forProfile(m_profile)->release(m_currentArticlePath);
+	m_rewrittenArticle = m_currentArticlePath;
+}
+
+void BrowserWindow::reloadAfterRewrite()
+{
+	// Its parts are served from the rewritten file now
+	if (!m_rewrittenArticle.isEmpty() && m_rewrittenArticle == m_currentArticlePath)
+		loadArticle(m_currentArticlePath, false);
+	m_rewrittenArticle.clear();
+}
+
+void BrowserWindow::moveCurrentArticleTo(const QString &destinationPath)
+{
+	if (getCurrentArticlePath().isEmpty() || destinationPath.isEmpty()) return;
+
+	if (!fileCurrentArticle(destinationPath)) {
+		QMessageBox::warning(this, tr("Error"),
+			tr("Failed to move article"));
+	}
+}
+
+bool BrowserWindow::fileCurrentArticle(const QString &destinationPath)
+{
+	QString currentArticle = getCurrentArticlePath();
+	if (currentArticle.isEmpty() || destinationPath.isEmpty()) return false;
+
 	//  
 	QFileInfo articleInfo(currentArticle);
 	QString newPath = destinationPath + "/" + articleInfo.fileName();
 
+	// Windows refuses to rename a file that is still mapped
+	LazyArchiveHandler::forProfile(m_profile)->release(currentArticle);
 	if (QFile::rename(currentArticle, newPath)) {
+		m_queue->remove(currentArticle);
+		if (m_ingest)
+			m_ingest->moveRecords(currentArticle, newPath);
+		m_classifier->learn(newPath, destinationPath);
+		if (QSettings().value("shrink/onMove", false).toBool())
+			m_shrinker->shrink(QStringList(newPath));
 		//   
 		loadNextUnprocessedFile();
+		return true;
 	}
-	else {
-		QMessageBox::warning(this, tr("Error"),
-			tr("Failed to move article"));
-	}
+	return false;
+}
+
+void BrowserWindow::openFileAndFind(const QString &filePath, const QString &needle)
+{
+	m_lastSearch = needle;
+	WebView *view = m_tabWidget->createTab();
+	// Highlight the match once, later navigations in the tab are left alone
+	auto connection = std::make_shared<QMetaObject::Connection>();
+	*connection = connect(view, &QWebEngineView::loadFinished, view, [view, needle, connection](bool ok) {
+		QObject::disconnect(*connection);
+		if (ok)
+			view->findText(needle);
+	});
+	view->setUrl(QUrl::fromLocalFile(filePath));
 }
 
 QString BrowserWindow::getCurrentArticlePath() const
@@ -674,10 +1161,26 @@ QString BrowserWindow::getCurrentArticlePath() const
 
 void BrowserWindow::loadNextUnprocessedFile()
 {
+	m_claimRetryTimer->stop();
 	QString nextFile = findNextUnprocessedFile();
+	if (nextFile.isEmpty() && !m_sourceFolder.isEmpty() && !m_awaitingScan) {
+		// The snapshot ran dry; files that arrived since the last scan are looked for in the background
+		m_awaitingScan = true;
+		m_currentArticlePath.clear();
+		currentTab()->setHtml("<h1>Looking for new articles...</h1>");
+		m_queue->rescan();
+		return;
+	}
+	m_awaitingScan = false;
 	if (!nextFile.isEmpty()) {
 		loadMhtmlFile(nextFile);
 	}
+	else if (!m_queue->head().isEmpty()) {
+		currentTab()->setHtml("<h1>The remaining articles are open in other windows</h1>");
+		statusBar()->showMessage(tr("No unclaimed articles left"));
+		m_currentArticlePath.clear();
+		m_claimRetryTimer->start();
+	}
 	else {
 		//   
 		currentTab()->setHtml("<h1>All files processed!</h1>");
@@ -686,21 +1189,31 @@ void BrowserWindow::loadNextUnprocessedFile()
 	}
 }
 
+void BrowserWindow::holdOpenArticles()
+{
+	if (m_sourceFolder.isEmpty())
+		return;
+	const QString inbox = QDir::cleanPath(m_sourceFolder) + '/';
+	QStringList files;
+	for (int i = 0; i < m_tabWidget->count(); ++i) {
+		const QUrl url = m_tabWidget->tabBar()->tabData(i).toUrl();
+		if (url.isLocalFile() && QDir::cleanPath(url.toLocalFile()).startsWith(inbox))
+			files.append(QDir::cleanPath(url.toLocalFile()));
+	}
+	// Titles and icons update the tabs far more often than their files change
+	if (files == m_heldArticles)
+		return;
+	m_heldArticles = files;
+	const QStringList refused = m_claims->hold(files);
+	if (!refused.isEmpty())
+		statusBar()->showMessage(tr("%1 is being triaged in another window").arg(QFileInfo(refused.first()).fileName()), 5000);
+}
+
 QString BrowserWindow::findNextUnprocessedFile()
 {
 	if (m_sourceFolder.isEmpty()) return QString();
 
-	//   mhtml   
-	QDirIterator it(m_sourceFolder,
-		QStringList() << "*.mhtml" << "*.mht",
-		QDir::Files,
-		QDirIterator::NoIteratorFlags);
-
-	if (it.hasNext()) {
-		return it.next();
-	}
-
-	return QString(); //   
+	return m_claims->claimNext(m_queue->files());
 }
 
 void BrowserWindow::selectSourceFolder()
@@ -716,6 +1229,12 @@ void BrowserWindow::selectSourceFolder()
 
 	if (!folder.isEmpty()) {
 		m_sourceFolder = folder;
+		m_queue->setSourceFolder(folder);
+		m_claims->setSourceFolder(folder);
+		m_heldArticles.clear();
+		holdOpenArticles();
+		if (m_ingest)
+			m_ingest->setSourceFolder(folder, m_queue->files());
 
 		//   
 		updateWindowTitle();
@@ -746,12 +1265,29 @@ void BrowserWindow::loadMhtmlFile(const QString &filePath)
 		return;
 	}
 
+	// The article being left no longer needs its mapping, it may be moved or rewritten next
+	if (!m_currentArticlePath.isEmpty() && m_currentArticlePath != filePath)
+		LazyArchiveHandler::forProfile(m_profile)->release(m_currentArticlePath);
 	//     
 	m_currentArticlePath = filePath;
-
-	//    file:// URL
-	QUrl fileUrl = QUrl::fromLocalFile(filePath);
-	currentTab()->setUrl(fileUrl);
+	showCategorySuggestions(filePath, QStringList());
+	m_classifier->suggest(filePath, SuggestionCount);
+	// The next queued files are read into the page cache while this one is triaged
+	const QStringList queued = m_queue->files();
+	m_readAhead->prefetch(filePath, queued.mid(queued.indexOf(filePath) + 1));
+
+	// The preview takes milliseconds, the full page renders behind it or on request
+	if (m_previewDock->isVisible())
+		m_previewPane->showFile(filePath);
+	if (m_partDock->isVisible())
+		m_partInspector->showFile(filePath);
+	if (m_previewOnDemand)
+		currentTab()->setUrl(QUrl(QStringLiteral("about:blank")));
+	else if (m_traceRecorder)
+		// Profiling mode: the trace has to be running before the navigation starts
+		m_traceRecorder->record(currentTab(), filePath, [this, filePath]() { loadArticle(filePath, false); });
+	else
+		loadArticle(filePath, false);
 
 	//      
 	QFileInfo fileInfo(filePath);
@@ -761,6 +1297,154 @@ void BrowserWindow::loadMhtmlFile(const QString &filePath)
 	statusBar()->showMessage(tr("Loaded: %1").arg(fileInfo.fileName()), 2000);
 }
 
+void BrowserWindow::showCategorySuggestions(const QString &filePath, const QStringList &categories)
+{
+	if (filePath != m_currentArticlePath)
+		return;
+	QDir root(m_categoriesRootFolder);
+	for (int i = 0; i < SuggestionCount; ++i) {
+		QPushButton *button = m_suggestionButtons[i];
+		if (i >= categories.size()) {
+			button->hide();
+			continue;
+		}
+		QString name = root.relativeFilePath(categories.at(i));
+		// The mnemonic makes every suggestion one Alt+digit away
+		button->setText(QString("&%1  %2").arg(i + 1).arg(name.replace('&', "&&")));
+		button->setToolTip(categories.at(i));
+		button->setProperty("category", categories.at(i));
+		button->show();
+	}
+}
+
+void BrowserWindow::loadFullPage(const QString &filePath)
+{
+	loadArticle(filePath, true);
+}
+
+void BrowserWindow::loadArticle(const QString &filePath, bool requested)
+{
+	if (filePath != m_currentArticlePath)
+		return;
+	// Ingested files were scanned by the pipeline already
+	ArticleRecord record;
+	if (m_ingest && m_ingest->catalog()->find(filePath, &record) && record.valid && record.scripts >= 0
+			&& record.isCurrent()) {
+		LoadPolicy::Scan scan;
+		scan.size = record.size;
+		scan.parts = record.parts;
+		scan.scripts = record.scripts;
+		scan.complete = record.partsComplete;
+		applyLoadPolicy(filePath, requested, scan);
+		return;
+	}
+
+	// Counting parts reads up to 16 MB, the current page stays up meanwhile
+	const int generation = ++m_loadGeneration;
+	auto *watcher = new QFutureWatcher<LoadPolicy::Scan>(this);
+	connect(watcher, &QFutureWatcher<LoadPolicy::Scan>::finished, this,
+		[this, watcher, filePath, requested, generation]() {
+			watcher->deleteLater();
+			if (generation == m_loadGeneration)
+				applyLoadPolicy(filePath, requested, watcher->result());
+		});
+	watcher->setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "loadPolicy.scan",
+		[filePath](BackgroundJob &) { return LoadPolicy::scan(filePath); }));
+}
+
+void BrowserWindow::applyLoadPolicy(const QString &filePath, bool requested, const LoadPolicy::Scan &scan)
+{
+	if (filePath != m_currentArticlePath)
+		return;
+	LoadPolicy::Mode mode = LoadPolicy::decide(scan, LoadPolicy::Limits::load());
+	// An explicit request always renders something, lazily at worst
+	if (requested && mode == LoadPolicy::TextPreview)
+		mode = LoadPolicy::LazyServing;
+	TimingLog::write("loadPolicy.scan", scan.elapsedMs, QString("%1 %2 bytes, %3 parts%4, %5 scripts -> %6")
+		.arg(QFileInfo(filePath).fileName()).arg(scan.size).arg(scan.parts)
+		.arg(scan.complete ? "" : "+").arg(scan.scripts).arg(LoadPolicy::modeName(mode)));
+	loadWithPolicy(filePath, mode);
+}
+
+void BrowserWindow::loadWithPolicy(const QString &filePath, LoadPolicy::Mode mode)
+{
+	WebView *view = currentTab();
+	WebPage *page = qobject_cast<WebPage*>(view->page());
+
+	if (mode == LoadPolicy::TextPreview) {
+		++m_loadGeneration;
+		m_previewDock->show();
+		m_previewPane->showFile(filePath);
+		view->setHtml(tr("<p>This archive is too large to render safely. "
+			"Its text is shown in the preview, Ctrl+Return loads it anyway.</p>"));
+		TimingLog::write("loadPolicy.render", 0, QString("%1 preview").arg(QFileInfo(filePath).fileName()));
+		return;
+	}
+
+	if (page)
+		page->setTriageMode(m_fastTriage || mode != LoadPolicy::FullRender);
+
+	QUrl url;
+	if (mode == LoadPolicy::LazyServing) {
+		url = LazyArchiveHandler::forProfile(m_profile)->open(filePath);
+		if (url.isEmpty()) {
+			loadWithPolicy(filePath, LoadPolicy::TextPreview);
+			return;
+		}
+	} else if (!(m_fastTriage && m_readableTriage)) {
+		url = QUrl::fromLocalFile(filePath);
+	}
+
+	// Log the render time; a crashed renderer or a failed load steps down to the next mode
+	const int generation = ++m_loadGeneration;
+	QElapsedTimer timer;
+	timer.start();
+	auto connections = std::make_shared<QList<QMetaObject::Connection>>();
+	auto fallBack = [this, connections, filePath, mode, generation, timer](bool ok, const char *reason) {
+		for (const QMetaObject::Connection &connection : qAsConst(*connections))
+			QObject::disconnect(connection);
+		if (generation != m_loadGeneration)
+			return;
+		TimingLog::write("loadPolicy.render", timer.elapsed(), QString("%1 %2 %3")
+			.arg(QFileInfo(filePath).fileName()).arg(LoadPolicy::modeName(mode)).arg(reason));
+		if (!ok && filePath == m_currentArticlePath)
+			loadWithPolicy(filePath, LoadPolicy::Mode(mode + 1));
+	};
+	connections->append(connect(view, &QWebEngineView::loadFinished, this, [view, url, fallBack](bool ok) {
+		// A failure reported for an earlier navigation is not ours
+		if (!ok && !url.isEmpty() && view->url() != url)
+			return;
+		fallBack(ok, ok ? "ok" : "failed");
+	}));
+	connections->append(connect(view, &QWebEngineView::renderProcessTerminated, this,
+		[fallBack](QWebEnginePage::RenderProcessTerminationStatus status) {
+			if (status != QWebEnginePage::NormalTerminationStatus)
+				fallBack(false, "renderer terminated");
+		}));
+
+	if (url.isEmpty())
+		loadReadablePage(filePath);
+	else
+		view->setUrl(url);
+}
+
+void BrowserWindow::loadReadablePage(const QString &filePath)
+{
+	// The rewrite parses the whole archive, keep it off the GUI thread
+	QElapsedTimer timer;
+	timer.start();
+	auto watcher = new QFutureWatcher<QString>(this);
+	connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, filePath, timer]() {
+		watcher->deleteLater();
+		QString readablePath = watcher->result();
+		TimingLog::write("triage.readable", timer.elapsed(), QFileInfo(filePath).fileName());
+		if (filePath != m_currentArticlePath)
+			return; // the user already moved on
+		currentTab()->setUrl(QUrl::fromLocalFile(readablePath.isEmpty() ? filePath : readablePath));
+	});
+	watcher->setFuture(QtConcurrent::run(&ReadablePage::renderToFile, filePath, m_imageBudget));
+}
+
 void BrowserWindow::selectCategoriesRootFolder()
 {
 	QString initialPath = m_categoriesRootFolder.isEmpty() ? QDir::homePath() : m_categoriesRootFolder;
@@ -790,6 +1474,8 @@ void BrowserWindow::setCategoriesRootPath(const QString &path)
 		m_categoriesModel->setRootPath(path);
 		m_categoryTree->setRootIndex(m_categoriesModel->index(path));
 	}
+	m_classifier->rebuild(path);
+	m_categoryIndex->rebuild(path);
 
 	//     
 	QDir rootDir(path);
@@ -806,22 +1492,123 @@ void BrowserWindow::readSettings()
 	QSettings settings;
 	m_sourceFolder = settings.value("sourceFolder").toString();
 	m_categoriesRootFolder = settings.value("categoriesRootFolder").toString();
+	m_imageBudget = settings.value("triage/imageBudgetKb", 512).toLongLong() * 1024;
+	if (m_fastTriageAction) {
+		m_fastTriageAction->setChecked(settings.value("triage/fast", false).toBool());
+		m_readableAction->setChecked(settings.value("triage/readable", false).toBool());
+		m_previewOnDemandAction->setChecked(settings.value("preview/onDemand", false).toBool());
+	}
+	m_previewDock->setVisible(settings.value("preview/visible", m_previewOnDemand).toBool());
+
+	// Only the first regular window restores and saves the session
+	m_ownsSession = m_fastTriageAction && !m_profile->isOffTheRecord() && m_browser->windows().isEmpty();
+
+	// The same window prepares incoming files, one pipeline per inbox is enough
+	if (m_ownsSession) {
+		m_ingest = new IngestPipeline(this);
+		m_previewPane->setCatalog(m_ingest->catalog());
+		connect(m_ingest, &IngestPipeline::filesArrived, m_queue, &ArticleQueue::rescan);
+		connect(m_queue, &ArticleQueue::changed, this, [this]() {
+			m_ingest->ingest(m_queue->files());
+		});
+		connect(m_ingest, &IngestPipeline::ingested, this, [this](const QString &filePath, bool valid) {
+			if (!valid)
+				statusBar()->showMessage(tr("Not a valid archive: %1").arg(QFileInfo(filePath).fileName()), 5000);
+		});
+		// Scripting API, off unless a port is configured
+		int apiPort = settings.value("api/port", 0).toInt();
+		if (apiPort > 0 && apiPort < 65536)
+			startControlServer(quint16(apiPort));
+	}
 
 	if (!m_sourceFolder.isEmpty()) {
 		updateWindowTitle();
-		QTimer::singleShot(100, this, &BrowserWindow::loadNextUnprocessedFile);
+		// Open the first article from the saved snapshot right away, so the load overlaps
+		// with Chromium start-up; the folder scan then runs in the background
+		m_queue->setSourceFolder(m_sourceFolder);
+		m_queue->restoreSnapshot();
+		m_claims->setSourceFolder(m_sourceFolder);
+		m_heldArticles.clear();
+		holdOpenArticles();
+		if (m_ingest)
+			m_ingest->setSourceFolder(m_sourceFolder, m_queue->files());
+		loadNextUnprocessedFile();
+		m_queue->rescan();
 	}
-
-	//    
-	if (!m_categoriesRootFolder.isEmpty()) {
+	if (m_ownsSession)
+		restoreSession();
+
+	// Populating the category tree hits the disk; deferred until the event loop runs,
+	// so the constructor returns and the window can be shown first
+	QTimer::singleShot(0, this, [this]() {
+		if (m_categoriesRootFolder.isEmpty()) {
+			m_categoriesRootFolder = QDir::homePath() + "/MHTML_Categories";
+			QDir().mkpath(m_categoriesRootFolder);
+		}
 		setCategoriesRootPath(m_categoriesRootFolder);
-	}
-	else {
-		//   
-		QString defaultCategoriesPath = QDir::homePath() + "/MHTML_Categories";
-		QDir().mkpath(defaultCategoriesPath);
-		setCategoriesRootPath(defaultCategoriesPath);
-	}
+		m_categoryOps->resumeJournal();
+	});
+}
+
+static QJsonObject apiError(const QString &message)
+{
+	QJsonObject result;
+	result.insert("error", message);
+	return result;
+}
+
+void BrowserWindow::startControlServer(quint16 port)
+{
+	m_controlServer = new ControlServer(m_ingest->catalog(), this);
+	m_controlServer->addCommand("GET", "/current", [this](const QJsonObject &) {
+		QJsonObject result;
+		result.insert("path", m_currentArticlePath);
+		result.insert("title", currentTab() ? currentTab()->title() : QString());
+		QJsonArray tags;
+		for (const QString &tag : m_tagsEdit->text().split(',', QString::SkipEmptyParts))
+			tags.append(tag.trimmed());
+		result.insert("tags", tags);
+		return result;
+	});
+	m_controlServer->addCommand("POST", "/current/move", [this](const QJsonObject &arguments) {
+		// The category is a folder path relative to the categories root
+		QString category = arguments.value("category").toString();
+		QString root = QDir::cleanPath(m_categoriesRootFolder);
+		QString destination = QDir::cleanPath(QDir(root).filePath(category));
+		if (category.isEmpty() || !destination.startsWith(root + '/') || !QFileInfo(destination).isDir())
+			return apiError(tr("Unknown category: %1").arg(category));
+		QString article = m_currentArticlePath;
+		if (article.isEmpty())
+			return apiError(tr("No article is open"));
+		QString target = destination + '/' + QFileInfo(article).fileName();
+		if (QFile::exists(target))
+			return apiError(tr("The category already has %1").arg(QFileInfo(article).fileName()));
+		// No dialog here, the caller gets the error
+		if (!fileCurrentArticle(destination))
+			return apiError(tr("Failed to move article"));
+		QJsonObject result;
+		result.insert("moved", target);
+		result.insert("next", m_currentArticlePath);
+		return result;
+	});
+	m_controlServer->addCommand("GET", "/categories", [this](const QJsonObject &arguments) {
+		int limit = arguments.contains("limit") ? arguments.value("limit").toVariant().toInt() : 20;
+		QDir root(m_categoriesRootFolder);
+		QJsonArray categories;
+		const QStringList matches = m_categoryIndex->match(arguments.value("q").toString(), limit);
+		for (const QString &path : matches)
+			categories.append(root.relativeFilePath(path));
+		QJsonObject result;
+		result.insert("categories", categories);
+		return result;
+	});
+
+	connect(m_queue, &ArticleQueue::changed, m_controlServer, [this]() {
+		m_controlServer->publishQueue(m_queue->sourceFolder(), m_queue->files());
+	});
+	connect(m_controlServer, &ControlServer::filesEnqueued, m_queue, &ArticleQueue::rescan);
+	if (!m_controlServer->listen(port))
+		statusBar()->showMessage(tr("Control API could not listen on port %1").arg(port), 5000);
 }
 
 void BrowserWindow::writeSettings()
@@ -829,4 +1616,94 @@ void BrowserWindow::writeSettings()
 	QSettings settings;
 	settings.setValue("sourceFolder", m_sourceFolder);
 	settings.setValue("categoriesRootFolder", m_categoriesRootFolder);
+	settings.setValue("triage/imageBudgetKb", m_imageBudget / 1024);
+	if (m_fastTriageAction) {
+		settings.setValue("triage/fast", m_fastTriage);
+		settings.setValue("triage/readable", m_readableTriage);
+		settings.setValue("preview/onDemand", m_previewOnDemand);
+	}
+	settings.setValue("preview/visible", m_previewDock->isVisible());
+	m_queue->saveSnapshot();
+	if (m_ownsSession)
+		saveSession();
+}
+
+bool BrowserWindow::isTriageTab(WebView *view) const
+{
+	// Article tabs come back through the queue, not through the session
+	QUrl url = view->sessionUrl();
+	if (url.isEmpty() || url.scheme() == QLatin1String("about"))
+		return true;
+	if (!url.isLocalFile())
+		return false;
+	QString path = url.toLocalFile();
+	return path == m_currentArticlePath
+		|| (!m_sourceFolder.isEmpty() && path.startsWith(m_sourceFolder + '/'))
+		|| path.startsWith(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+}
+
+void BrowserWindow::saveSession()
+{
+	QSettings settings;
+	settings.beginGroup("session");
+	settings.remove("");
+
+	int current = -1;
+	settings.beginWriteArray("tabs");
+	int saved = 0;
+	for (int i = 0; i < m_tabWidget->count(); ++i) {
+		WebView *view = m_tabWidget->webView(i);
+		if (!view)
+			continue;
+		if (isTriageTab(view)) {
+			if (view == currentTab() && !m_currentArticlePath.isEmpty()) {
+				settings.setValue("article", m_currentArticlePath);
+				settings.setValue("articleZoom", view->zoomFactor());
+				settings.setValue("articleScroll", view->page()->scrollPosition());
+			}
+			continue;
+		}
+		if (view == currentTab())
+			current = saved;
+		settings.setArrayIndex(saved++);
+		settings.setValue("url", view->sessionUrl());
+		settings.setValue("title", view->sessionTitle());
+		settings.setValue("zoom", view->zoomFactor());
+		settings.setValue("scroll", view->page()->scrollPosition());
+	}
+	settings.endArray();
+	settings.setValue("currentTab", current);
+	settings.endGroup();
+}
+
+void BrowserWindow::restoreSession()
+{
+	QElapsedTimer timer;
+	timer.start();
+	QSettings settings;
+	settings.beginGroup("session");
+
+	// The article tab gets its zoom and scroll back if the same article reopened
+	if (!m_currentArticlePath.isEmpty() && settings.value("article").toString() == m_currentArticlePath) {
+		currentTab()->restoreViewState(settings.value("articleZoom", 1.0).toReal(),
+			settings.value("articleScroll").toPointF());
+	}
+
+	// Other tabs come back hibernated; none of them loads until it is shown
+	QList<WebView*> views;
+	int count = settings.beginReadArray("tabs");
+	for (int i = 0; i < count; ++i) {
+		settings.setArrayIndex(i);
+		views.append(m_tabWidget->createHibernatedTab(settings.value("url").toUrl(),
+			settings.value("title").toString(), settings.value("zoom", 1.0).toReal(),
+			settings.value("scroll").toPointF()));
+	}
+	settings.endArray();
+
+	// Articles load into the current tab, the restored selection only applies without one
+	int current = settings.value("currentTab", -1).toInt();
+	if (m_currentArticlePath.isEmpty() && current >= 0 && current < views.size())
+		m_tabWidget->setCurrentWidget(views.at(current));
+	settings.endGroup();
+	TimingLog::write("session.restore", timer.elapsed(), QString("%1 tabs").arg(count));
 }
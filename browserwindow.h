@@ -5,14 +5,36 @@
 #include <QMainWindow>
 #include <QTime>
 #include <QWebEnginePage>
+#include "loadpolicy.h"
 
 QT_BEGIN_NAMESPACE
 class QLineEdit;
 class QProgressBar;
+class QPushButton;
+class QTimer;
 QT_END_NAMESPACE
 
+class ArchiveShrinker;
+class ArchiveSlimmer;
+class ArticleQueue;
+class BatchExporter;
+class CategoryClassifier;
+class CategoryIndex;
+class CategoryOperations;
+class CategoryPalette;
+class ControlServer;
 class Browser;
+class FindPanel;
+class IngestPipeline;
+class PageCapture;
+class PartInspector;
+class PreviewPane;
+class ReadAhead;
+class ResourceMonitor;
+class TabList;
 class TabWidget;
+class TraceRecorder;
+class WorkClaims;
 class WebView;
 class QTreeView;
 class QFileSystemModel;
@@ -48,9 +70,25 @@ private slots:
 
 	void createNewCategory();
 	void moveCurrentArticle();
+	void moveCurrentArticleTo(const QString &destinationPath);
+	// Moves the article and loads the next one; false if the file stayed where it was
+	bool fileCurrentArticle(const QString &destinationPath);
+	void showCategoryContextMenu(const QPoint &pos);
+	void capturePages(const QList<QUrl> &urls);
+	void handleCategoryOperationFinished(const QString &from, const QString &to, int failed);
+	void showCategorySuggestions(const QString &filePath, const QStringList &categories);
 	void selectSourceFolder();
 	void selectCategoriesRootFolder();
 	void updateWindowTitle();
+	void openFileAndFind(const QString &filePath, const QString &needle);
+	void loadFullPage(const QString &filePath);
+	void loadArticle(const QString &filePath, bool requested);
+	void applyLoadPolicy(const QString &filePath, bool requested, const LoadPolicy::Scan &scan);
+	void loadWithPolicy(const QString &filePath, LoadPolicy::Mode mode);
+	void loadReadablePage(const QString &filePath);
+	// Unmaps the current article if a rewrite of the folder includes it
+	void releaseForRewrite(const QString &folder);
+	void reloadAfterRewrite();
 private:
     QMenu *createFileMenu(TabWidget *tabWidget);
     QMenu *createEditMenu();
@@ -60,11 +98,17 @@ private:
     QToolBar *createToolBar();
 	QString getCurrentArticlePath() const;
 	void loadNextUnprocessedFile();
+	// Claims the inbox archives shown in any tab, not only the one being triaged
+	void holdOpenArticles();
 	QString findNextUnprocessedFile();
 	void loadMhtmlFile(const QString &filePath);
 	void setCategoriesRootPath(const QString &path);
 	void readSettings();
 	void writeSettings();
+	void saveSession();
+	void restoreSession();
+	bool isTriageTab(WebView *view) const;
+	void startControlServer(quint16 port);
 private:
     Browser *m_browser;
     QWebEngineProfile *m_profile;
@@ -77,6 +121,9 @@ private:
     QAction *m_stopReloadAction;
     QLineEdit *m_urlLineEdit;
     QAction *m_favAction;
+    QAction *m_fastTriageAction;
+    QAction *m_readableAction;
+    QAction *m_previewOnDemandAction;
     QString m_lastSearch;
 
 	QDockWidget *m_sidebarDock;
@@ -86,6 +133,41 @@ private:
 	QString m_sourceFolder;
 	QString m_categoriesRootFolder;
 	QFileSystemModel *m_categoriesModel;
+	ArticleQueue *m_queue;
+	WorkClaims *m_claims;
+	QTimer *m_claimRetryTimer;
+	QStringList m_heldArticles;
+	ReadAhead *m_readAhead;
+	CategoryClassifier *m_classifier;
+	CategoryIndex *m_categoryIndex;
+	CategoryPalette *m_categoryPalette;
+	CategoryOperations *m_categoryOps;
+	BatchExporter *m_exporter;
+	ArchiveShrinker *m_shrinker;
+	ArchiveSlimmer *m_slimmer;
+	PageCapture *m_capture;
+	static const int SuggestionCount = 3;
+	QPushButton *m_suggestionButtons[SuggestionCount];
+	QDockWidget *m_findDock;
+	FindPanel *m_findPanel;
+	QDockWidget *m_previewDock;
+	PreviewPane *m_previewPane;
+	QDockWidget *m_tabListDock;
+	QDockWidget *m_resourceDock;
+	ResourceMonitor *m_resourceMonitor;
+	QDockWidget *m_partDock;
+	PartInspector *m_partInspector;
+	bool m_fastTriage;
+	bool m_readableTriage;
+	bool m_previewOnDemand;
+	bool m_ownsSession;
+	bool m_awaitingScan;           // the queue ran dry, the next article comes from a rescan
+	int m_loadGeneration;
+	QString m_rewrittenArticle;    // released for a running slim or shrink, reloaded after it
+	IngestPipeline *m_ingest;
+	ControlServer *m_controlServer;
+	TraceRecorder *m_traceRecorder;
+	qint64 m_imageBudget;
 };
 
 #endif // BROWSERWINDOW_H
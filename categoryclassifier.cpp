@@ -0,0 +1,186 @@
+#include "categoryclassifier.h"
+#include "backgroundscheduler.h"
+#include "mhtmlarchive.h"
+#include "timinglog.h"
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+// Titles and the opening paragraphs carry most of the topic
+static const qint64 TrainingReadBytes = 256 * 1024;
+static const int TrainingTextLength = 20000;
+static const int MinTermLength = 3;
+
+CategoryClassifier::CategoryClassifier(QObject *parent)
+	: QObject(parent)
+{
+	// One thread keeps training and inference ordered without locking the model
+	m_pool.setMaxThreadCount(1);
+	m_suggestPool.setMaxThreadCount(1);
+}
+
+CategoryClassifier::~CategoryClassifier()
+{
+	m_generation.fetchAndAddOrdered(1);
+	m_pool.clear();
+	m_suggestPool.clear();
+	m_pool.waitForDone();
+	m_suggestPool.waitForDone();
+}
+
+bool CategoryClassifier::isTrained() const
+{
+	return m_documentCount.loadAcquire() > 0;
+}
+
+CategoryClassifier::TermCounts CategoryClassifier::extractTerms(const QString &filePath)
+{
+	TermCounts terms;
+	MhtmlArchive archive;
+	if (!archive.load(filePath, TrainingReadBytes))
+		return terms;
+
+	const QString text = archive.subject() + QLatin1Char(' ') + archive.plainText(TrainingTextLength);
+	int start = -1;
+	for (int i = 0; i <= text.size(); ++i) {
+		const bool letter = i < text.size() && text.at(i).isLetter();
+		if (letter && start < 0) {
+			start = i;
+		} else if (!letter && start >= 0) {
+			if (i - start >= MinTermLength)
+				++terms[text.mid(start, i - start).toLower()];
+			start = -1;
+		}
+	}
+	return terms;
+}
+
+void CategoryClassifier::rebuild(const QString &rootFolder)
+{
+	const int generation = m_generation.fetchAndAddOrdered(1) + 1;
+	m_pool.clear();
+	QtConcurrent::run(&m_pool, [this, generation, rootFolder]() {
+		QElapsedTimer timer;
+		timer.start();
+		{
+			QWriteLocker locker(&m_lock);
+			m_categories.clear();
+			m_vocabulary.clear();
+			m_documentCount.storeRelease(0);
+		}
+
+		QDirIterator it(rootFolder, QStringList() << "*.mhtml" << "*.mht", QDir::Files, QDirIterator::Subdirectories);
+		// Training waits while the user triages, a rebuild or shutdown ends the wait
+		auto superseded = [this, generation]() { return m_generation.loadAcquire() != generation; };
+		while (it.hasNext()) {
+			if (!BackgroundScheduler::instance()->throttle(BackgroundScheduler::Normal, TrainingReadBytes, superseded))
+				return;
+			const QString filePath = it.next();
+			addDocument(QFileInfo(filePath).absolutePath(), extractTerms(filePath));
+		}
+
+		const int documents = m_documentCount.loadAcquire();
+		const int categories = m_categories.size();
+		TimingLog::write("classifier.train", timer.elapsed(),
+			QString("%1 documents, %2 categories").arg(documents).arg(categories));
+		QMetaObject::invokeMethod(this, [this, documents, categories]() {
+			emit trained(documents, categories);
+		}, Qt::QueuedConnection);
+	});
+}
+
+void CategoryClassifier::learn(const QString &filePath, const QString &category)
+{
+	QtConcurrent::run(&m_pool, [this, filePath, category]() {
+		QElapsedTimer timer;
+		timer.start();
+		addDocument(QFileInfo(category).absoluteFilePath(), extractTerms(filePath));
+		TimingLog::write("classifier.learn", timer.elapsed(), QFileInfo(filePath).fileName());
+	});
+}
+
+void CategoryClassifier::moveCategory(const QString &from, const QString &to)
+{
+	QtConcurrent::run(&m_pool, [this, from, to]() {
+		QWriteLocker locker(&m_lock);
+		const QString prefix = from + '/';
+		const QStringList categories = m_categories.keys();
+		for (const QString &category : categories) {
+			if (category != from && !category.startsWith(prefix))
+				continue;
+			CategoryStats moved = m_categories.take(category);
+			CategoryStats &target = m_categories[to + category.mid(from.size())];
+			// Merging into an existing theme adds the counts up
+			target.documents += moved.documents;
+			target.totalTerms += moved.totalTerms;
+			for (auto it = moved.terms.constBegin(); it != moved.terms.constEnd(); ++it)
+				target.terms[it.key()] += it.value();
+		}
+	});
+}
+
+void CategoryClassifier::suggest(const QString &filePath, int count)
+{
+	// Only reads the model, it does not queue behind training
+	QtConcurrent::run(&m_suggestPool, [this, filePath, count]() {
+		QElapsedTimer timer;
+		timer.start();
+		const QStringList categories = rank(extractTerms(filePath), count);
+		TimingLog::write("classifier.suggest", timer.elapsed(), QFileInfo(filePath).fileName());
+		QMetaObject::invokeMethod(this, [this, filePath, categories]() {
+			emit suggestionsReady(filePath, categories);
+		}, Qt::QueuedConnection);
+	});
+}
+
+void CategoryClassifier::addDocument(const QString &category, const TermCounts &terms)
+{
+	if (terms.isEmpty())
+		return;
+	QWriteLocker locker(&m_lock);
+	CategoryStats &stats = m_categories[category];
+	++stats.documents;
+	for (auto it = terms.constBegin(); it != terms.constEnd(); ++it) {
+		stats.terms[it.key()] += it.value();
+		stats.totalTerms += it.value();
+		++m_vocabulary[it.key()];
+	}
+	m_documentCount.fetchAndAddOrdered(1);
+}
+
+QStringList CategoryClassifier::rank(const TermCounts &terms, int count) const
+{
+	QReadLocker locker(&m_lock);
+	const int documents = m_documentCount.loadAcquire();
+	if (terms.isEmpty() || documents == 0)
+		return QStringList();
+
+	// Laplace smoothing over the whole vocabulary, scores stay in log space
+	const double vocabularySize = m_vocabulary.size() + 1;
+	const double priorDenominator = std::log(double(documents + m_categories.size()));
+	QVector<QPair<double, QString>> scores;
+	scores.reserve(m_categories.size());
+	for (auto category = m_categories.constBegin(); category != m_categories.constEnd(); ++category) {
+		const CategoryStats &stats = category.value();
+		const double termDenominator = std::log(stats.totalTerms + vocabularySize);
+		double score = std::log(double(stats.documents + 1)) - priorDenominator;
+		for (auto term = terms.constBegin(); term != terms.constEnd(); ++term) {
+			// Words never seen in training say nothing about any category
+			if (!m_vocabulary.contains(term.key()))
+				continue;
+			score += term.value() * (std::log(stats.terms.value(term.key()) + 1.0) - termDenominator);
+		}
+		scores.append(qMakePair(score, category.key()));
+	}
+
+	const int top = qMin(count, scores.size());
+	std::partial_sort(scores.begin(), scores.begin() + top, scores.end(),
+		[](const QPair<double, QString> &a, const QPair<double, QString> &b) { return a.first > b.first; });
+	QStringList result;
+	for (int i = 0; i < top; ++i)
+		result.append(scores.at(i).second);
+	return result;
+}
@@ -0,0 +1,64 @@
+#ifndef CATEGORYCLASSIFIER_H
+#define CATEGORYCLASSIFIER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QStringList>
+#include <QThreadPool>
+
+// Multinomial naive Bayes over the words of saved articles. Every folder under
+// the categories root is a class, the archives already filed there are the
+// training set. Training and updates run in order on one worker thread;
+// suggestions run on a thread of their own, so a training pass held back
+// while the user triages never delays them.
+class CategoryClassifier : public QObject
+{
+	Q_OBJECT
+
+public:
+	typedef QHash<QString, int> TermCounts;
+
+	explicit CategoryClassifier(QObject *parent = nullptr);
+	~CategoryClassifier();
+
+	// Drops the model and trains it again from every archive under rootFolder
+	void rebuild(const QString &rootFolder);
+	// Adds one archive to the model, called after an article was filed
+	void learn(const QString &filePath, const QString &category);
+	// Re-keys the category and everything below it after a rename, move or merge
+	void moveCategory(const QString &from, const QString &to);
+	// Ranks categories for the archive, answered by suggestionsReady()
+	void suggest(const QString &filePath, int count);
+
+	bool isTrained() const;
+
+	static TermCounts extractTerms(const QString &filePath);
+
+signals:
+	void trained(int documents, int categories);
+	void suggestionsReady(const QString &filePath, const QStringList &categories);
+
+private:
+	struct CategoryStats
+	{
+		TermCounts terms;
+		qint64 totalTerms = 0;
+		int documents = 0;
+	};
+
+	void addDocument(const QString &category, const TermCounts &terms);
+	QStringList rank(const TermCounts &terms, int count) const;
+
+	QThreadPool m_pool;
+	QThreadPool m_suggestPool;
+	QAtomicInt m_generation;
+	QAtomicInt m_documentCount;
+	// Written by the worker thread, read by suggestions
+	mutable QReadWriteLock m_lock;
+	QHash<QString, CategoryStats> m_categories;
+	QHash<QString, int> m_vocabulary;
+};
+
+#endif // CATEGORYCLASSIFIER_H
@@ -0,0 +1,235 @@
+#include "categoryindex.h"
+#include "backgroundscheduler.h"
+#include "timinglog.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <algorithm>
+
+CategoryIndex::CategoryIndex(QObject *parent)
+	: QObject(parent)
+	, m_ready(false)
+	, m_generation(0)
+{
+	connect(&m_watcher, &QFutureWatcher<Scan>::finished, this, [this]() {
+		if (!m_watcher.isCanceled())
+			setEntries(m_watcher.result());
+	});
+}
+
+void CategoryIndex::rebuild(const QString &rootFolder)
+{
+	m_rootFolder = QDir(rootFolder).absolutePath();
+	m_ready = false;
+	// The new scan sees every change made so far
+	m_deferred.clear();
+	const QString root = m_rootFolder;
+	const int generation = ++m_generation;
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Normal, "categoryIndex.scan",
+		[root, generation](BackgroundJob &) {
+			Scan result;
+			result.generation = generation;
+			result.entries = scan(root);
+			return result;
+		}));
+}
+
+QVector<CategoryIndex::Entry> CategoryIndex::scan(const QString &rootFolder)
+{
+	QElapsedTimer timer;
+	timer.start();
+	QVector<Entry> entries;
+	QDirIterator it(rootFolder, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+	while (it.hasNext())
+		entries.append(makeEntry(rootFolder, it.next()));
+	TimingLog::write("categoryIndex.scan", timer.elapsed(), QString("%1 folders").arg(entries.size()));
+	return entries;
+}
+
+void CategoryIndex::setEntries(const Scan &scan)
+{
+	// A result of an earlier rebuild() arrives after the next one started
+	if (scan.generation != m_generation)
+		return;
+	m_entries = scan.entries;
+	m_positions.clear();
+	m_positions.reserve(m_entries.size());
+	for (int i = 0; i < m_entries.size(); ++i)
+		m_positions.insert(m_entries.at(i).path, i);
+	m_ready = true;
+	// The scan may or may not have seen them, each update is harmless to repeat
+	const QVector<std::function<void()>> deferred = m_deferred;
+	m_deferred.clear();
+	for (const std::function<void()> &update : deferred)
+		update();
+	invalidate();
+	emit ready(m_entries.size());
+}
+
+bool CategoryIndex::deferWhileScanning(const std::function<void()> &update)
+{
+	if (!m_watcher.isRunning())
+		return false;
+	m_deferred.append(update);
+	return true;
+}
+
+CategoryIndex::Entry CategoryIndex::makeEntry(const QString &rootFolder, const QString &path)
+{
+	Entry entry;
+	entry.path = QDir::cleanPath(path);
+	entry.key = QDir(rootFolder).relativeFilePath(entry.path).toLower();
+	entry.mask = charMask(entry.key);
+	return entry;
+}
+
+quint64 CategoryIndex::charMask(const QString &text)
+{
+	quint64 mask = 0;
+	for (QChar c : text)
+		mask |= quint64(1) << (c.unicode() % 64);
+	return mask;
+}
+
+void CategoryIndex::invalidate()
+{
+	m_lastQuery.clear();
+	m_lastCandidates.clear();
+}
+
+void CategoryIndex::addFolder(const QString &path)
+{
+	if (deferWhileScanning([this, path]() { addFolder(path); }))
+		return;
+	Entry entry = makeEntry(m_rootFolder, path);
+	if (m_positions.contains(entry.path))
+		return;
+	m_positions.insert(entry.path, m_entries.size());
+	m_entries.append(entry);
+	invalidate();
+}
+
+void CategoryIndex::removeEntry(int i)
+{
+	// Swap-remove keeps removal O(1), order does not matter
+	if (m_positions.value(m_entries.at(i).path, -1) == i)
+		m_positions.remove(m_entries.at(i).path);
+	if (i != m_entries.size() - 1) {
+		m_entries[i] = m_entries.last();
+		m_positions.insert(m_entries.at(i).path, i);
+	}
+	m_entries.removeLast();
+}
+
+void CategoryIndex::removeFolder(const QString &path)
+{
+	if (deferWhileScanning([this, path]() { removeFolder(path); }))
+		return;
+	const QString folder = QDir::cleanPath(path);
+	const QString prefix = folder + '/';
+	for (int i = m_entries.size() - 1; i >= 0; --i) {
+		const QString &entryPath = m_entries.at(i).path;
+		if (entryPath == folder || entryPath.startsWith(prefix))
+			removeEntry(i);
+	}
+	invalidate();
+}
+
+void CategoryIndex::moveFolder(const QString &from, const QString &to)
+{
+	if (deferWhileScanning([this, from, to]() { moveFolder(from, to); }))
+		return;
+	const QString source = QDir::cleanPath(from);
+	const QString target = QDir::cleanPath(to);
+	const QString prefix = source + '/';
+	// After a merge some folders already exist at the target, drop those entries
+	QVector<int> duplicates;
+	for (int i = 0; i < m_entries.size(); ++i) {
+		const QString entryPath = m_entries.at(i).path;
+		if (entryPath != source && !entryPath.startsWith(prefix))
+			continue;
+		Entry entry = makeEntry(m_rootFolder, target + entryPath.mid(source.size()));
+		if (m_positions.contains(entry.path)) {
+			duplicates.append(i);
+			continue;
+		}
+		m_positions.remove(entryPath);
+		m_entries[i] = entry;
+		m_positions.insert(entry.path, i);
+	}
+	for (int i = duplicates.size() - 1; i >= 0; --i)
+		removeEntry(duplicates.at(i));
+	invalidate();
+}
+
+int CategoryIndex::score(const QString &key, const QString &query)
+{
+	// Greedy subsequence match; consecutive characters and characters at the start
+	// of a path segment or word score higher, shorter paths win ties
+	const QChar *k = key.constData();
+	const int keySize = key.size();
+	int result = 0;
+	int pos = 0;
+	int previous = -2;
+	for (QChar q : query) {
+		while (pos < keySize && k[pos] != q)
+			++pos;
+		if (pos == keySize)
+			return -1;
+		int points = 1;
+		if (pos == previous + 1)
+			points += 4;
+		if (pos == 0 || k[pos - 1] == '/')
+			points += 8;
+		else if (!k[pos - 1].isLetterOrNumber())
+			points += 4;
+		result += points;
+		previous = pos++;
+	}
+	// The final segment is the folder name itself, prefer matches there
+	if (previous > key.lastIndexOf('/'))
+		result += 8;
+	return result * 256 - qMin(keySize, 255);
+}
+
+QStringList CategoryIndex::match(const QString &query, int limit)
+{
+	const QString needle = query.toLower().remove(' ');
+	QStringList result;
+	if (needle.isEmpty() || limit <= 0)
+		return result;
+
+	const bool narrowing = !m_lastQuery.isEmpty() && needle.startsWith(m_lastQuery);
+	const quint64 mask = charMask(needle);
+	QVector<int> candidates;
+	QVector<QPair<int, int>> scored;
+	const int pool = narrowing ? m_lastCandidates.size() : m_entries.size();
+	candidates.reserve(pool);
+	scored.reserve(pool);
+	auto consider = [&](int i) {
+		const Entry &entry = m_entries.at(i);
+		if ((mask & ~entry.mask) != 0)
+			return;
+		int s = score(entry.key, needle);
+		if (s < 0)
+			return;
+		candidates.append(i);
+		scored.append(qMakePair(s, i));
+	};
+	if (narrowing) {
+		for (int i : qAsConst(m_lastCandidates))
+			consider(i);
+	} else {
+		for (int i = 0; i < m_entries.size(); ++i)
+			consider(i);
+	}
+	m_lastQuery = needle;
+	m_lastCandidates = candidates;
+
+	const int top = qMin(limit, scored.size());
+	std::partial_sort(scored.begin(), scored.begin() + top, scored.end(),
+		[](const QPair<int, int> &a, const QPair<int, int> &b) { return a.first > b.first; });
+	for (int i = 0; i < top; ++i)
+		result.append(m_entries.at(scored.at(i).second).path);
+	return result;
+}
@@ -0,0 +1,75 @@
+#ifndef CATEGORYINDEX_H
+#define CATEGORYINDEX_H
+
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+// In-memory index of every category folder for fuzzy lookup by path.
+// The tree is walked once on a worker thread, afterwards the index is kept
+// current by explicit updates instead of rescanning the disk.
+class CategoryIndex : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit CategoryIndex(QObject *parent = nullptr);
+
+	void rebuild(const QString &rootFolder);
+	QString rootFolder() const { return m_rootFolder; }
+	int size() const { return m_entries.size(); }
+	bool isReady() const { return m_ready; }
+
+	void addFolder(const QString &path);
+	// Removes the folder and everything below it
+	void removeFolder(const QString &path);
+	// Re-bases the folder and everything below it, used for renames, moves and merges
+	void moveFolder(const QString &from, const QString &to);
+
+	// Absolute folder paths matching the query as a subsequence, best first
+	QStringList match(const QString &query, int limit);
+
+signals:
+	void ready(int folders);
+
+private:
+	struct Entry
+	{
+		QString path;      // absolute path
+		QString key;       // lower-case path relative to the root
+		quint64 mask = 0;  // characters present in key, for fast rejection
+	};
+
+	struct Scan
+	{
+		int generation = 0;
+		QVector<Entry> entries;
+	};
+
+	static Entry makeEntry(const QString &rootFolder, const QString &path);
+	static QVector<Entry> scan(const QString &rootFolder);
+	static quint64 charMask(const QString &text);
+	static int score(const QString &key, const QString &query);
+	void setEntries(const Scan &scan);
+	// Updates made while a scan runs are applied again to its result
+	bool deferWhileScanning(const std::function<void()> &update);
+	void removeEntry(int i);
+	void invalidate();
+
+	QString m_rootFolder;
+	QVector<Entry> m_entries;
+	QHash<QString, int> m_positions;
+	bool m_ready;
+	int m_generation;
+	QFutureWatcher<Scan> m_watcher;
+	QVector<std::function<void()>> m_deferred;
+
+	// Candidates of the previous query, a longer query only narrows them
+	QString m_lastQuery;
+	QVector<int> m_lastCandidates;
+};
+
+#endif // CATEGORYINDEX_H
@@ -0,0 +1,268 @@
+#include "categoryoperations.h"
+#include "timinglog.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <algorithm>
+
+// Journal layout: the first line is "source<TAB>target", every further line is
+// one planned "from<TAB>to" move. Indexes of finished moves go to a .done file.
+CategoryOperations::CategoryOperations(QObject *parent)
+	: QObject(parent)
+{
+	connect(&m_planWatcher, &QFutureWatcher<QVector<FileMove>>::finished, this, [this]() {
+		runMoves(m_planWatcher.result());
+	});
+	connect(&m_moveWatcher, &QFutureWatcher<void>::progressValueChanged, this, [this](int value) {
+		emit progress(value, m_moves.size());
+	});
+	connect(&m_moveWatcher, &QFutureWatcher<void>::finished, this, &CategoryOperations::finish);
+}
+
+CategoryOperations::~CategoryOperations()
+{
+	// Unfinished moves stay in the journal and are resumed on the next start
+	m_planWatcher.waitForFinished();
+	m_moveWatcher.cancel();
+	m_moveWatcher.waitForFinished();
+}
+
+QString CategoryOperations::journalPath()
+{
+	QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+	QDir().mkpath(dir);
+	return dir + "/categoryops.journal";
+}
+
+bool CategoryOperations::rename(const QString &folder, const QString &newName)
+{
+	if (newName.isEmpty() || newName.contains('/') || newName.contains('\\'))
+		return false;
+	return relocate(folder, QFileInfo(folder).absolutePath() + '/' + newName);
+}
+
+bool CategoryOperations::moveSubtree(const QString &folder, const QString &newParent)
+{
+	return relocate(folder, QDir(newParent).absolutePath() + '/' + QFileInfo(folder).fileName());
+}
+
+bool CategoryOperations::relocate(const QString &source, const QString &target)
+{
+	const QString from = QDir(source).absolutePath();
+	const QString to = QDir::cleanPath(target);
+	if (isBusy() || from == to || to.startsWith(from + '/') || QFileInfo::exists(to))
+		return false;
+	// Same volume: one directory rename moves the whole subtree atomically
+	if (QDir().rename(from, to)) {
+		emit finished(from, to, 0);
+		return true;
+	}
+	return start(from, to);
+}
+
+bool CategoryOperations::merge(const QString &source, const QString &target)
+{
+	const QString from = QDir(source).absolutePath();
+	const QString to = QDir(target).absolutePath();
+	if (isBusy() || from == to || to.startsWith(from + '/') || !QFileInfo(to).isDir())
+		return false;
+	return start(from, to);
+}
+
+bool CategoryOperations::start(const QString &source, const QString &target)
+{
+	m_source = source;
+	m_target = target;
+	m_failed.storeRelease(0);
+	m_timer.start();
+	m_planWatcher.setFuture(QtConcurrent::run(&CategoryOperations::planMoves, source, target));
+	return true;
+}
+
+QVector<CategoryOperations::FileMove> CategoryOperations::planMoves(const QString &source, const QString &target)
+{
+	QVector<FileMove> moves;
+	QSet<QString> planned;
+	const QDir sourceDir(source);
+	QDirIterator it(source, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		const QString from = it.next();
+		QString to = target + '/' + sourceDir.relativeFilePath(from);
+		// Folders of the same name are merged, their files are planned on their own
+		if (it.fileInfo().isDir()) {
+			moves.append({ from, to, moves.size(), false });
+			continue;
+		}
+		// Same name in both themes: keep both, the incoming one gets a number
+		if (QFileInfo::exists(to) || planned.contains(to)) {
+			const QFileInfo info(to);
+			const QString stem = info.absolutePath() + '/' + info.completeBaseName();
+			const QString suffix = info.suffix().isEmpty() ? QString() : '.' + info.suffix();
+			int n = 2;
+			do
+				to = QString("%1 (%2)%3").arg(stem).arg(n++).arg(suffix);
+			while (QFileInfo::exists(to) || planned.contains(to));
+		}
+		planned.insert(to);
+		moves.append({ from, to, moves.size(), false });
+	}
+	return moves;
+}
+
+void CategoryOperations::runMoves(const QVector<FileMove> &moves)
+{
+	m_moves = moves;
+
+	QSaveFile journal(journalPath());
+	if (journal.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		QTextStream out(&journal);
+		out.setCodec("UTF-8");
+		out << m_source << '\t' << m_target << '\n';
+		for (const FileMove &move : qAsConst(m_moves))
+			out << move.from << '\t' << move.to << '\n';
+		out.flush();
+		journal.commit();
+	}
+	m_doneLog.setFileName(journalPath() + ".done");
+	m_doneLog.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text);
+
+	emit progress(0, m_moves.size());
+	m_moveWatcher.setFuture(QtConcurrent::map(m_moves, [this](const FileMove &move) {
+		if (moveFile(move))
+			markDone(move.index);
+		else
+			m_failed.fetchAndAddOrdered(1);
+	}));
+}
+
+void CategoryOperations::markDone(int index)
+{
+	QMutexLocker locker(&m_doneMutex);
+	m_doneLog.write(QByteArray::number(index) + '\n');
+	m_doneLog.flush();
+}
+
+bool CategoryOperations::moveFile(const FileMove &move)
+{
+	const QString &from = move.from;
+	const QString &to = move.to;
+	if (QFileInfo(from).isDir())
+		return QDir().mkpath(to);
+	QDir().mkpath(QFileInfo(to).absolutePath());
+	if (QFileInfo::exists(to)) {
+		// A crash between copy and delete leaves the complete copy behind; anything
+		// else at the planned name is another file and the move fails
+		if (!move.resumed || !sameContent(from, to))
+			return false;
+		return QFile::remove(from);
+	}
+	if (QFile::rename(from, to))
+		return true;
+	// Across volumes rename fails, fall back to copy and delete; the copy goes
+	// under a temporary name so an interrupted one is never taken for the file
+	const QString part = to + ".part";
+	QFile::remove(part);
+	if (!QFile::copy(from, part))
+		return false;
+	if (!QFile::rename(part, to)) {
+		QFile::remove(part);
+		return false;
+	}
+	if (QFile::remove(from))
+		return true;
+	QFile::remove(to);
+	return false;
+}
+
+bool CategoryOperations::sameContent(const QString &a, const QString &b)
+{
+	QFile first(a);
+	QFile second(b);
+	if (first.size() != second.size() || !first.open(QIODevice::ReadOnly) || !second.open(QIODevice::ReadOnly))
+		return false;
+	while (!first.atEnd()) {
+		const QByteArray chunk = first.read(1024 * 1024);
+		if (chunk.isEmpty() || chunk != second.read(chunk.size()))
+			return false;
+	}
+	return true;
+}
+
+void CategoryOperations::removeEmptyFolders(const QString &folder)
+{
+	QStringList folders;
+	QDirIterator it(folder, QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden, QDirIterator::Subdirectories);
+	while (it.hasNext())
+		folders.append(it.next());
+	// Deepest first, rmdir refuses folders that still hold anything
+	std::sort(folders.begin(), folders.end(), [](const QString &a, const QString &b) {
+		return a.count('/') > b.count('/');
+	});
+	for (const QString &path : qAsConst(folders))
+		QDir().rmdir(path);
+	QDir().rmdir(folder);
+}
+
+void CategoryOperations::finish()
+{
+	m_doneLog.close();
+	if (m_moveWatcher.isCanceled())
+		return;
+
+	const int failed = m_failed.loadAcquire();
+	removeEmptyFolders(m_source);
+	if (failed == 0) {
+		QFile::remove(journalPath());
+		QFile::remove(journalPath() + ".done");
+	}
+	TimingLog::write("categoryOps.moves", m_timer.elapsed(),
+		QString("%1 files, %2 failed").arg(m_moves.size()).arg(failed));
+
+	const QString from = m_source;
+	const QString to = m_target;
+	m_source.clear();
+	m_target.clear();
+	m_moves.clear();
+	emit finished(from, to, failed);
+}
+
+void CategoryOperations::resumeJournal()
+{
+	if (isBusy())
+		return;
+	QFile journal(journalPath());
+	if (!journal.open(QIODevice::ReadOnly | QIODevice::Text))
+		return;
+	QTextStream in(&journal);
+	in.setCodec("UTF-8");
+	const QStringList header = in.readLine().split('\t');
+	if (header.size() != 2)
+		return;
+
+	QSet<int> done;
+	QFile doneLog(journalPath() + ".done");
+	if (doneLog.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		while (!doneLog.atEnd())
+			done.insert(doneLog.readLine().trimmed().toInt());
+	}
+
+	QVector<FileMove> moves;
+	for (int index = 0; !in.atEnd(); ++index) {
+		const QStringList fields = in.readLine().split('\t');
+		if (fields.size() != 2 || done.contains(index) || !QFileInfo::exists(fields.at(0)))
+			continue;
+		moves.append({ fields.at(0), fields.at(1), moves.size(), true });
+	}
+	journal.close();
+
+	m_source = header.at(0);
+	m_target = header.at(1);
+	m_failed.storeRelease(0);
+	m_timer.start();
+	runMoves(moves);
+}
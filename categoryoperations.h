@@ -0,0 +1,69 @@
+#ifndef CATEGORYOPERATIONS_H
+#define CATEGORYOPERATIONS_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+// Restructures the category tree: rename, move a subtree, merge two themes.
+// A plain directory rename is used whenever possible; otherwise every archive
+// is moved on the thread pool, with a journal so a crash can be finished later.
+class CategoryOperations : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit CategoryOperations(QObject *parent = nullptr);
+	~CategoryOperations();
+
+	bool isBusy() const { return !m_source.isEmpty(); }
+
+	bool rename(const QString &folder, const QString &newName);
+	bool moveSubtree(const QString &folder, const QString &newParent);
+	bool merge(const QString &source, const QString &target);
+
+	// Completes an operation interrupted by a crash, if the journal holds one
+	void resumeJournal();
+
+signals:
+	void progress(int done, int total);
+	// Everything below from now lives below to
+	void finished(const QString &from, const QString &to, int failed);
+
+private:
+	// A folder entry only creates its target, so empty categories survive the move
+	struct FileMove
+	{
+		QString from;
+		QString to;
+		int index;
+		bool resumed;          // replayed from the journal of an interrupted run
+	};
+
+	bool relocate(const QString &source, const QString &target);
+	bool start(const QString &source, const QString &target);
+	void runMoves(const QVector<FileMove> &moves);
+	void finish();
+	void markDone(int index);
+
+	static QVector<FileMove> planMoves(const QString &source, const QString &target);
+	static bool moveFile(const FileMove &move);
+	static bool sameContent(const QString &a, const QString &b);
+	static void removeEmptyFolders(const QString &folder);
+	static QString journalPath();
+
+	QString m_source;
+	QString m_target;
+	QVector<FileMove> m_moves;
+	QAtomicInt m_failed;
+	QElapsedTimer m_timer;
+	QFutureWatcher<QVector<FileMove>> m_planWatcher;
+	QFutureWatcher<void> m_moveWatcher;
+	QFile m_doneLog;
+	QMutex m_doneMutex;
+};
+
+#endif // CATEGORYOPERATIONS_H
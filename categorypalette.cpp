@@ -0,0 +1,99 @@
+#include "categorypalette.h"
+#include "categoryindex.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QVBoxLayout>
+
+static const int MaxMatches = 50;
+
+CategoryPalette::CategoryPalette(CategoryIndex *index, QWidget *parent)
+	: QFrame(parent, Qt::Popup)
+	, m_index(index)
+{
+	setFrameStyle(QFrame::Panel | QFrame::Raised);
+	m_input = new QLineEdit;
+	m_input->setPlaceholderText(tr("Move article to category..."));
+	m_input->installEventFilter(this);
+	m_matches = new QListWidget;
+	m_matches->setUniformItemSizes(true);
+	m_status = new QLabel;
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->addWidget(m_input);
+	layout->addWidget(m_matches, 1);
+	layout->addWidget(m_status);
+
+	connect(m_input, &QLineEdit::textChanged, this, &CategoryPalette::updateMatches);
+	connect(m_input, &QLineEdit::returnPressed, this, &CategoryPalette::acceptCurrent);
+	connect(m_matches, &QListWidget::itemActivated, this, &CategoryPalette::acceptCurrent);
+	connect(m_index, &CategoryIndex::ready, this, [this]() {
+		if (isVisible())
+			updateMatches(m_input->text());
+	});
+}
+
+void CategoryPalette::popup()
+{
+	QWidget *window = parentWidget()->window();
+	const QSize size(qMax(400, window->width() / 2), qMax(300, window->height() / 2));
+	const QPoint topLeft = window->mapToGlobal(QPoint((window->width() - size.width()) / 2, window->height() / 8));
+	setGeometry(QRect(topLeft, size));
+	m_input->clear();
+	updateMatches(QString());
+	show();
+	m_input->setFocus();
+}
+
+void CategoryPalette::updateMatches(const QString &text)
+{
+	m_matches->clear();
+	if (!m_index->isReady()) {
+		m_status->setText(tr("Indexing categories..."));
+		return;
+	}
+	QElapsedTimer timer;
+	timer.start();
+	const QStringList paths = m_index->match(text, MaxMatches);
+	const qint64 elapsed = timer.nsecsElapsed() / 1000;
+
+	QDir root(m_index->rootFolder());
+	for (const QString &path : paths) {
+		QListWidgetItem *item = new QListWidgetItem(root.relativeFilePath(path), m_matches);
+		item->setData(Qt::UserRole, path);
+	}
+	m_matches->setCurrentRow(0);
+	m_status->setText(tr("%1 folders, matched in %2 us").arg(m_index->size()).arg(elapsed));
+}
+
+void CategoryPalette::acceptCurrent()
+{
+	QListWidgetItem *item = m_matches->currentItem();
+	if (!item)
+		return;
+	const QString path = item->data(Qt::UserRole).toString();
+	hide();
+	emit categoryChosen(path);
+}
+
+bool CategoryPalette::eventFilter(QObject *watched, QEvent *event)
+{
+	// Keep typing in the line edit while the arrows walk the list
+	if (watched == m_input && event->type() == QEvent::KeyPress) {
+		QKeyEvent *keyEvent = static_cast<QKeyEvent*>(event);
+		switch (keyEvent->key()) {
+		case Qt::Key_Up:
+		case Qt::Key_Down:
+		case Qt::Key_PageUp:
+		case Qt::Key_PageDown:
+			QCoreApplication::sendEvent(m_matches, event);
+			return true;
+		default:
+			break;
+		}
+	}
+	return QFrame::eventFilter(watched, event);
+}
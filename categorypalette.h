@@ -0,0 +1,41 @@
+#ifndef CATEGORYPALETTE_H
+#define CATEGORYPALETTE_H
+
+#include <QFrame>
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QLineEdit;
+class QListWidget;
+QT_END_NAMESPACE
+
+class CategoryIndex;
+
+// Command palette for picking a category by typing part of its path.
+// Enter reports the highlighted folder, Escape closes the palette.
+class CategoryPalette : public QFrame
+{
+	Q_OBJECT
+
+public:
+	CategoryPalette(CategoryIndex *index, QWidget *parent);
+
+	void popup();
+
+signals:
+	void categoryChosen(const QString &path);
+
+protected:
+	bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+	void updateMatches(const QString &text);
+	void acceptCurrent();
+
+	CategoryIndex *m_index;
+	QLineEdit *m_input;
+	QListWidget *m_matches;
+	QLabel *m_status;
+};
+
+#endif // CATEGORYPALETTE_H
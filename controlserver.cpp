@@ -0,0 +1,424 @@
+#include "controlserver.h"
+#include "articlecatalog.h"
+#include "backgroundscheduler.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+#include <QUrlQuery>
+#include <memory>
+
+static const int MaxHeaderBytes = 16 * 1024;
+static const int MaxBodyBytes = 1024 * 1024;
+static const int StreamBatch = 256;
+static const qint64 StreamHighWater = 256 * 1024;
+
+namespace
+{
+	QByteArray reasonPhrase(int status)
+	{
+		switch (status) {
+		case 200: return "OK";
+		case 202: return "Accepted";
+		case 400: return "Bad Request";
+		case 401: return "Unauthorized";
+		case 403: return "Forbidden";
+		case 404: return "Not Found";
+		case 413: return "Payload Too Large";
+		case 431: return "Request Header Fields Too Large";
+		default: return "Error";
+		}
+	}
+
+	QByteArray jsonString(const QString &text)
+	{
+		QByteArray array = QJsonDocument(QJsonArray() << text).toJson(QJsonDocument::Compact);
+		return array.mid(1, array.size() - 2);
+	}
+
+	QJsonObject error(const QString &message)
+	{
+		QJsonObject object;
+		object.insert("error", message);
+		return object;
+	}
+
+	bool isArchiveFile(const QFileInfo &file)
+	{
+		QString suffix = file.suffix().toLower();
+		return file.isFile() && (suffix == "mhtml" || suffix == "mht");
+	}
+
+	// Copies under a temporary name first, the queue and the ingest pipeline ignore partial files
+	QString copyIntoFolder(const QString &filePath, const QString &folder)
+	{
+		QFileInfo source(filePath);
+		if (!isArchiveFile(source))
+			return QString();
+		QDir dir(folder);
+		QString target = dir.filePath(source.fileName());
+		for (int i = 2; QFile::exists(target); ++i)
+			target = dir.filePath(QString("%1 (%2).%3").arg(source.completeBaseName()).arg(i).arg(source.suffix()));
+		QString partial = target + ".part";
+		QFile::remove(partial);
+		if (!QFile::copy(filePath, partial))
+			return QString();
+		if (!QFile::rename(partial, target)) {
+			QFile::remove(partial);
+			return QString();
+		}
+		return target;
+	}
+}
+
+ControlServer::ControlServer(const ArticleCatalog *catalog, QObject *parent)
+	: QObject(parent)
+	, m_catalog(catalog)
+	, m_server(nullptr)
+{
+	quint32 random[4];
+	QRandomGenerator::system()->fillRange(random);
+	m_token = QByteArray(reinterpret_cast<const char *>(random), sizeof(random)).toHex();
+	m_thread.setObjectName("ControlServer");
+}
+
+ControlServer::~ControlServer()
+{
+	if (m_server) {
+		// The server and its sockets are deleted as the thread finishes
+		m_thread.quit();
+		m_thread.wait();
+		QFile::remove(tokenPath());
+	}
+}
+
+QString ControlServer::tokenPath()
+{
+	QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+	QDir().mkpath(dir);
+	return dir + "/api.token";
+}
+
+void ControlServer::addCommand(const QByteArray &method, const QString &path, const Command &command)
+{
+	m_commands.insert(method + ' ' + path.toUtf8(), command);
+}
+
+bool ControlServer::listen(quint16 port)
+{
+	if (m_server)
+		return false;
+	QSaveFile tokenFile(tokenPath());
+	if (!tokenFile.open(QIODevice::WriteOnly))
+		return false;
+	tokenFile.write(m_token);
+	// Whoever reads the token can drive the browser, other users of the machine must not
+	tokenFile.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+	if (!tokenFile.commit())
+		return false;
+
+	m_server = new QTcpServer;
+	connect(m_server, &QTcpServer::newConnection, m_server, [this]() { handleNewConnection(); });
+	connect(&m_thread, &QThread::finished, m_server, &QObject::deleteLater);
+	m_server->moveToThread(&m_thread);
+	m_thread.start();
+
+	bool listening = false;
+	QMetaObject::invokeMethod(m_server, [this, port, &listening]() {
+		// Loopback only, the API is for tools running next to the browser
+		listening = m_server->listen(QHostAddress::LocalHost, port);
+		if (!listening)
+			qWarning("Control server failed: %s", qPrintable(m_server->errorString()));
+	}, Qt::BlockingQueuedConnection);
+	return listening;
+}
+
+void ControlServer::publishQueue(const QString &sourceFolder, const QStringList &files)
+{
+	QMutexLocker locker(&m_queueMutex);
+	m_sourceFolder = sourceFolder;
+	m_queue = files;
+}
+
+void ControlServer::handleNewConnection()
+{
+	while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+		connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+		connect(socket, &QTcpSocket::readyRead, m_server, [this, socket]() { processRequests(socket); });
+	}
+}
+
+void ControlServer::processRequests(QTcpSocket *socket)
+{
+	// Pipelined requests are answered in order, the next one waits for the current response
+	while (!socket->property("busy").toBool() && socket->bytesAvailable() > 0) {
+		QByteArray head = socket->peek(qMin<qint64>(socket->bytesAvailable(), MaxHeaderBytes + 4));
+		int headerEnd = head.indexOf("\r\n\r\n");
+		if (headerEnd < 0) {
+			if (head.size() > MaxHeaderBytes)
+				sendJson(socket, 431, error("Header too large"), false);
+			return;
+		}
+		QList<QByteArray> lines = head.left(headerEnd).split('\n');
+		QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+		if (requestLine.size() != 3) {
+			sendJson(socket, 400, error("Malformed request line"), false);
+			return;
+		}
+		QHash<QByteArray, QByteArray> headers;
+		for (const QByteArray &line : lines) {
+			int colon = line.indexOf(':');
+			if (colon > 0)
+				headers.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+		}
+		int contentLength = headers.value("content-length", "0").toInt();
+		if (contentLength < 0 || contentLength > MaxBodyBytes) {
+			sendJson(socket, 413, error("Body too large"), false);
+			return;
+		}
+		if (socket->bytesAvailable() < headerEnd + 4 + contentLength)
+			return; // wait for the rest of the body
+		socket->read(headerEnd + 4);
+		QByteArray body = socket->read(contentLength);
+
+		QByteArray connection = headers.value("connection").toLower();
+		bool keepAlive = requestLine[2] == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+		// Web pages can reach loopback ports too, browsers always send an Origin with those requests
+		if (headers.contains("origin")) {
+			sendJson(socket, 403, error("Cross-origin requests are not accepted"), false);
+			return;
+		}
+		if (headers.value("authorization") != "Bearer " + m_token) {
+			sendJson(socket, 401, error("Missing or wrong token"), keepAlive);
+			continue;
+		}
+
+		QUrl url(QString::fromUtf8(requestLine[1]));
+		QJsonObject arguments;
+		if (!body.trimmed().isEmpty()) {
+			QJsonDocument document = QJsonDocument::fromJson(body);
+			if (!document.isObject()) {
+				sendJson(socket, 400, error("The body must be a JSON object"), keepAlive);
+				continue;
+			}
+			arguments = document.object();
+		}
+		const auto items = QUrlQuery(url).queryItems(QUrl::FullyDecoded);
+		for (const auto &item : items)
+			arguments.insert(item.first, item.second);
+		dispatch(socket, requestLine[0], url.path(), arguments, keepAlive);
+	}
+}
+
+void ControlServer::dispatch(QTcpSocket *socket, const QByteArray &method, const QString &path,
+	const QJsonObject &arguments, bool keepAlive)
+{
+	QByteArray route = method + ' ' + path.toUtf8();
+	if (route == "GET /queue") {
+		QString folder;
+		QStringList files;
+		{
+			QMutexLocker locker(&m_queueMutex);
+			folder = m_sourceFolder;
+			files = m_queue;
+		}
+		int offset = qBound(0, arguments.value("offset").toVariant().toInt(), files.size());
+		int limit = arguments.contains("limit") ? arguments.value("limit").toVariant().toInt() : files.size();
+		int end = offset + qBound(0, limit, files.size() - offset);
+		auto index = std::make_shared<int>(-1);
+		sendStream(socket, [folder, files, offset, end, index]() {
+			QByteArray chunk;
+			if (*index < 0) {
+				chunk = "{\"sourceFolder\":" + jsonString(folder) + ",\"total\":" + QByteArray::number(files.size()) + ",\"files\":[";
+				*index = offset;
+			}
+			if (*index > end)
+				return chunk;
+			int batchEnd = qMin(end, *index + StreamBatch);
+			for (int i = *index; i < batchEnd; ++i) {
+				if (i > offset)
+					chunk += ',';
+				chunk += jsonString(files[i]);
+			}
+			*index = batchEnd;
+			if (batchEnd == end) {
+				chunk += "]}";
+				*index = end + 1;
+			}
+			return chunk;
+		}, keepAlive);
+	} else if (route == "POST /queue") {
+		enqueue(socket, arguments, keepAlive);
+	} else if (route == "GET /catalog" && !m_catalog) {
+		sendJson(socket, 404, error("The catalog is not available in this window"), keepAlive);
+	} else if (route == "GET /catalog" && (arguments.contains("path") || arguments.contains("sha1"))) {
+		QString filePath = arguments.value("path").toString();
+		if (filePath.isEmpty())
+			filePath = m_catalog->findBySha1(arguments.value("sha1").toString().toLatin1(), QString());
+		ArticleRecord record;
+		if (!filePath.isEmpty() && m_catalog->find(filePath, &record))
+			sendJson(socket, 200, ArticleCatalog::toJson(record), keepAlive);
+		else
+			sendJson(socket, 404, error("Not in the catalog"), keepAlive);
+	} else if (route == "GET /catalog") {
+		const QList<ArticleRecord> records = m_catalog->records();
+		auto index = std::make_shared<int>(-1);
+		sendStream(socket, [records, index]() {
+			QByteArray chunk;
+			if (*index < 0) {
+				chunk = "{\"records\":[";
+				*index = 0;
+			}
+			if (*index > records.size())
+				return chunk;
+			int batchEnd = qMin(records.size(), *index + StreamBatch);
+			for (int i = *index; i < batchEnd; ++i) {
+				if (i > 0)
+					chunk += ',';
+				chunk += QJsonDocument(ArticleCatalog::toJson(records[i])).toJson(QJsonDocument::Compact);
+			}
+			*index = batchEnd;
+			if (batchEnd == records.size()) {
+				chunk += "]}";
+				*index = batchEnd + 1;
+			}
+			return chunk;
+		}, keepAlive);
+	} else if (m_commands.contains(route)) {
+		// Window state belongs to the GUI thread, the answer comes back to this one
+		socket->setProperty("busy", true);
+		QPointer<QTcpSocket> guard(socket);
+		Command command = m_commands.value(route);
+		QMetaObject::invokeMethod(this, [this, guard, command, arguments, keepAlive]() {
+			QJsonObject result = command(arguments);
+			QMetaObject::invokeMethod(m_server, [this, guard, result, keepAlive]() {
+				if (!guard)
+					return;
+				guard->setProperty("busy", false);
+				sendJson(guard, result.contains("error") ? 400 : 200, result, keepAlive);
+				processRequests(guard);
+			}, Qt::QueuedConnection);
+		}, Qt::QueuedConnection);
+	} else {
+		sendJson(socket, 404, error("Unknown request " + QString::fromUtf8(route)), keepAlive);
+	}
+}
+
+void ControlServer::enqueue(QTcpSocket *socket, const QJsonObject &arguments, bool keepAlive)
+{
+	QString folder;
+	{
+		QMutexLocker locker(&m_queueMutex);
+		folder = m_sourceFolder;
+	}
+	if (folder.isEmpty()) {
+		sendJson(socket, 400, error("No source folder selected"), keepAlive);
+		return;
+	}
+	QJsonArray accepted;
+	QJsonArray rejected;
+	QStringList files;
+	const QJsonArray requested = arguments.value("files").toArray();
+	for (const QJsonValue &value : requested) {
+		if (isArchiveFile(QFileInfo(value.toString()))) {
+			accepted.append(value);
+			files.append(value.toString());
+		} else {
+			rejected.append(value);
+		}
+	}
+	QJsonObject result;
+	result.insert("accepted", accepted);
+	result.insert("rejected", rejected);
+	sendJson(socket, 202, result, keepAlive);
+	if (files.isEmpty())
+		return;
+
+	// Copying can take long, the connection thread answers other requests meanwhile;
+	// the copies show up in GET /queue once they are complete
+	QPointer<ControlServer> guard(this);
+	BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "api.enqueue",
+		[guard, files, folder](BackgroundJob &) {
+			QStringList copied;
+			for (const QString &filePath : files) {
+				QString target = copyIntoFolder(filePath, folder);
+				if (target.isEmpty())
+					qWarning("Control server could not enqueue %s", qPrintable(filePath));
+				else
+					copied.append(target);
+			}
+			if (copied.isEmpty())
+				return;
+			QMetaObject::invokeMethod(qApp, [guard, copied]() {
+				if (guard)
+					emit guard->filesEnqueued(copied);
+			}, Qt::QueuedConnection);
+		});
+}
+
+void ControlServer::sendJson(QTcpSocket *socket, int status, const QJsonObject &object, bool keepAlive)
+{
+	QByteArray body = QJsonDocument(object).toJson(QJsonDocument::Compact);
+	QByteArray head = "HTTP/1.1 " + QByteArray::number(status) + ' ' + reasonPhrase(status) + "\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+	if (!keepAlive)
+		head += "Connection: close\r\n";
+	socket->write(head + "\r\n" + body);
+	if (!keepAlive)
+		socket->disconnectFromHost();
+}
+
+void ControlServer::sendStream(QTcpSocket *socket, const Generator &next, bool keepAlive)
+{
+	// Chunked, so large listings are produced as fast as the client reads them
+	QByteArray head = "HTTP/1.1 200 OK\r\n"
+		"Content-Type: application/json\r\n"
+		"Transfer-Encoding: chunked\r\n";
+	if (!keepAlive)
+		head += "Connection: close\r\n";
+	socket->write(head + "\r\n");
+	socket->setProperty("busy", true);
+
+	auto generator = std::make_shared<Generator>(next);
+	auto connection = std::make_shared<QMetaObject::Connection>();
+	auto pump = [this, socket, generator, connection, keepAlive]() {
+		while (socket->bytesToWrite() < StreamHighWater) {
+			QByteArray chunk = (*generator)();
+			if (chunk.isEmpty()) {
+				QObject::disconnect(*connection);
+				socket->write("0\r\n\r\n");
+				finishResponse(socket, keepAlive);
+				return;
+			}
+			socket->write(QByteArray::number(chunk.size(), 16) + "\r\n" + chunk + "\r\n");
+		}
+	};
+	*connection = connect(socket, &QTcpSocket::bytesWritten, m_server, pump);
+	pump();
+}
+
+void ControlServer::finishResponse(QTcpSocket *socket, bool keepAlive)
+{
+	socket->setProperty("busy", false);
+	if (!keepAlive) {
+		socket->disconnectFromHost();
+		return;
+	}
+	// Requests that arrived meanwhile are still in the socket buffer
+	QPointer<QTcpSocket> guard(socket);
+	QMetaObject::invokeMethod(m_server, [this, guard]() {
+		if (guard)
+			processRequests(guard);
+	}, Qt::QueuedConnection);
+}
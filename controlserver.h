@@ -0,0 +1,67 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <functional>
+
+class ArticleCatalog;
+class QTcpServer;
+class QTcpSocket;
+
+// Loopback HTTP/JSON API for scripting triage from other tools.
+// Connections are served on a thread of their own: queue and catalog queries
+// are answered there, commands that touch the window run on the GUI thread.
+// Every request has to carry the token from tokenPath() as a bearer token.
+class ControlServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Runs on the GUI thread with the query items merged into the JSON body.
+	// A result with an "error" member is sent as 400.
+	typedef std::function<QJsonObject(const QJsonObject &arguments)> Command;
+
+	explicit ControlServer(const ArticleCatalog *catalog, QObject *parent = nullptr);
+	~ControlServer();
+
+	// Commands are read by the server thread, add them before listen()
+	void addCommand(const QByteArray &method, const QString &path, const Command &command);
+	bool listen(quint16 port);
+
+	// The queue lives on the GUI thread, the server answers from this copy
+	void publishQueue(const QString &sourceFolder, const QStringList &files);
+
+	static QString tokenPath();
+
+signals:
+	void filesEnqueued(const QStringList &files);
+
+private:
+	typedef std::function<QByteArray()> Generator;
+
+	void handleNewConnection();
+	void processRequests(QTcpSocket *socket);
+	void dispatch(QTcpSocket *socket, const QByteArray &method, const QString &path,
+		const QJsonObject &arguments, bool keepAlive);
+	void enqueue(QTcpSocket *socket, const QJsonObject &arguments, bool keepAlive);
+	void sendJson(QTcpSocket *socket, int status, const QJsonObject &object, bool keepAlive);
+	void sendStream(QTcpSocket *socket, const Generator &next, bool keepAlive);
+	void finishResponse(QTcpSocket *socket, bool keepAlive);
+
+	const ArticleCatalog *m_catalog;
+	QByteArray m_token;
+	QMap<QByteArray, Command> m_commands;
+	QThread m_thread;
+	QTcpServer *m_server;
+
+	QMutex m_queueMutex;
+	QString m_sourceFolder;
+	QStringList m_queue;
+};
+
+#endif // CONTROLSERVER_H
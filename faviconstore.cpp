@@ -0,0 +1,268 @@
+#include "faviconstore.h"
+#include "articlecatalog.h"
+#include "backgroundscheduler.h"
+#include "mhtmlarchive.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QPixmap>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QUrl>
+
+static const int TileSize = 32;
+static const int AtlasColumns = 32;
+// The archive header with the snapshot location is in the first few kilobytes
+static const qint64 HeaderReadBytes = 16 * 1024;
+
+FaviconStore *FaviconStore::instance()
+{
+	static FaviconStore store;
+	return &store;
+}
+
+FaviconStore::FaviconStore()
+	: m_atlasDirty(false)
+	, m_indexDirty(false)
+{
+	// Ingest workers may be the first to ask for the store, its signals belong to the GUI thread
+	if (QCoreApplication::instance())
+		moveToThread(QCoreApplication::instance()->thread());
+	load();
+}
+
+static QString atlasPath()
+{
+	return ArticleCatalog::cacheFolder() + "/favicons.png";
+}
+
+static QString indexPath()
+{
+	return ArticleCatalog::cacheFolder() + "/favicons.json";
+}
+
+void FaviconStore::load()
+{
+	QFile file(indexPath());
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+	QImage atlas(atlasPath());
+	if (atlas.isNull())
+		return;
+	m_atlas = atlas.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	const QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+	// Older indexes hold only the tiles
+	const QJsonObject tiles = index.contains("tiles") ? index.value("tiles").toObject() : index;
+	const QJsonObject files = index.value("files").toObject();
+	for (auto it = files.constBegin(); it != files.constEnd(); ++it)
+		m_fileOrigins.insert(it.key(), it.value().toString());
+	const int capacity = (m_atlas.width() / TileSize) * (m_atlas.height() / TileSize);
+	for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+		int tile = it.value().toInt(-1);
+		if (tile >= 0 && tile < capacity)
+			m_tiles.insert(it.key(), tile);
+	}
+}
+
+void FaviconStore::save()
+{
+	QImage atlas;
+	QJsonObject tiles;
+	QJsonObject files;
+	{
+		QMutexLocker locker(&m_mutex);
+		if (!m_atlasDirty && !m_indexDirty)
+			return;
+		if (m_atlasDirty)
+			atlas = m_atlas;
+		m_atlasDirty = m_indexDirty = false;
+		for (auto it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it)
+			tiles.insert(it.key(), it.value());
+		for (auto it = m_fileOrigins.constBegin(); it != m_fileOrigins.constEnd(); ++it)
+			files.insert(it.key(), it.value());
+	}
+	// The index is written last, it never refers to tiles the saved atlas lacks
+	if (!atlas.isNull()) {
+		QSaveFile image(atlasPath());
+		if (!image.open(QIODevice::WriteOnly) || !atlas.save(&image, "PNG") || !image.commit())
+			return;
+	}
+	QJsonObject index;
+	index.insert("tiles", tiles);
+	index.insert("files", files);
+	QSaveFile file(indexPath());
+	if (file.open(QIODevice::WriteOnly)) {
+		file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+		file.commit();
+	}
+}
+
+void FaviconStore::add(const QString &origin, const QImage &image)
+{
+	if (origin.isEmpty() || image.isNull())
+		return;
+	QImage tile = image.scaled(TileSize, TileSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	QMutexLocker locker(&m_mutex);
+	if (m_tiles.contains(origin))
+		return;
+	const int index = m_tiles.size();
+	const int rows = index / AtlasColumns + 1;
+	if (m_atlas.height() < rows * TileSize) {
+		// Grows by doubling, the atlas is copied only a few times
+		int height = qMax(rows * TileSize, m_atlas.height() * 2);
+		QImage grown(AtlasColumns * TileSize, height, QImage::Format_ARGB32_Premultiplied);
+		grown.fill(Qt::transparent);
+		QPainter painter(&grown);
+		painter.drawImage(0, 0, m_atlas);
+		painter.end();
+		m_atlas = grown;
+	}
+	QPainter painter(&m_atlas);
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	QRect cell((index % AtlasColumns) * TileSize, (index / AtlasColumns) * TileSize, TileSize, TileSize);
+	painter.fillRect(cell, Qt::transparent);
+	painter.drawImage(cell.x() + (TileSize - tile.width()) / 2, cell.y() + (TileSize - tile.height()) / 2, tile);
+	m_tiles.insert(origin, index);
+	m_atlasDirty = m_indexDirty = true;
+}
+
+void FaviconStore::addFromArchive(const QString &filePath, const MhtmlArchive &archive)
+{
+	const QString origin = originOf(QUrl(archive.snapshotLocation()));
+	if (origin.isEmpty())
+		return;
+	{
+		QMutexLocker locker(&m_mutex);
+		m_fileOrigins.insert(filePath, origin);
+		m_indexDirty = true;
+	}
+	if (!contains(origin))
+		add(origin, findIcon(archive));
+}
+
+bool FaviconStore::contains(const QString &origin) const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_tiles.contains(origin);
+}
+
+QIcon FaviconStore::icon(const QString &origin)
+{
+	if (origin.isEmpty())
+		return QIcon();
+	auto cached = m_icons.constFind(origin);
+	if (cached != m_icons.constEnd())
+		return cached.value();
+
+	QImage tile;
+	{
+		QMutexLocker locker(&m_mutex);
+		auto it = m_tiles.constFind(origin);
+		if (it == m_tiles.constEnd())
+			return QIcon(); // not cached, a later ingest may still bring it
+		tile = m_atlas.copy((it.value() % AtlasColumns) * TileSize, (it.value() / AtlasColumns) * TileSize, TileSize, TileSize);
+	}
+	QIcon icon(QPixmap::fromImage(tile));
+	m_icons.insert(origin, icon);
+	return icon;
+}
+
+QIcon FaviconStore::iconForUrl(const QUrl &url)
+{
+	if (url.isLocalFile())
+		return iconForFile(url.toLocalFile());
+	return icon(originOf(url));
+}
+
+QIcon FaviconStore::iconForFile(const QString &filePath)
+{
+	QString suffix = QFileInfo(filePath).suffix().toLower();
+	if (suffix != "mhtml" && suffix != "mht")
+		return QIcon();
+	QString origin;
+	{
+		QMutexLocker locker(&m_mutex);
+		auto it = m_fileOrigins.constFind(filePath);
+		if (it == m_fileOrigins.constEnd()) {
+			locker.unlock();
+			resolveLater(filePath);
+			return QIcon();
+		}
+		origin = it.value();
+	}
+	return icon(origin);
+}
+
+void FaviconStore::resolveLater(const QString &filePath)
+{
+	if (m_resolving.contains(filePath))
+		return;
+	m_resolving.insert(filePath);
+	// Files that were not ingested, e.g. already sorted into categories; only the header is read
+	BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "favicon.origin",
+		[this, filePath](BackgroundJob &) {
+			MhtmlArchive archive;
+			QString origin;
+			if (archive.load(filePath, HeaderReadBytes))
+				origin = originOf(QUrl(archive.snapshotLocation()));
+			{
+				QMutexLocker locker(&m_mutex);
+				m_fileOrigins.insert(filePath, origin);
+				m_indexDirty = true;
+			}
+			QMetaObject::invokeMethod(this, [this, filePath]() {
+				m_resolving.remove(filePath);
+				emit fileResolved(filePath);
+			}, Qt::QueuedConnection);
+		});
+}
+
+QString FaviconStore::originOf(const QUrl &url)
+{
+	if (!url.isValid() || url.host().isEmpty())
+		return QString();
+	return url.adjusted(QUrl::RemovePath | QUrl::RemoveQuery | QUrl::RemoveFragment | QUrl::RemoveUserInfo).toString().toLower();
+}
+
+QImage FaviconStore::findIcon(const MhtmlArchive &archive)
+{
+	const QVector<MhtmlPart> &parts = archive.parts();
+
+	// Icons the page declares, <link rel="icon" href="...">, resolved against the page location
+	QList<QByteArray> declared;
+	QString html = archive.rootHtml();
+	int headEnd = html.indexOf(QLatin1String("</head>"), 0, Qt::CaseInsensitive);
+	if (headEnd > 0)
+		html.truncate(headEnd);
+	static const QRegularExpression linkPattern("<link\\b[^>]*>", QRegularExpression::CaseInsensitiveOption);
+	static const QRegularExpression relPattern("\\brel\\s*=\\s*[\"']?([^\"'>]*)", QRegularExpression::CaseInsensitiveOption);
+	static const QRegularExpression hrefPattern("\\bhref\\s*=\\s*[\"']([^\"']*)[\"']", QRegularExpression::CaseInsensitiveOption);
+	const QUrl base(archive.snapshotLocation());
+	auto links = linkPattern.globalMatch(html);
+	while (links.hasNext()) {
+		const QString tag = links.next().captured(0);
+		if (!relPattern.match(tag).captured(1).contains(QLatin1String("icon"), Qt::CaseInsensitive))
+			continue;
+		const QString href = hrefPattern.match(tag).captured(1);
+		if (!href.isEmpty())
+			declared.append(base.resolved(QUrl(href)).toEncoded());
+	}
+
+	int best = -1;
+	for (int i = 0; i < parts.size() && best < 0; ++i) {
+		if (declared.contains(parts.at(i).contentLocation))
+			best = i;
+	}
+	for (int i = 0; i < parts.size() && best < 0; ++i) {
+		const MhtmlPart &part = parts.at(i);
+		if (part.contentType == "image/x-icon" || part.contentType == "image/vnd.microsoft.icon"
+			|| part.contentLocation.toLower().contains("favicon"))
+			best = i;
+	}
+	return best < 0 ? QImage() : QImage::fromData(archive.body(best));
+}
@@ -0,0 +1,63 @@
+#ifndef FAVICONSTORE_H
+#define FAVICONSTORE_H
+
+#include <QHash>
+#include <QIcon>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+class MhtmlArchive;
+class QUrl;
+
+// Site icons by origin, taken from the icon parts of ingested archives.
+// All icons share one atlas image in the cache folder, so the whole store is
+// loaded with a single file read and icons are shown before any page renders.
+// add() is safe from worker threads, the icon lookups are for the GUI thread.
+// The origins of archives are kept in the index too; an archive seen for the
+// first time is read in the background and fileResolved() reports it.
+class FaviconStore : public QObject
+{
+	Q_OBJECT
+
+public:
+	static FaviconStore *instance();
+
+	// Keeps the first icon seen for an origin
+	void add(const QString &origin, const QImage &image);
+	// Records the origin of an archive and stores its icon if it carries one
+	void addFromArchive(const QString &filePath, const MhtmlArchive &archive);
+	bool contains(const QString &origin) const;
+
+	QIcon icon(const QString &origin);
+	// Local archives resolve to the site they were saved from
+	QIcon iconForUrl(const QUrl &url);
+	// Empty until the origin of an unknown archive is read, see fileResolved()
+	QIcon iconForFile(const QString &filePath);
+
+	void save();
+
+	static QString originOf(const QUrl &url);
+	static QImage findIcon(const MhtmlArchive &archive);
+
+signals:
+	void fileResolved(const QString &filePath);
+
+private:
+	FaviconStore();
+	void load();
+	void resolveLater(const QString &filePath);
+
+	mutable QMutex m_mutex;
+	QImage m_atlas;
+	QHash<QString, int> m_tiles;          // origin -> tile index in the atlas
+	QHash<QString, QString> m_fileOrigins;
+	bool m_atlasDirty;
+	bool m_indexDirty;
+	QHash<QString, QIcon> m_icons;        // GUI thread only
+	QSet<QString> m_resolving;            // GUI thread only
+};
+
+#endif // FAVICONSTORE_H
@@ -0,0 +1,192 @@
+#include "findpanel.h"
+#include "articlequeue.h"
+#include "faviconstore.h"
+#include "mhtmlarchive.h"
+#include "tabwidget.h"
+#include "webview.h"
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QSpinBox>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+
+static const int SnippetContext = 60;
+static const int MaxSnippetsPerSource = 3;
+
+FindPanel::FindPanel(TabWidget *tabWidget, ArticleQueue *queue, QWidget *parent)
+	: QWidget(parent)
+	, m_tabWidget(tabWidget)
+	, m_queue(queue)
+	, m_pendingSources(0)
+	, m_matchedSources(0)
+{
+	m_searchEdit = new QLineEdit;
+	m_searchEdit->setPlaceholderText(tr("Search open tabs and queued archives"));
+	m_searchEdit->setClearButtonEnabled(true);
+	m_queueDepth = new QSpinBox;
+	m_queueDepth->setRange(0, 10000);
+	m_queueDepth->setValue(50);
+	m_queueDepth->setToolTip(tr("Number of queued archives to search"));
+	m_results = new QListWidget;
+	m_results->setWordWrap(true);
+	m_results->setAlternatingRowColors(true);
+	m_status = new QLabel;
+
+	QHBoxLayout *searchLayout = new QHBoxLayout;
+	searchLayout->addWidget(m_searchEdit, 1);
+	searchLayout->addWidget(new QLabel(tr("Queue items:")));
+	searchLayout->addWidget(m_queueDepth);
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->addLayout(searchLayout);
+	layout->addWidget(m_results, 1);
+	layout->addWidget(m_status);
+
+	m_pool.setMaxThreadCount(QThread::idealThreadCount());
+
+	connect(m_searchEdit, &QLineEdit::returnPressed, this, &FindPanel::startSearch);
+	connect(m_results, &QListWidget::itemActivated, this, &FindPanel::handleItemActivated);
+}
+
+FindPanel::~FindPanel()
+{
+	m_generation.fetchAndAddOrdered(1);
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+void FindPanel::setSearchText(const QString &text)
+{
+	m_searchEdit->setText(text);
+	m_searchEdit->setFocus();
+	m_searchEdit->selectAll();
+}
+
+void FindPanel::startSearch()
+{
+	// Bumping the generation drops results of the previous search still in flight
+	const int generation = m_generation.fetchAndAddOrdered(1) + 1;
+	m_pool.clear();
+	m_results->clear();
+	m_tabTargets.clear();
+	m_needle = m_searchEdit->text();
+	m_matchedSources = 0;
+	m_pendingSources = 0;
+	if (m_needle.isEmpty()) {
+		m_status->clear();
+		return;
+	}
+	m_timer.start();
+
+	const QString needle = m_needle;
+	for (int i = 0; i < m_tabWidget->count(); ++i) {
+		WebView *view = qobject_cast<WebView*>(m_tabWidget->widget(i));
+		if (!view)
+			continue;
+		++m_pendingSources;
+		QPointer<FindPanel> self(this);
+		QPointer<WebView> guard(view);
+		view->page()->toPlainText([self, generation, guard, needle](const QString &text) {
+			if (!self)
+				return;
+			if (guard)
+				self->addResult(generation, guard->title(), findSnippets(text, needle, MaxSnippetsPerSource), guard, QString());
+			self->finishSource(generation);
+		});
+	}
+
+	const QStringList files = m_queue->upcoming(m_queueDepth->value());
+	for (const QString &filePath : files) {
+		++m_pendingSources;
+		QtConcurrent::run(&m_pool, [this, generation, filePath, needle]() {
+			QString title;
+			QStringList snippets;
+			if (m_generation.loadAcquire() == generation) {
+				MhtmlArchive archive;
+				if (archive.load(filePath)) {
+					// The result row asks for the icon, the origin is known by then
+					FaviconStore::instance()->addFromArchive(filePath, archive);
+					title = archive.subject();
+					snippets = findSnippets(archive.plainText(), needle, MaxSnippetsPerSource);
+				}
+			}
+			if (title.isEmpty())
+				title = QFileInfo(filePath).fileName();
+			QMetaObject::invokeMethod(this, [this, generation, title, snippets, filePath]() {
+				addResult(generation, title, snippets, nullptr, filePath);
+				finishSource(generation);
+			}, Qt::QueuedConnection);
+		});
+	}
+
+	m_status->setText(tr("Searching %1 sources...").arg(m_pendingSources));
+}
+
+QStringList FindPanel::findSnippets(const QString &text, const QString &needle, int maxHits)
+{
+	QStringList snippets;
+	int pos = 0;
+	while (snippets.size() < maxHits) {
+		pos = text.indexOf(needle, pos, Qt::CaseInsensitive);
+		if (pos < 0)
+			break;
+		int start = qMax(0, pos - SnippetContext);
+		int end = qMin(text.size(), pos + needle.size() + SnippetContext);
+		QString snippet = text.mid(start, end - start).simplified();
+		if (start > 0)
+			snippet.prepend(QChar(0x2026));
+		if (end < text.size())
+			snippet.append(QChar(0x2026));
+		snippets.append(snippet);
+		pos += needle.size();
+	}
+	return snippets;
+}
+
+void FindPanel::addResult(int generation, const QString &title, const QStringList &snippets,
+	WebView *view, const QString &filePath)
+{
+	if (generation != m_generation.loadAcquire() || snippets.isEmpty())
+		return;
+
+	++m_matchedSources;
+	QString origin = view ? tr("Tab") : tr("Queue");
+	QListWidgetItem *item = new QListWidgetItem(QString("[%1] %2\n    %3").arg(origin, title, snippets.join("\n    ")));
+	item->setToolTip(filePath.isEmpty() ? title : filePath);
+	item->setData(Qt::UserRole, filePath);
+	if (view) {
+		item->setIcon(view->favIcon());
+		m_tabTargets.insert(item, view);
+	} else {
+		item->setIcon(FaviconStore::instance()->iconForFile(filePath));
+	}
+	m_results->addItem(item);
+}
+
+void FindPanel::finishSource(int generation)
+{
+	if (generation != m_generation.loadAcquire())
+		return;
+	if (--m_pendingSources > 0)
+		return;
+	m_status->setText(tr("\"%1\" found in %2 sources (%3 ms)")
+		.arg(m_needle).arg(m_matchedSources).arg(m_timer.elapsed()));
+}
+
+void FindPanel::handleItemActivated(QListWidgetItem *item)
+{
+	if (m_tabTargets.contains(item)) {
+		WebView *view = m_tabTargets.value(item);
+		if (!view)
+			return;
+		m_tabWidget->setCurrentWidget(view);
+		view->findText(m_needle);
+		return;
+	}
+	QString filePath = item->data(Qt::UserRole).toString();
+	if (!filePath.isEmpty())
+		emit fileRequested(filePath, m_needle);
+}
@@ -0,0 +1,63 @@
+#ifndef FINDPANEL_H
+#define FINDPANEL_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QThreadPool>
+#include <QWidget>
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QLineEdit;
+class QListWidget;
+class QListWidgetItem;
+class QSpinBox;
+QT_END_NAMESPACE
+
+class ArticleQueue;
+class TabWidget;
+class WebView;
+
+// Searches the text of every open tab and of the next queued archives at once.
+// Queued archives are read natively on a thread pool, results appear as they arrive.
+class FindPanel : public QWidget
+{
+	Q_OBJECT
+
+public:
+	FindPanel(TabWidget *tabWidget, ArticleQueue *queue, QWidget *parent = nullptr);
+	~FindPanel();
+
+	void setSearchText(const QString &text);
+	void startSearch();
+
+	static QStringList findSnippets(const QString &text, const QString &needle, int maxHits);
+
+signals:
+	void fileRequested(const QString &filePath, const QString &needle);
+
+private:
+	void addResult(int generation, const QString &title, const QStringList &snippets,
+		WebView *view, const QString &filePath);
+	void finishSource(int generation);
+	void handleItemActivated(QListWidgetItem *item);
+
+	TabWidget *m_tabWidget;
+	ArticleQueue *m_queue;
+	QLineEdit *m_searchEdit;
+	QSpinBox *m_queueDepth;
+	QListWidget *m_results;
+	QLabel *m_status;
+
+	QThreadPool m_pool;
+	QAtomicInt m_generation;
+	QString m_needle;
+	int m_pendingSources;
+	int m_matchedSources;
+	QElapsedTimer m_timer;
+	QHash<QListWidgetItem*, QPointer<WebView>> m_tabTargets;
+};
+
+#endif // FINDPANEL_H
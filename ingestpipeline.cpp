@@ -0,0 +1,280 @@
+#include "ingestpipeline.h"
+#include "articlequeue.h"
+#include "backgroundscheduler.h"
+#include "faviconstore.h"
+#include "loadpolicy.h"
+#include "mhtmlarchive.h"
+#include "timinglog.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <limits>
+
+// Enough for the root document and the first images of a saved page
+static const qint64 HeadBytes = 4 * 1024 * 1024;
+// Items in flight between two stages
+static const int StageCapacity = 4;
+static const int TextLength = 200000;
+static const int ExcerptLength = 500;
+static const int ThumbnailSize = 240;
+static const qint64 MinThumbnailSourceBytes = 8 * 1024;
+// A file still being copied fails validation, it is retried after this delay
+static const int IncompleteRetryMs = 5000;
+// Changes are written out at most this often, a crash loses no more than that
+static const int SaveDelayMs = 10000;
+
+IngestPipeline::IngestPipeline(QObject *parent)
+	: QObject(parent)
+{
+	m_catalog.load();
+	// Records of files moved or edited since are dropped once the user is idle
+	m_pruning = BackgroundScheduler::instance()->run(BackgroundScheduler::Idle, "ingest.prune",
+		[this](BackgroundJob &job) { pruneCatalog(job); });
+	m_saveTimer.setSingleShot(true);
+	m_saveTimer.setInterval(SaveDelayMs);
+	connect(&m_saveTimer, &QTimer::timeout, this, &IngestPipeline::saveCatalog);
+
+	// Paths are cheap, the first queue only bounds the archives behind it
+	m_queues.append(new BoundedQueue<Item>(std::numeric_limits<int>::max()));
+	for (int stage = 1; stage < StageCount; ++stage)
+		m_queues.append(new BoundedQueue<Item>(StageCapacity));
+	m_pool.setMaxThreadCount(StageCount);
+	for (int stage = 0; stage < StageCount; ++stage)
+		QtConcurrent::run(&m_pool, [this, stage]() { runStage(stage); });
+
+	m_rescanTimer.setSingleShot(true);
+	m_rescanTimer.setInterval(500);
+	connect(&m_rescanTimer, &QTimer::timeout, this, &IngestPipeline::handleDirectoryChanged);
+	connect(&m_watcher, &QFileSystemWatcher::directoryChanged, &m_rescanTimer, QOverload<>::of(&QTimer::start));
+}
+
+IngestPipeline::~IngestPipeline()
+{
+	m_stopping.storeRelease(1);
+	for (BoundedQueue<Item> *queue : qAsConst(m_queues)) {
+		queue->clear();
+		queue->close();
+	}
+	m_pruning.cancel();
+	m_pruning.waitForFinished();
+	m_pool.waitForDone();
+	qDeleteAll(m_queues);
+	m_saveTimer.stop();
+	m_saving.waitForFinished();
+	m_catalog.save();
+	FaviconStore::instance()->save();
+}
+
+void IngestPipeline::setSourceFolder(const QString &folder, const QStringList &files)
+{
+	if (!m_sourceFolder.isEmpty())
+		m_watcher.removePath(m_sourceFolder);
+	m_sourceFolder = folder;
+	m_known.clear();
+	if (!folder.isEmpty())
+		m_watcher.addPath(folder);
+	ingest(files);
+}
+
+void IngestPipeline::ingest(const QStringList &files)
+{
+	for (const QString &filePath : files) {
+		if (m_known.contains(filePath))
+			continue;
+		m_known.insert(filePath);
+		// Unchanged files are recognized by the Validate stage, the disk is not touched here
+		Item item;
+		item.record.filePath = filePath;
+		m_queues.first()->push(item);
+	}
+}
+
+void IngestPipeline::moveRecords(const QString &from, const QString &to)
+{
+	m_catalog.move(from, to);
+	scheduleSave();
+}
+
+void IngestPipeline::refreshRecords(const QString &path)
+{
+	// The Validate stage sees that the records no longer describe the files and redoes them
+	const QStringList files = m_catalog.filesUnder(path);
+	for (const QString &filePath : files)
+		m_known.remove(filePath);
+	ingest(files);
+}
+
+void IngestPipeline::scheduleSave()
+{
+	if (!m_saveTimer.isActive())
+		m_saveTimer.start();
+}
+
+void IngestPipeline::saveCatalog()
+{
+	// One write at a time, an older snapshot must not replace a newer one
+	if (m_saving.isRunning()) {
+		m_saveTimer.start();
+		return;
+	}
+	m_saving = BackgroundScheduler::instance()->run(BackgroundScheduler::Normal, "catalog.save",
+		[this](BackgroundJob &) { m_catalog.save(); });
+}
+
+void IngestPipeline::handleDirectoryChanged()
+{
+	// Names only, the stages do the reading
+	QStringList arrived;
+	const QStringList files = ArticleQueue::scanFolder(m_sourceFolder);
+	for (const QString &filePath : files) {
+		if (!m_known.contains(filePath))
+			arrived.append(filePath);
+	}
+	if (arrived.isEmpty())
+		return;
+	ingest(arrived);
+	emit filesArrived();
+}
+
+void IngestPipeline::runStage(int stage)
+{
+	BoundedQueue<Item> *input = m_queues.at(stage);
+	Item item;
+	auto stopping = [this]() { return m_stopping.loadAcquire() != 0; };
+	while (input->pop(item)) {
+		// The stages that read the file share the disk budget with other indexing
+		qint64 ioBytes = 0;
+		if (stage == Validate)
+			ioBytes = HeadBytes;
+		else if (stage == Hash)
+			ioBytes = item.record.size;
+		if (!BackgroundScheduler::instance()->throttle(BackgroundScheduler::Normal, ioBytes, stopping))
+			return;
+		QElapsedTimer timer;
+		timer.start();
+		// Invalid archives skip the remaining work but still reach the catalog
+		if (stage == Validate || item.record.valid)
+			process(stage, item);
+		if (item.current)
+			continue;
+		if (stage + 1 < StageCount) {
+			if (!m_queues.at(stage + 1)->push(item))
+				return;
+			continue;
+		}
+		item.archive.reset();
+		m_catalog.insert(item.record);
+		const ArticleRecord record = item.record;
+		QMetaObject::invokeMethod(this, [this, record]() { finish(record); }, Qt::QueuedConnection);
+	}
+}
+
+void IngestPipeline::process(int stage, Item &item)
+{
+	ArticleRecord &record = item.record;
+	switch (stage) {
+	case Validate: {
+		ArticleRecord known;
+		if (m_catalog.find(record.filePath, &known) && known.isCurrent()) {
+			item.current = true;
+			break;
+		}
+		QFileInfo info(record.filePath);
+		record.size = info.size();
+		record.modified = info.lastModified();
+		item.archive.reset(new MhtmlArchive);
+		if (!item.archive->load(record.filePath, HeadBytes)) {
+			record.error = item.archive->errorString();
+		} else if (item.archive->rootIndex() < 0) {
+			record.error = QStringLiteral("No root document");
+		} else {
+			record.valid = true;
+		}
+		break;
+	}
+	case Hash: {
+		QFile file(record.filePath);
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		if (file.open(QIODevice::ReadOnly) && hash.addData(&file)) {
+			record.sha1 = hash.result().toHex();
+			record.duplicateOf = m_catalog.findBySha1(record.sha1, record.filePath);
+		} else {
+			record.valid = false;
+			record.error = file.errorString();
+		}
+		break;
+	}
+	case Metadata: {
+		record.title = item.archive->subject();
+		record.origin = item.archive->snapshotLocation();
+		record.date = QString::fromUtf8(item.archive->header("date"));
+		// Kept whole, opening the article takes its load policy from here
+		const LoadPolicy::Scan scan = LoadPolicy::scan(record.filePath);
+		record.parts = scan.parts;
+		record.scripts = scan.scripts;
+		record.partsComplete = scan.complete;
+		FaviconStore::instance()->addFromArchive(record.filePath, *item.archive);
+		break;
+	}
+	case Thumbnail: {
+		// The first sizeable image that decodes, usually the article's lead picture
+		const QVector<MhtmlPart> &parts = item.archive->parts();
+		for (int i = 0; i < parts.size(); ++i) {
+			if (!parts.at(i).contentType.startsWith("image/") || parts.at(i).bodySize < MinThumbnailSourceBytes)
+				continue;
+			QImage image = QImage::fromData(item.archive->body(i));
+			if (image.isNull() || image.width() < ThumbnailSize / 2)
+				continue;
+			QString path = ArticleCatalog::cacheFolder() + "/thumbs/" + record.sha1 + ".png";
+			if (image.scaled(ThumbnailSize, ThumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation).save(path))
+				record.thumbnailPath = path;
+			break;
+		}
+		break;
+	}
+	case Text: {
+		const QString text = item.archive->plainText(TextLength);
+		record.excerpt = text.left(ExcerptLength).simplified();
+		QSaveFile file(ArticleCatalog::cacheFolder() + "/text/" + record.sha1 + ".txt");
+		if (file.open(QIODevice::WriteOnly)) {
+			file.write(text.toUtf8());
+			if (file.commit())
+				record.textPath = file.fileName();
+		}
+		break;
+	}
+	}
+}
+
+void IngestPipeline::pruneCatalog(BackgroundJob &job)
+{
+	const QList<ArticleRecord> records = m_catalog.records();
+	for (const ArticleRecord &record : records) {
+		if (!job.checkpoint())
+			return;
+		if (!record.isCurrent())
+			m_catalog.removeIfUnchanged(record);
+	}
+	QMetaObject::invokeMethod(this, [this]() { scheduleSave(); }, Qt::QueuedConnection);
+}
+
+void IngestPipeline::finish(const ArticleRecord &record)
+{
+	scheduleSave();
+	if (!record.valid) {
+		TimingLog::write("ingest.invalid", 0, record.filePath + ": " + record.error);
+		if (record.modified.msecsTo(QDateTime::currentDateTime()) < IncompleteRetryMs) {
+			const QString filePath = record.filePath;
+			QTimer::singleShot(IncompleteRetryMs, this, [this, filePath]() {
+				m_known.remove(filePath);
+				ingest(QStringList(filePath));
+			});
+		}
+	}
+	emit ingested(record.filePath, record.valid);
+}
@@ -0,0 +1,76 @@
+#ifndef INGESTPIPELINE_H
+#define INGESTPIPELINE_H
+
+#include "articlecatalog.h"
+#include "boundedqueue.h"
+#include <QAtomicInt>
+#include <QFileSystemWatcher>
+#include <QFuture>
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+class BackgroundJob;
+class MhtmlArchive;
+
+// Prepares files arriving in the source folder before they are opened:
+// validation, hashing, metadata, thumbnail and text extraction run as stages
+// on their own threads, connected by bounded queues. Results go to the catalog.
+class IngestPipeline : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit IngestPipeline(QObject *parent = nullptr);
+	~IngestPipeline();
+
+	const ArticleCatalog *catalog() const { return &m_catalog; }
+
+	// Watches the folder; files already there are ingested in the given order
+	void setSourceFolder(const QString &folder, const QStringList &files);
+	void ingest(const QStringList &files);
+	// Keeps the catalog in step with files moved or rewritten elsewhere in the browser;
+	// the path is a file or a folder
+	void moveRecords(const QString &from, const QString &to);
+	void refreshRecords(const QString &path);
+
+signals:
+	void filesArrived();
+	void ingested(const QString &filePath, bool valid);
+
+private:
+	enum Stage { Validate, Hash, Metadata, Thumbnail, Text, StageCount };
+
+	struct Item
+	{
+		ArticleRecord record;
+		QSharedPointer<MhtmlArchive> archive;
+		bool current = false;          // the catalog already describes the file as it is
+	};
+
+	void runStage(int stage);
+	void process(int stage, Item &item);
+	void finish(const ArticleRecord &record);
+	void handleDirectoryChanged();
+	void pruneCatalog(BackgroundJob &job);
+	void scheduleSave();
+	void saveCatalog();
+
+	ArticleCatalog m_catalog;
+	QFileSystemWatcher m_watcher;
+	QTimer m_rescanTimer;
+	QTimer m_saveTimer;
+	QString m_sourceFolder;
+	QSet<QString> m_known;
+	QThreadPool m_pool;
+	QVector<BoundedQueue<Item>*> m_queues;
+	QAtomicInt m_stopping;
+	QFuture<void> m_pruning;
+	QFuture<void> m_saving;
+};
+
+#endif // INGESTPIPELINE_H
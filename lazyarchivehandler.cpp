@@ -0,0 +1,173 @@
+#include "lazyarchivehandler.h"
+#include "mhtmlarchive.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QRegularExpression>
+#include <QWebEngineProfile>
+#include <QWebEngineUrlRequestJob>
+#include <QWebEngineUrlScheme>
+
+// Archives are released when their article is left, this only bounds what a
+// missed release keeps mapped
+static const int MaxOpenArchives = 2;
+
+const QByteArray LazyArchiveHandler::Scheme = QByteArrayLiteral("mhtml-part");
+
+struct LazyArchiveHandler::Archive
+{
+	QString key;
+	QFile file;
+	MhtmlArchive archive;
+	QHash<QString, int> locations;
+};
+
+void LazyArchiveHandler::registerScheme()
+{
+	QWebEngineUrlScheme scheme(Scheme);
+	scheme.setSyntax(QWebEngineUrlScheme::Syntax::Path);
+	scheme.setFlags(QWebEngineUrlScheme::SecureScheme | QWebEngineUrlScheme::LocalScheme);
+	QWebEngineUrlScheme::registerScheme(scheme);
+}
+
+LazyArchiveHandler *LazyArchiveHandler::forProfile(QWebEngineProfile *profile)
+{
+	const QWebEngineUrlSchemeHandler *installed = profile->urlSchemeHandler(Scheme);
+	if (installed)
+		return qobject_cast<LazyArchiveHandler*>(const_cast<QWebEngineUrlSchemeHandler*>(installed));
+	LazyArchiveHandler *handler = new LazyArchiveHandler(profile);
+	profile->installUrlSchemeHandler(Scheme, handler);
+	return handler;
+}
+
+LazyArchiveHandler::LazyArchiveHandler(QObject *parent)
+	: QWebEngineUrlSchemeHandler(parent)
+{
+}
+
+LazyArchiveHandler::~LazyArchiveHandler()
+{
+	qDeleteAll(m_archives);
+}
+
+static QString archiveKey(const QString &filePath)
+{
+	return QString::fromLatin1(QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Sha1).toHex().left(16));
+}
+
+QUrl LazyArchiveHandler::open(const QString &filePath)
+{
+	const QString key = archiveKey(filePath);
+	Archive *archive = nullptr;
+	for (Archive *candidate : qAsConst(m_archives)) {
+		if (candidate->key == key)
+			archive = candidate;
+	}
+
+	if (!archive) {
+		archive = new Archive;
+		archive->key = key;
+		archive->file.setFileName(filePath);
+		// Mapped, not read: the OS pages in only the parts that are requested
+		uchar *data = archive->file.open(QIODevice::ReadOnly) ? archive->file.map(0, archive->file.size()) : nullptr;
+		if (!data || !archive->archive.parse(QByteArray::fromRawData(reinterpret_cast<const char*>(data),
+				int(archive->file.size())))) {
+			delete archive;
+			return QUrl();
+		}
+		const QVector<MhtmlPart> &parts = archive->archive.parts();
+		for (int i = 0; i < parts.size(); ++i) {
+			if (!parts.at(i).contentLocation.isEmpty())
+				archive->locations.insert(QString::fromUtf8(parts.at(i).contentLocation), i);
+			if (!parts.at(i).contentId.isEmpty()) {
+				QByteArray id = parts.at(i).contentId;
+				if (id.startsWith('<') && id.endsWith('>'))
+					id = id.mid(1, id.size() - 2);
+				archive->locations.insert("cid:" + QString::fromUtf8(id), i);
+			}
+		}
+		m_archives.prepend(archive);
+		while (m_archives.size() > MaxOpenArchives)
+			delete m_archives.takeLast();
+	}
+
+	return QUrl(QString("%1:%2/%3").arg(QString::fromLatin1(Scheme), key).arg(archive->archive.rootIndex()));
+}
+
+void LazyArchiveHandler::release(const QString &filePath)
+{
+	const QString key = archiveKey(filePath);
+	for (int i = m_archives.size() - 1; i >= 0; --i) {
+		if (m_archives.at(i)->key == key)
+			delete m_archives.takeAt(i);
+	}
+}
+
+void LazyArchiveHandler::requestStarted(QWebEngineUrlRequestJob *job)
+{
+	const QStringList path = job->requestUrl().path().split('/');
+	bool ok = false;
+	const int index = path.value(1).toInt(&ok);
+	const Archive *archive = nullptr;
+	for (const Archive *candidate : qAsConst(m_archives)) {
+		if (candidate->key == path.value(0))
+			archive = candidate;
+	}
+	if (!archive || !ok || index < 0 || index >= archive->archive.parts().size()) {
+		job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+		return;
+	}
+
+	const MhtmlPart &part = archive->archive.parts().at(index);
+	QBuffer *buffer = new QBuffer(job);
+	QByteArray contentType = part.contentType;
+	if (part.contentType == "text/html" || part.contentType == "text/css") {
+		// Rewritten text is UTF-8 whatever the part was saved in; the header wins over a <meta> in the page
+		buffer->setData(rewriteLinks(archive, index));
+		contentType += "; charset=utf-8";
+	} else {
+		// Binary bodies point into the mapping, the reply may outlive it
+		const QByteArray body = archive->archive.body(index);
+		buffer->setData(QByteArray(body.constData(), body.size()));
+	}
+	job->reply(contentType, buffer);
+}
+
+QByteArray LazyArchiveHandler::rewriteLinks(const Archive *archive, int index) const
+{
+	// Links to other parts become mhtml-part: URLs, everything else stays as saved
+	static const QRegularExpression attributeLink(
+		QStringLiteral("(\\b(?:src|href|poster)\\s*=\\s*)([\"'])([^\"']*)\\2"),
+		QRegularExpression::CaseInsensitiveOption);
+	static const QRegularExpression cssLink(QStringLiteral("(url\\(\\s*)([\"']?)([^\"')]*)\\2"));
+
+	const QString text = archive->archive.text(index);
+	const QUrl base(QString::fromUtf8(archive->archive.parts().at(index).contentLocation));
+	const QString prefix = QString("%1:%2/").arg(QString::fromLatin1(Scheme), archive->key);
+	auto rewrite = [&](const QRegularExpression &expression, const QString &input) {
+		QString output;
+		output.reserve(input.size());
+		int last = 0;
+		QRegularExpressionMatchIterator it = expression.globalMatch(input);
+		while (it.hasNext()) {
+			QRegularExpressionMatch match = it.next();
+			const QString link = match.captured(3);
+			const QString location = link.startsWith(QLatin1String("cid:")) ? link
+				: base.resolved(QUrl(link)).toString();
+			const int target = archive->locations.value(location, -1);
+			if (target < 0)
+				continue;
+			output += input.midRef(last, match.capturedStart(3) - last);
+			output += prefix + QString::number(target);
+			last = match.capturedEnd(3);
+		}
+		output += input.midRef(last);
+		return output;
+	};
+
+	QString result = rewrite(cssLink, text);
+	if (archive->archive.parts().at(index).contentType == "text/html")
+		result = rewrite(attributeLink, result);
+	return result.toUtf8();
+}
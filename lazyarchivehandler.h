@@ -0,0 +1,45 @@
+#ifndef LAZYARCHIVEHANDLER_H
+#define LAZYARCHIVEHANDLER_H
+
+#include <QList>
+#include <QUrl>
+#include <QWebEngineUrlSchemeHandler>
+
+QT_BEGIN_NAMESPACE
+class QWebEngineProfile;
+QT_END_NAMESPACE
+
+// Serves the parts of a memory-mapped archive one request at a time through the
+// mhtml-part: scheme. The renderer only receives what the page actually asks
+// for, instead of Chromium parsing the whole archive at once.
+class LazyArchiveHandler : public QWebEngineUrlSchemeHandler
+{
+	Q_OBJECT
+
+public:
+	static const QByteArray Scheme;
+
+	// Must run before the QApplication is created
+	static void registerScheme();
+	// Returns the handler of the profile, installing one on first use
+	static LazyArchiveHandler *forProfile(QWebEngineProfile *profile);
+
+	explicit LazyArchiveHandler(QObject *parent = nullptr);
+	~LazyArchiveHandler();
+
+	// URL of the root part, empty if the archive cannot be mapped or parsed
+	QUrl open(const QString &filePath);
+	// Unmaps the archive so the file can be moved or rewritten; later requests for it fail
+	void release(const QString &filePath);
+
+	void requestStarted(QWebEngineUrlRequestJob *job) override;
+
+private:
+	struct Archive;
+
+	QByteArray rewriteLinks(const Archive *archive, int index) const;
+
+	QList<Archive*> m_archives;    // most recently opened first
+};
+
+#endif // LAZYARCHIVEHANDLER_H
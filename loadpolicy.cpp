@@ -0,0 +1,102 @@
+#include "loadpolicy.h"
+#include "mhtmlarchive.h"
+#include <QByteArrayMatcher>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSettings>
+
+// Headers of the archive and of the first parts
+static const qint64 HeadBytes = 64 * 1024;
+// Files up to this size get every part counted, larger ones are judged by size
+static const qint64 CountLimitBytes = 16LL * 1024 * 1024;
+static const qint64 ChunkBytes = 1024 * 1024;
+
+LoadPolicy::Limits LoadPolicy::Limits::load()
+{
+	Limits limits;
+	const qint64 mb = 1024 * 1024;
+	QSettings settings;
+	settings.beginGroup("loadPolicy");
+	limits.fullRenderBytes = settings.value("fullRenderMb", limits.fullRenderBytes / mb).toLongLong() * mb;
+	limits.fullRenderParts = settings.value("fullRenderParts", limits.fullRenderParts).toInt();
+	limits.scriptlessBytes = settings.value("scriptlessMb", limits.scriptlessBytes / mb).toLongLong() * mb;
+	limits.scriptlessParts = settings.value("scriptlessParts", limits.scriptlessParts).toInt();
+	limits.lazyBytes = settings.value("lazyMb", limits.lazyBytes / mb).toLongLong() * mb;
+	settings.endGroup();
+	return limits;
+}
+
+LoadPolicy::Scan LoadPolicy::scan(const QString &filePath)
+{
+	QElapsedTimer timer;
+	timer.start();
+	Scan result;
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return result;
+	result.size = file.size();
+
+	QByteArray head = file.read(HeadBytes);
+	MhtmlArchive::Headers headers;
+	MhtmlArchive::parseHeaders(head.constData(), head.constData() + head.size(), headers);
+	QByteArray boundary = MhtmlArchive::headerParameter(headers.value("content-type"), "boundary");
+	if (boundary.isEmpty()) {
+		result.parts = 1;
+		result.complete = true;
+		result.elapsedMs = timer.elapsed();
+		return result;
+	}
+
+	// Delimiters and script parts are counted without decoding anything; the
+	// carried tail is one byte shorter than a delimiter, so none is counted twice
+	const QByteArray delimiter = "\n--" + boundary;
+	QByteArrayMatcher delimiterMatcher(delimiter);
+	QByteArrayMatcher scriptMatcher(QByteArrayLiteral("Content-Type: text/javascript"));
+	const int overlap = delimiter.size() - 1;
+	const qint64 limit = qMin(result.size, CountLimitBytes);
+	file.seek(0);
+	QByteArray carry;
+	qint64 scanned = 0;
+	while (scanned < limit) {
+		QByteArray chunk = carry + file.read(qMin(ChunkBytes, limit - scanned));
+		if (chunk.size() == carry.size())
+			break;
+		scanned += chunk.size() - carry.size();
+		for (int pos = delimiterMatcher.indexIn(chunk); pos >= 0; pos = delimiterMatcher.indexIn(chunk, pos + 1))
+			++result.parts;
+		for (int pos = scriptMatcher.indexIn(chunk); pos >= 0; pos = scriptMatcher.indexIn(chunk, pos + 1))
+			++result.scripts;
+		carry = chunk.right(overlap);
+	}
+	// The closing delimiter is not a part
+	result.parts = qMax(0, result.parts - 1);
+	result.complete = limit == result.size;
+	result.elapsedMs = timer.elapsed();
+	return result;
+}
+
+LoadPolicy::Mode LoadPolicy::decide(const Scan &scan, const Limits &limits)
+{
+	if (scan.size <= limits.fullRenderBytes && scan.parts <= limits.fullRenderParts)
+		return FullRender;
+	if (scan.size <= limits.scriptlessBytes && scan.parts <= limits.scriptlessParts)
+		return ScriptlessRender;
+	if (scan.size <= limits.lazyBytes)
+		return LazyServing;
+	return TextPreview;
+}
+
+const char *LoadPolicy::modeName(Mode mode)
+{
+	switch (mode) {
+	case FullRender:
+		return "full";
+	case ScriptlessRender:
+		return "scriptless";
+	case LazyServing:
+		return "lazy";
+	case TextPreview:
+		return "preview";
+	}
+	return "";
+}
@@ -0,0 +1,40 @@
+#ifndef LOADPOLICY_H
+#define LOADPOLICY_H
+
+#include <QString>
+
+// Picks how an archive is opened from a quick look at its size and parts, so a
+// multi-hundred-megabyte file does not freeze or kill the render process.
+// Modes are ordered from the most to the least faithful; a failed load steps
+// down to the next one.
+namespace LoadPolicy
+{
+	enum Mode { FullRender, ScriptlessRender, LazyServing, TextPreview };
+
+	struct Scan
+	{
+		qint64 size = 0;
+		int parts = 0;
+		int scripts = 0;
+		bool complete = false;    // parts were counted over the whole file
+		qint64 elapsedMs = 0;
+	};
+
+	struct Limits
+	{
+		qint64 fullRenderBytes = 32LL * 1024 * 1024;
+		int fullRenderParts = 800;
+		qint64 scriptlessBytes = 128LL * 1024 * 1024;
+		int scriptlessParts = 3000;
+		qint64 lazyBytes = 768LL * 1024 * 1024;
+
+		// QSettings group "loadPolicy", sizes in megabytes
+		static Limits load();
+	};
+
+	Scan scan(const QString &filePath);
+	Mode decide(const Scan &scan, const Limits &limits);
+	const char *modeName(Mode mode);
+}
+
+#endif // LOADPOLICY_H
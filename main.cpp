@@ -1,29 +1,132 @@
 
+#include "backgroundscheduler.h"
 #include "browser.h"
 #include "browserwindow.h"
+#include "faviconstore.h"
+#include "lazyarchivehandler.h"
+#include "mimedecode.h"
+#include "pagecapture.h"
+#include "singleinstance.h"
 #include "tabwidget.h"
+#include "timinglog.h"
+#include "tracerecorder.h"
+#include "webview.h"
 #include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
 #include <QWebEngineProfile>
 #include <QWebEngineSettings>
+#include <cstdio>
 
-QUrl commandLineUrlArgument()
+QStringList commandLineUrlArguments()
 {
+    QStringList urls;
     const QStringList args = QCoreApplication::arguments();
     for (const QString &arg : args.mid(1)) {
+        // Relative paths must be resolved here, the running instance has another working directory
         if (!arg.startsWith(QLatin1Char('-')))
-            return QUrl::fromUserInput(arg);
+            urls.append(QUrl::fromUserInput(arg, QDir::currentPath(), QUrl::AssumeLocalFile).toString());
     }
-    return QUrl(QStringLiteral("https://www.qt.io"));
+    return urls;
+}
+
+// Opens the files passed on the command line or by another instance. They load a few
+// at a time in background tabs, the first one is brought to front.
+static void openUrls(BrowserWindow *window, const QStringList &urls)
+{
+    WebView *first = nullptr;
+    for (const QString &url : urls) {
+        WebView *view = window->tabWidget()->openInBackground(QUrl(url));
+        if (!first)
+            first = view;
+    }
+    if (first)
+        window->tabWidget()->setCurrentWidget(first);
+}
+
+// Saves the URLs listed in listFile (one per line) as MHTML archives and exits,
+// so capturing can be scripted and checked against a local HTTP server
+static int runCapture(const QString &listFile, QString folder)
+{
+    if (folder.isEmpty())
+        folder = QSettings().value("sourceFolder").toString();
+    QFile file(listFile);
+    if (folder.isEmpty() || !file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        fputs("usage: --capture <url list file> [--capture-dir <folder>]\n", stderr);
+        return 2;
+    }
+    QList<QUrl> urls;
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if (!line.isEmpty() && !line.startsWith(QLatin1Char('#')))
+            urls.append(QUrl::fromUserInput(line));
+    }
+    if (urls.isEmpty())
+        return 0;
+
+    PageCapture capture(QWebEngineProfile::defaultProfile());
+    int failed = 0;
+    QObject::connect(&capture, &PageCapture::captured, [](const QString &filePath) {
+        fprintf(stdout, "%s\n", qPrintable(QDir::toNativeSeparators(filePath)));
+    });
+    QObject::connect(&capture, &PageCapture::finished, [&failed](int, int failedCount, qint64) {
+        failed = failedCount;
+        QCoreApplication::quit();
+    });
+    capture.capture(urls, folder);
+    QCoreApplication::exec();
+    return failed == 0 ? 0 : 1;
 }
 
 int main(int argc, char **argv)
 {
+    TimingLog::startupTimer().start();
+
+    // Decoder throughput report, runs without a display
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--bench-decoders") == 0) {
+            fputs(qPrintable(MimeDecode::benchmark(64)), stdout);
+            return 0;
+        }
+    }
+
+    // Profiling mode, --trace-articles[=port] records a Chromium trace for every article
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray argument(argv[i]);
+        if (argument == "--trace-articles" || argument.startsWith("--trace-articles=")) {
+            const int port = argument.mid(17).toInt();
+            TraceRecorder::enable(port > 0 && port < 65536 ? quint16(port) : 9223);
+        }
+    }
+
     QCoreApplication::setOrganizationName("QtExamples");
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QCoreApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
 
+    LazyArchiveHandler::registerScheme();
     QApplication app(argc, argv);
     app.setWindowIcon(QIcon(QStringLiteral(":AppLogoColor.png")));
+    // Created on the GUI thread, it watches user input from here on
+    BackgroundScheduler::instance();
+
+    const QStringList arguments = app.arguments();
+    const int captureIndex = arguments.indexOf(QStringLiteral("--capture"));
+    if (captureIndex > 0) {
+        const int folderIndex = arguments.indexOf(QStringLiteral("--capture-dir"));
+        return runCapture(arguments.value(captureIndex + 1),
+                          folderIndex > 0 ? arguments.value(folderIndex + 1) : QString());
+    }
+
+    const QStringList urls = commandLineUrlArguments();
+
+    // Hand the files to an already running browser instead of starting another Chromium
+    SingleInstance instance(QStringLiteral("MhtmlBrowser"));
+    if (!app.arguments().contains(QStringLiteral("--new-instance"))) {
+        if (instance.forwardToRunningInstance(urls))
+            return 0;
+        instance.listen();
+    }
 
     QWebEngineSettings::defaultSettings()->setAttribute(QWebEngineSettings::PluginsEnabled, true);
 #if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
@@ -31,11 +134,23 @@ int main(int argc, char **argv)
     QWebEngineProfile::defaultProfile()->setUseForGlobalCertificateVerification();
 #endif
 
-    QUrl url = commandLineUrlArgument();
-
     Browser browser;
     BrowserWindow *window = browser.createWindow();
-    window->tabWidget()->setUrl(url);
+    // The first tab is already busy with the next queued article
+    openUrls(window, urls);
+
+    QObject::connect(&instance, &SingleInstance::argumentsReceived, [&browser](const QStringList &urls) {
+        BrowserWindow *window = qobject_cast<BrowserWindow*>(QApplication::activeWindow());
+        if (!window)
+            window = browser.windows().isEmpty() ? browser.createWindow() : browser.windows().last();
+        openUrls(window, urls);
+        window->show();
+        window->raise();
+        window->activateWindow();
+    });
 
-    return app.exec();
+    const int result = app.exec();
+    // Origins read outside the ingest pipeline are kept for the next start
+    FaviconStore::instance()->save();
+    return result;
 }
@@ -0,0 +1,497 @@
+#include "mhtmlarchive.h"
+#include "mimedecode.h"
+#include <QByteArrayMatcher>
+#include <QFile>
+#include <QTextCodec>
+#include <cstring>
+
+static QByteArray partHeader(const MhtmlArchive::Headers &headers, const char *name)
+{
+	return headers.value(QByteArray(name));
+}
+
+static void fillPart(MhtmlPart &part, const MhtmlArchive::Headers &headers)
+{
+	QByteArray contentType = partHeader(headers, "content-type");
+	part.contentType = MhtmlArchive::headerMainValue(contentType);
+	part.charset = MhtmlArchive::headerParameter(contentType, "charset").toLower();
+	part.transferEncoding = partHeader(headers, "content-transfer-encoding").trimmed().toLower();
+	part.contentLocation = partHeader(headers, "content-location").trimmed();
+	part.contentId = partHeader(headers, "content-id").trimmed();
+}
+
+bool MhtmlArchive::load(const QString &filePath, qint64 maxBytes)
+{
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		m_errorString = file.errorString();
+		return false;
+	}
+	return parse(maxBytes < 0 ? file.readAll() : file.read(maxBytes));
+}
+
+const char *MhtmlArchive::parseHeaders(const char *begin, const char *end, Headers &headers)
+{
+	QByteArray lastName;
+	const char *p = begin;
+	while (p < end) {
+		const char *eol = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+		const char *lineEnd = eol ? eol : end;
+		const char *next = eol ? eol + 1 : end;
+		if (lineEnd > p && lineEnd[-1] == '\r')
+			--lineEnd;
+		if (lineEnd == p)
+			return next; // blank line ends the header block
+
+		if ((*p == ' ' || *p == '\t') && !lastName.isEmpty()) {
+			// Folded continuation of the previous header
+			headers[lastName] += ' ' + QByteArray(p, int(lineEnd - p)).trimmed();
+		} else if (const char *colon = static_cast<const char*>(memchr(p, ':', size_t(lineEnd - p)))) {
+			lastName = QByteArray(p, int(colon - p)).trimmed().toLower();
+			headers[lastName] = QByteArray(colon + 1, int(lineEnd - colon - 1)).trimmed();
+		}
+		p = next;
+	}
+	return end;
+}
+
+QByteArray MhtmlArchive::headerMainValue(const QByteArray &value)
+{
+	int semicolon = value.indexOf(';');
+	return (semicolon < 0 ? value : value.left(semicolon)).trimmed().toLower();
+}
+
+QByteArray MhtmlArchive::headerParameter(const QByteArray &value, const QByteArray &name)
+{
+	const QList<QByteArray> params = value.split(';');
+	for (int i = 1; i < params.size(); ++i) {
+		QByteArray param = params.at(i).trimmed();
+		int eq = param.indexOf('=');
+		if (eq < 0 || param.left(eq).trimmed().toLower() != name)
+			continue;
+		QByteArray result = param.mid(eq + 1).trimmed();
+		if (result.size() >= 2 && result.startsWith('"') && result.endsWith('"'))
+			result = result.mid(1, result.size() - 2);
+		return result;
+	}
+	return QByteArray();
+}
+
+bool MhtmlArchive::parse(const QByteArray &data)
+{
+	m_data = data;
+	m_headers.clear();
+	m_parts.clear();
+	m_errorString.clear();
+
+	const char *begin = m_data.constData();
+	const char *end = begin + m_data.size();
+	const char *p = parseHeaders(begin, end, m_headers);
+
+	QByteArray contentType = m_headers.value("content-type");
+	if (!headerMainValue(contentType).startsWith("multipart/")) {
+		// Single part document, e.g. a plain page saved with an .mht extension
+		MhtmlPart part;
+		fillPart(part, m_headers);
+		part.bodyOffset = p - begin;
+		part.bodySize = end - p;
+		m_parts.append(part);
+		return true;
+	}
+
+	QByteArray boundary = headerParameter(contentType, "boundary");
+	if (boundary.isEmpty()) {
+		m_errorString = QStringLiteral("Missing multipart boundary");
+		return false;
+	}
+
+	// A delimiter only counts at the start of a line
+	QByteArrayMatcher matcher("--" + boundary);
+	const int delimiterSize = boundary.size() + 2;
+	auto findDelimiter = [&](int from) {
+		int pos = matcher.indexIn(m_data, from);
+		while (pos > 0 && m_data.at(pos - 1) != '\n')
+			pos = matcher.indexIn(m_data, pos + 1);
+		return pos;
+	};
+
+	int pos = findDelimiter(int(p - begin));
+	while (pos >= 0) {
+		const char *afterDelimiter = begin + pos + delimiterSize;
+		if (end - afterDelimiter >= 2 && afterDelimiter[0] == '-' && afterDelimiter[1] == '-')
+			break; // closing delimiter
+
+		const char *eol = static_cast<const char*>(memchr(afterDelimiter, '\n', size_t(end - afterDelimiter)));
+		if (!eol)
+			break;
+
+		Headers headers;
+		const char *body = parseHeaders(eol + 1, end, headers);
+		int next = findDelimiter(int(body - begin));
+		const char *bodyEnd = next >= 0 ? begin + next : end;
+		// The line break before a delimiter belongs to the delimiter
+		if (next >= 0 && bodyEnd > body && bodyEnd[-1] == '\n')
+			--bodyEnd;
+		if (next >= 0 && bodyEnd > body && bodyEnd[-1] == '\r')
+			--bodyEnd;
+
+		MhtmlPart part;
+		fillPart(part, headers);
+		part.headerOffset = eol + 1 - begin;
+		part.bodyOffset = body - begin;
+		part.bodySize = bodyEnd - body;
+		m_parts.append(part);
+		pos = next;
+	}
+
+	if (m_parts.isEmpty()) {
+		m_errorString = QStringLiteral("No parts found");
+		return false;
+	}
+	return true;
+}
+
+QString MhtmlArchive::subject() const
+{
+	return decodeHeaderWords(m_headers.value("subject"));
+}
+
+QString MhtmlArchive::snapshotLocation() const
+{
+	return QString::fromUtf8(m_headers.value("snapshot-content-location"));
+}
+
+int MhtmlArchive::rootIndex() const
+{
+	QByteArray location = m_headers.value("snapshot-content-location");
+	int firstHtml = -1;
+	for (int i = 0; i < m_parts.size(); ++i) {
+		if (m_parts.at(i).contentType != "text/html")
+			continue;
+		if (!location.isEmpty() && m_parts.at(i).contentLocation == location)
+			return i;
+		if (firstHtml < 0)
+			firstHtml = i;
+	}
+	if (firstHtml >= 0)
+		return firstHtml;
+	return m_parts.isEmpty() ? -1 : 0;
+}
+
+QByteArray MhtmlArchive::encodedBody(int index) const
+{
+	if (index < 0 || index >= m_parts.size())
+		return QByteArray();
+	const MhtmlPart &part = m_parts.at(index);
+	// No copy, the result is only valid while the archive is alive
+	return QByteArray::fromRawData(m_data.constData() + part.bodyOffset, int(part.bodySize));
+}
+
+QByteArray MhtmlArchive::body(int index) const
+{
+	if (index < 0 || index >= m_parts.size())
+		return QByteArray();
+	return MimeDecode::decode(encodedBody(index), m_parts.at(index).transferEncoding);
+}
+
+QString MhtmlArchive::text(int index) const
+{
+	if (index < 0 || index >= m_parts.size())
+		return QString();
+	const MhtmlPart &part = m_parts.at(index);
+	QByteArray bytes = body(index);
+	QTextCodec *codec = part.charset.isEmpty() ? nullptr : QTextCodec::codecForName(part.charset);
+	if (!codec) {
+		QTextCodec *utf8 = QTextCodec::codecForName("UTF-8");
+		codec = part.contentType == "text/html" ? QTextCodec::codecForHtml(bytes, utf8) : utf8;
+	}
+	return codec->toUnicode(bytes);
+}
+
+QString MhtmlArchive::rootHtml() const
+{
+	int index = rootIndex();
+	if (index < 0 || m_parts.at(index).contentType != "text/html")
+		return QString();
+	return text(index);
+}
+
+QString MhtmlArchive::plainText(int maxLength) const
+{
+	int index = rootIndex();
+	if (index < 0)
+		return QString();
+	if (m_parts.at(index).contentType == "text/html")
+		return htmlToText(text(index), maxLength);
+	if (m_parts.at(index).contentType.startsWith("text/")) {
+		QString result = text(index);
+		return maxLength < 0 ? result : result.left(maxLength);
+	}
+	return QString();
+}
+
+// The part headers with the type and encoding replaced, the others are kept as saved
+static QByteArray rewriteHeaders(const QByteArray &headers, const QByteArray &contentType, const QByteArray &eol)
+{
+	QByteArray result;
+	bool skipping = false;
+	for (QByteArray line : headers.split('\n')) {
+		if (line.endsWith('\r'))
+			line.chop(1);
+		if (line.isEmpty())
+			continue;
+		// Folded lines belong to the previous header
+		if (line.at(0) == ' ' || line.at(0) == '\t') {
+			if (!skipping)
+				result += line + eol;
+			continue;
+		}
+		const QByteArray name = line.left(line.indexOf(':')).trimmed().toLower();
+		skipping = name == "content-type" || name == "content-transfer-encoding";
+		if (!skipping)
+			result += line + eol;
+	}
+	result += "Content-Type: " + contentType + eol;
+	result += "Content-Transfer-Encoding: base64" + eol;
+	result += eol;
+	return result;
+}
+
+static QByteArray wrappedBase64(const QByteArray &data, const QByteArray &eol)
+{
+	static const int LineLength = 76;
+	const QByteArray encoded = data.toBase64();
+	QByteArray result;
+	result.reserve(encoded.size() + encoded.size() / LineLength * eol.size());
+	for (int pos = 0; pos < encoded.size(); pos += LineLength) {
+		if (pos > 0)
+			result += eol;
+		result += encoded.mid(pos, LineLength);
+	}
+	return result;
+}
+
+QByteArray MhtmlArchive::rewrite(const QMap<int, MhtmlPartEdit> &edits) const
+{
+	const QByteArray eol = m_data.contains("\r\n") ? QByteArray("\r\n") : QByteArray("\n");
+	QByteArray result;
+	result.reserve(m_data.size());
+	int copied = 0;
+	// Parts are stored in file order, so are the map keys
+	for (auto it = edits.constBegin(); it != edits.constEnd(); ++it) {
+		if (it.key() < 0 || it.key() >= m_parts.size())
+			continue;
+		const MhtmlPart &part = m_parts.at(it.key());
+		// Single part documents have no part headers of their own
+		if (part.headerOffset == 0)
+			continue;
+		int bodyEnd = int(part.bodyOffset + part.bodySize);
+		if (it->remove) {
+			// From the delimiter line of the part up to the next delimiter
+			int start = m_data.lastIndexOf('\n', int(part.headerOffset) - 2) + 1;
+			if (bodyEnd < m_data.size() && m_data.at(bodyEnd) == '\r')
+				++bodyEnd;
+			if (bodyEnd < m_data.size() && m_data.at(bodyEnd) == '\n')
+				++bodyEnd;
+			result.append(m_data.constData() + copied, start - copied);
+		} else {
+			result.append(m_data.constData() + copied, int(part.headerOffset) - copied);
+			result += rewriteHeaders(m_data.mid(int(part.headerOffset), int(part.bodyOffset - part.headerOffset)), it->contentType, eol);
+			result += wrappedBase64(it->body, eol);
+		}
+		copied = bodyEnd;
+	}
+	result.append(m_data.constData() + copied, m_data.size() - copied);
+	return result;
+}
+
+QString MhtmlArchive::decodeHeaderWords(const QByteArray &value)
+{
+	// RFC 2047 encoded words: =?charset?Q?text?= or =?charset?B?text?=
+	QString result;
+	int pos = 0;
+	bool lastWasEncoded = false;
+	while (pos < value.size()) {
+		int start = value.indexOf("=?", pos);
+		if (start < 0) {
+			result += QString::fromUtf8(value.mid(pos));
+			break;
+		}
+		int q1 = value.indexOf('?', start + 2);
+		int q2 = q1 < 0 ? -1 : value.indexOf('?', q1 + 1);
+		int stop = q2 < 0 ? -1 : value.indexOf("?=", q2 + 1);
+		if (stop < 0) {
+			result += QString::fromUtf8(value.mid(pos));
+			break;
+		}
+
+		// Whitespace between two adjacent encoded words is dropped
+		QByteArray gap = value.mid(pos, start - pos);
+		if (!(lastWasEncoded && gap.trimmed().isEmpty()))
+			result += QString::fromUtf8(gap);
+
+		QByteArray charset = value.mid(start + 2, q1 - start - 2);
+		QByteArray encoding = value.mid(q1 + 1, q2 - q1 - 1).toUpper();
+		QByteArray text = value.mid(q2 + 1, stop - q2 - 1);
+		QByteArray decoded;
+		if (encoding == "B") {
+			decoded = MimeDecode::base64(text);
+		} else {
+			text.replace('_', ' ');
+			decoded = MimeDecode::quotedPrintable(text);
+		}
+		QTextCodec *codec = QTextCodec::codecForName(charset);
+		result += codec ? codec->toUnicode(decoded) : QString::fromUtf8(decoded);
+		lastWasEncoded = true;
+		pos = stop + 2;
+	}
+	return result;
+}
+
+static bool matchesTagName(const QString &html, int pos, const char *name)
+{
+	int length = int(strlen(name));
+	if (pos + length > html.size())
+		return false;
+	for (int i = 0; i < length; ++i) {
+		if (html.at(pos + i).toLower() != QLatin1Char(name[i]))
+			return false;
+	}
+	// The name must not continue, so <style> does not match <styles>
+	return pos + length == html.size() || !html.at(pos + length).isLetterOrNumber();
+}
+
+static QString decodeEntity(const QString &html, int &pos)
+{
+	// pos points at '&'; on success it is moved past ';'
+	int semicolon = html.indexOf(QLatin1Char(';'), pos + 1);
+	if (semicolon < 0 || semicolon - pos > 10)
+		return QString();
+	QStringRef name = html.midRef(pos + 1, semicolon - pos - 1);
+	uint code = 0;
+	if (name.startsWith(QLatin1Char('#'))) {
+		bool ok = false;
+		if (name.size() > 1 && (name.at(1) == QLatin1Char('x') || name.at(1) == QLatin1Char('X')))
+			code = name.mid(2).toUInt(&ok, 16);
+		else
+			code = name.mid(1).toUInt(&ok, 10);
+		if (!ok || code == 0)
+			return QString();
+	} else {
+		static const struct { const char *name; ushort code; } entities[] = {
+			{ "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' },
+			{ "nbsp", ' ' }, { "mdash", 0x2014 }, { "ndash", 0x2013 }, { "hellip", 0x2026 },
+			{ "laquo", 0x00AB }, { "raquo", 0x00BB }, { "copy", 0x00A9 }, { "lsquo", 0x2018 },
+			{ "rsquo", 0x2019 }, { "ldquo", 0x201C }, { "rdquo", 0x201D }, { "bull", 0x2022 },
+		};
+		for (const auto &entity : entities) {
+			if (name == QLatin1String(entity.name)) {
+				code = entity.code;
+				break;
+			}
+		}
+		if (code == 0)
+			return QString();
+	}
+	pos = semicolon + 1;
+	return QString::fromUcs4(&code, 1);
+}
+
+QString MhtmlArchive::htmlToText(const QString &html, int maxLength)
+{
+	static const char *const skippedElements[] = { "script", "style", "head", "noscript", "template", "svg" };
+	static const char *const blockElements[] = {
+		"p", "div", "br", "li", "tr", "h1", "h2", "h3", "h4", "h5", "h6",
+		"section", "article", "header", "footer", "blockquote", "pre", "table", "ul", "ol",
+	};
+
+	QString out;
+	out.reserve(qMin(html.size() / 3, maxLength < 0 ? html.size() : maxLength));
+	bool pendingSpace = false;
+	bool pendingBreak = false;
+	int i = 0;
+	const int n = html.size();
+
+	auto append = [&](const QString &text) {
+		if (pendingBreak && !out.isEmpty())
+			out += QLatin1Char('\n');
+		else if (pendingSpace && !out.isEmpty())
+			out += QLatin1Char(' ');
+		pendingBreak = pendingSpace = false;
+		out += text;
+	};
+
+	while (i < n && (maxLength < 0 || out.size() < maxLength)) {
+		QChar c = html.at(i);
+		if (c == QLatin1Char('<')) {
+			if (html.midRef(i, 4) == QLatin1String("<!--")) {
+				int close = html.indexOf(QLatin1String("-->"), i + 4);
+				i = close < 0 ? n : close + 3;
+				continue;
+			}
+			int nameStart = i + 1;
+			bool closing = nameStart < n && html.at(nameStart) == QLatin1Char('/');
+			if (closing)
+				++nameStart;
+
+			bool skipped = false;
+			if (!closing) {
+				for (const char *element : skippedElements) {
+					if (matchesTagName(html, nameStart, element)) {
+						int close = html.indexOf(QLatin1String("</") + QLatin1String(element), nameStart, Qt::CaseInsensitive);
+						close = close < 0 ? n : html.indexOf(QLatin1Char('>'), close);
+						i = close < 0 ? n : close + 1;
+						skipped = true;
+						break;
+					}
+				}
+			}
+			if (skipped)
+				continue;
+
+			for (const char *element : blockElements) {
+				if (matchesTagName(html, nameStart, element)) {
+					pendingBreak = true;
+					break;
+				}
+			}
+			int close = html.indexOf(QLatin1Char('>'), i + 1);
+			i = close < 0 ? n : close + 1;
+			continue;
+		}
+
+		if (c == QLatin1Char('&')) {
+			int pos = i;
+			QString entity = decodeEntity(html, pos);
+			if (!entity.isEmpty()) {
+				if (entity.at(0).isSpace())
+					pendingSpace = true;
+				else
+					append(entity);
+				i = pos;
+				continue;
+			}
+		}
+
+		if (c.isSpace()) {
+			pendingSpace = true;
+			++i;
+			continue;
+		}
+
+		// Copy a run of ordinary characters at once
+		int runEnd = i + 1;
+		while (runEnd < n) {
+			QChar r = html.at(runEnd);
+			if (r == QLatin1Char('<') || r == QLatin1Char('&') || r.isSpace())
+				break;
+			++runEnd;
+		}
+		append(html.mid(i, runEnd - i));
+		i = runEnd;
+	}
+
+	if (maxLength >= 0 && out.size() > maxLength)
+		out.truncate(maxLength);
+	return out;
+}
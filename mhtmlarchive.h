@@ -0,0 +1,72 @@
+#ifndef MHTMLARCHIVE_H
+#define MHTMLARCHIVE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+struct MhtmlPart
+{
+	QByteArray contentType;        // lower case, parameters stripped
+	QByteArray charset;
+	QByteArray transferEncoding;
+	QByteArray contentLocation;
+	QByteArray contentId;
+	qint64 headerOffset = 0;       // start of the part headers in the archive
+	qint64 bodyOffset = 0;         // encoded body position in the archive
+	qint64 bodySize = 0;
+};
+
+// Replacement of a part when an archive is rewritten; new bodies are stored as base64
+struct MhtmlPartEdit
+{
+	bool remove = false;
+	QByteArray contentType;        // full header value, parameters included
+	QByteArray body;               // decoded
+};
+
+// Reads MHTML (multipart/related) archives without rendering them.
+// Part bodies stay encoded in the loaded data and are decoded on request.
+class MhtmlArchive
+{
+public:
+	typedef QHash<QByteArray, QByteArray> Headers;
+
+	// maxBytes limits the read to the head of the file; the root part comes first
+	// in saved pages, so a truncated read is enough for titles and previews
+	bool load(const QString &filePath, qint64 maxBytes = -1);
+	bool parse(const QByteArray &data);
+	QString errorString() const { return m_errorString; }
+	const QByteArray &data() const { return m_data; }
+
+	QString subject() const;
+	QString snapshotLocation() const;
+	QByteArray header(const QByteArray &name) const { return m_headers.value(name); }
+
+	const QVector<MhtmlPart> &parts() const { return m_parts; }
+	int rootIndex() const;
+	QByteArray encodedBody(int index) const;
+	QByteArray body(int index) const;
+	QString text(int index) const;
+
+	QString rootHtml() const;
+	QString plainText(int maxLength = -1) const;
+	// The archive with the edited parts replaced or dropped, everything else is copied as saved
+	QByteArray rewrite(const QMap<int, MhtmlPartEdit> &edits) const;
+
+	static QString htmlToText(const QString &html, int maxLength = -1);
+	static QString decodeHeaderWords(const QByteArray &value);
+	static const char *parseHeaders(const char *begin, const char *end, Headers &headers);
+	static QByteArray headerParameter(const QByteArray &value, const QByteArray &name);
+	static QByteArray headerMainValue(const QByteArray &value);
+
+private:
+	QByteArray m_data;
+	Headers m_headers;
+	QVector<MhtmlPart> m_parts;
+	QString m_errorString;
+};
+
+#endif // MHTMLARCHIVE_H
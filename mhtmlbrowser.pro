@@ -1,6 +1,6 @@
 TEMPLATE = app
 TARGET = simplebrowser
-QT += webenginewidgets
+QT += webenginewidgets concurrent network websockets
 
 HEADERS += \
     browser.h \
@@ -10,7 +10,38 @@ HEADERS += \
     tabwidget.h \
     webpage.h \
     webpopupwindow.h \
-    webview.h
+    webview.h \
+    timinglog.h \
+    articlequeue.h \
+    singleinstance.h \
+    profileconfig.h \
+    mimedecode.h \
+    mhtmlarchive.h \
+    findpanel.h \
+    readablepage.h \
+    previewpane.h \
+    categoryclassifier.h \
+    categoryindex.h \
+    categorypalette.h \
+    categoryoperations.h \
+    batchexporter.h \
+    pagecapture.h \
+    loadpolicy.h \
+    lazyarchivehandler.h \
+    boundedqueue.h \
+    articlecatalog.h \
+    ingestpipeline.h \
+    workclaims.h \
+    controlserver.h \
+    resourcemonitor.h \
+    tablist.h \
+    faviconstore.h \
+    tracerecorder.h \
+    archiveshrinker.h \
+    archiveslimmer.h \
+    partinspector.h \
+    backgroundscheduler.h \
+    readahead.h
 
 SOURCES += \
     browser.cpp \
@@ -21,7 +52,37 @@ SOURCES += \
     tabwidget.cpp \
     webpage.cpp \
     webpopupwindow.cpp \
-    webview.cpp
+    webview.cpp \
+    timinglog.cpp \
+    articlequeue.cpp \
+    singleinstance.cpp \
+    profileconfig.cpp \
+    mimedecode.cpp \
+    mhtmlarchive.cpp \
+    findpanel.cpp \
+    readablepage.cpp \
+    previewpane.cpp \
+    categoryclassifier.cpp \
+    categoryindex.cpp \
+    categorypalette.cpp \
+    categoryoperations.cpp \
+    batchexporter.cpp \
+    pagecapture.cpp \
+    loadpolicy.cpp \
+    lazyarchivehandler.cpp \
+    articlecatalog.cpp \
+    ingestpipeline.cpp \
+    workclaims.cpp \
+    controlserver.cpp \
+    resourcemonitor.cpp \
+    tablist.cpp \
+    faviconstore.cpp \
+    tracerecorder.cpp \
+    archiveshrinker.cpp \
+    archiveslimmer.cpp \
+    partinspector.cpp \
+    backgroundscheduler.cpp \
+    readahead.cpp
 
 FORMS += \
     certificateerrordialog.ui \
@@ -0,0 +1,31 @@
+#ifndef MIMEDECODE_H
+#define MIMEDECODE_H
+
+#include <QByteArray>
+#include <QString>
+
+// Content-Transfer-Encoding decoders for MHTML parts.
+// Vector kernels are picked at runtime from the CPU features, the scalar
+// kernel is the reference and the fallback for other architectures.
+namespace MimeDecode
+{
+	enum Kernel { Scalar, Sse41, Avx2 };
+
+	Kernel bestKernel();
+	bool isKernelSupported(Kernel kernel);
+	const char *kernelName(Kernel kernel);
+
+	// Skips line breaks and other characters outside the base64 alphabet
+	QByteArray base64(const QByteArray &encoded);
+	QByteArray base64(const QByteArray &encoded, Kernel kernel);
+	QByteArray quotedPrintable(const QByteArray &encoded);
+	QByteArray quotedPrintable(const QByteArray &encoded, Kernel kernel);
+
+	// Dispatches on the Content-Transfer-Encoding header value
+	QByteArray decode(const QByteArray &encoded, const QByteArray &transferEncoding);
+
+	// Throughput of every supported kernel and of QByteArray::fromBase64, run with --bench-decoders
+	QString benchmark(int megabytes);
+}
+
+#endif // MIMEDECODE_H
@@ -0,0 +1,224 @@
+#include "pagecapture.h"
+#include "timinglog.h"
+#include "webpage.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QWebEngineDownloadItem>
+#include <QWebEngineProfile>
+
+static const int LoadTimeoutMs = 60000;
+static const int MaxFileNameLength = 120;
+
+PageCapture::PageCapture(QWebEngineProfile *profile, QObject *parent)
+	: QObject(parent)
+	, m_profile(profile)
+	, m_maxConcurrent(4)
+	, m_generation(0)
+	, m_total(0)
+	, m_done(0)
+	, m_failed(0)
+{
+	connect(m_profile, &QWebEngineProfile::downloadRequested, this, &PageCapture::handleDownloadRequested);
+}
+
+PageCapture::~PageCapture()
+{
+	m_pending.clear();
+	while (!m_slots.isEmpty())
+		releaseSlot(m_slots.first());
+}
+
+void PageCapture::capture(const QList<QUrl> &urls, const QString &outputFolder)
+{
+	if (!isRunning()) {
+		m_total = m_done = m_failed = 0;
+		m_timer.start();
+	}
+	QDir().mkpath(outputFolder);
+	int queued = 0;
+	for (const QUrl &url : urls) {
+		if (url.isValid()) {
+			m_pending.append({ url, outputFolder });
+			++queued;
+		}
+	}
+	m_total += queued;
+	if (!isRunning() && m_pending.isEmpty()) {
+		// Nothing to wait for; queued, so a caller about to enter the event loop sees it
+		QMetaObject::invokeMethod(this, [this]() {
+			emit finished(m_done, m_failed, m_timer.elapsed());
+		}, Qt::QueuedConnection);
+		return;
+	}
+	fillSlots();
+}
+
+void PageCapture::fillSlots()
+{
+	while (m_slots.size() < m_maxConcurrent && m_slots.size() < m_pending.size()) {
+		Slot *slot = new Slot;
+		slot->page = new WebPage(m_profile, this);
+		slot->timeout = new QTimer(this);
+		slot->timeout->setSingleShot(true);
+		slot->timeout->setInterval(LoadTimeoutMs);
+		connect(slot->timeout, &QTimer::timeout, this, [this, slot]() { complete(slot, false); });
+		connect(slot->page, &QWebEnginePage::loadStarted, this, [slot]() { slot->loading = true; });
+		// A navigation abandoned after a timeout reports its end before the next one starts
+		connect(slot->page, &QWebEnginePage::loadFinished, this, [this, slot](bool ok) {
+			if (slot->loading)
+				handleLoadFinished(slot, ok);
+		});
+		m_slots.append(slot);
+		loadNext(slot);
+	}
+}
+
+void PageCapture::loadNext(Slot *slot)
+{
+	if (m_pending.isEmpty()) {
+		releaseSlot(slot);
+		if (m_slots.isEmpty()) {
+			TimingLog::write("capture.finished", m_timer.elapsed(),
+				QString("%1 pages, %2 failed").arg(m_done).arg(m_failed));
+			emit finished(m_done, m_failed, m_timer.elapsed());
+		}
+		return;
+	}
+	Request request = m_pending.takeFirst();
+	slot->url = request.url;
+	slot->folder = request.outputFolder;
+	slot->target.clear();
+	slot->saving = false;
+	slot->generation = ++m_generation;
+	slot->loading = false;
+	slot->timeout->start();
+	slot->page->setUrl(request.url);
+}
+
+void PageCapture::handleLoadFinished(Slot *slot, bool ok)
+{
+	if (slot->url.isEmpty() || slot->saving)
+		return;
+	slot->loading = false;
+	if (!ok) {
+		complete(slot, false);
+		return;
+	}
+	// The file is named after the title, known only now
+	slot->target = uniqueTarget(slot->folder, fileNameForPage(slot->page->title(), slot->url));
+	slot->saving = true;
+	slot->page->save(slot->target + ".part", QWebEngineDownloadItem::MimeHtmlSaveFormat);
+}
+
+void PageCapture::handleDownloadRequested(QWebEngineDownloadItem *download)
+{
+	if (!download->isSavePageDownload())
+		return;
+	for (Slot *slot : qAsConst(m_slots)) {
+		if (download->page() != slot->page)
+			continue;
+		if (!slot->saving || slot->download)
+			return;
+		download->accept();
+		slot->download = download;
+		const int generation = slot->generation;
+		connect(download, &QWebEngineDownloadItem::finished, this, [this, slot, download, generation]() {
+			if (isCurrent(slot, generation))
+				complete(slot, download->state() == QWebEngineDownloadItem::DownloadCompleted);
+		});
+		return;
+	}
+}
+
+void PageCapture::complete(Slot *slot, bool ok)
+{
+	if (slot->url.isEmpty())
+		return;
+	slot->timeout->stop();
+	dropDownload(slot);
+	const QString part = slot->target + ".part";
+	const QString target = slot->target;
+	const QUrl url = slot->url;
+	slot->url.clear();
+
+	// The queue only picks up *.mhtml, the rename makes the archive visible at once
+	ok = ok && !target.isEmpty() && QFile::rename(part, target);
+	if (ok) {
+		++m_done;
+		emit captured(target);
+	} else {
+		if (!target.isEmpty())
+			QFile::remove(part);
+		++m_failed;
+		TimingLog::write("capture.failed", 0, url.toString());
+	}
+	emit progress(m_done, m_failed, m_total);
+	loadNext(slot);
+}
+
+void PageCapture::releaseSlot(Slot *slot)
+{
+	m_slots.removeOne(slot);
+	slot->url.clear();
+	// Nothing may reach the slot once it is deleted
+	dropDownload(slot);
+	disconnect(slot->page, nullptr, this, nullptr);
+	disconnect(slot->timeout, nullptr, this, nullptr);
+	slot->timeout->stop();
+	slot->timeout->deleteLater();
+	slot->page->deleteLater();
+	delete slot;
+}
+
+void PageCapture::dropDownload(Slot *slot)
+{
+	if (!slot->download)
+		return;
+	disconnect(slot->download, nullptr, this, nullptr);
+	// A save still running after a timeout would write into the next file's name
+	if (slot->download->state() == QWebEngineDownloadItem::DownloadInProgress)
+		slot->download->cancel();
+	slot->download = nullptr;
+}
+
+bool PageCapture::isCurrent(const Slot *slot, int generation) const
+{
+	// Generations are unique over all slots, a new slot at the same address does not match
+	return m_slots.contains(const_cast<Slot*>(slot)) && slot->generation == generation;
+}
+
+QString PageCapture::fileNameForPage(const QString &title, const QUrl &url)
+{
+	QString name = title.simplified();
+	if (name.isEmpty())
+		name = url.host() + url.path();
+	static const QString invalid = QStringLiteral("\\/:*?\"<>|");
+	for (QChar &c : name) {
+		if (invalid.contains(c) || c.unicode() < 32)
+			c = '_';
+	}
+	name = name.left(MaxFileNameLength).trimmed();
+	if (name.isEmpty())
+		name = QStringLiteral("page");
+	return name + ".mhtml";
+}
+
+QString PageCapture::uniqueTarget(const QString &folder, const QString &fileName) const
+{
+	QFileInfo info(folder + '/' + fileName);
+	QString target = info.filePath();
+	auto taken = [this](const QString &path) {
+		if (QFileInfo::exists(path) || QFileInfo::exists(path + ".part"))
+			return true;
+		for (Slot *slot : m_slots) {
+			if (slot->target == path)
+				return true;
+		}
+		return false;
+	};
+	for (int n = 2; taken(target); ++n)
+		target = QString("%1/%2 (%3).mhtml").arg(info.absolutePath(), info.completeBaseName()).arg(n);
+	return target;
+}
@@ -0,0 +1,83 @@
+#ifndef PAGECAPTURE_H
+#define PAGECAPTURE_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QUrl>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+class QWebEngineDownloadItem;
+class QWebEngineProfile;
+QT_END_NAMESPACE
+
+class WebPage;
+
+// Saves web pages as MHTML archives into a folder, usually the source inbox.
+// A bounded pool of background pages loads the URLs; each page is saved with
+// QWebEnginePage::save() once loaded and the file appears under its final name
+// only when the save download completed.
+class PageCapture : public QObject
+{
+	Q_OBJECT
+
+public:
+	PageCapture(QWebEngineProfile *profile, QObject *parent = nullptr);
+	~PageCapture();
+
+	void setMaxConcurrent(int count) { m_maxConcurrent = qMax(1, count); }
+	bool isRunning() const { return !m_slots.isEmpty(); }
+
+	// Queues the URLs, capturing starts right away
+	void capture(const QList<QUrl> &urls, const QString &outputFolder);
+
+	static QString fileNameForPage(const QString &title, const QUrl &url);
+
+signals:
+	void captured(const QString &filePath);
+	void progress(int done, int failed, int total);
+	void finished(int captured, int failed, qint64 ms);
+
+private:
+	struct Slot
+	{
+		WebPage *page = nullptr;
+		QTimer *timeout = nullptr;
+		QUrl url;
+		QString folder;
+		QString target;
+		bool saving = false;
+		int generation = 0;            // new for every URL, callbacks for an earlier one are dropped
+		bool loading = false;          // the load of the current URL has started
+		QPointer<QWebEngineDownloadItem> download;
+	};
+	struct Request
+	{
+		QUrl url;
+		QString outputFolder;
+	};
+
+	void fillSlots();
+	void loadNext(Slot *slot);
+	void handleLoadFinished(Slot *slot, bool ok);
+	void handleDownloadRequested(QWebEngineDownloadItem *download);
+	void complete(Slot *slot, bool ok);
+	void releaseSlot(Slot *slot);
+	void dropDownload(Slot *slot);
+	bool isCurrent(const Slot *slot, int generation) const;
+	QString uniqueTarget(const QString &folder, const QString &fileName) const;
+
+	QWebEngineProfile *m_profile;
+	int m_maxConcurrent;
+	QList<Request> m_pending;
+	QList<Slot*> m_slots;
+	int m_generation;
+	int m_total;
+	int m_done;
+	int m_failed;
+	QElapsedTimer m_timer;
+};
+
+#endif // PAGECAPTURE_H
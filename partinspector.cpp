@@ -0,0 +1,121 @@
+#include "partinspector.h"
+#include "backgroundscheduler.h"
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+enum Column { TypeColumn, SizeColumn, ReferencedColumn, ActionColumn, LocationColumn };
+
+static QString kilobytes(qint64 bytes)
+{
+	return QObject::tr("%1 KB").arg((bytes + 1023) / 1024);
+}
+
+PartInspector::PartInspector(QWidget *parent)
+	: QWidget(parent)
+	, m_slimming(false)
+{
+	m_tree = new QTreeWidget;
+	m_tree->setRootIsDecorated(false);
+	m_tree->setHeaderLabels(QStringList() << tr("Type") << tr("Size") << tr("Referenced") << tr("Slimming") << tr("Location"));
+	m_tree->header()->setSectionResizeMode(LocationColumn, QHeaderView::Stretch);
+	m_summary = new QLabel;
+	m_summary->setWordWrap(true);
+	m_slimButton = new QPushButton(tr("Slim Archive"));
+	m_slimButton->setEnabled(false);
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->setContentsMargins(4, 4, 4, 4);
+	layout->addWidget(m_tree, 1);
+	layout->addWidget(m_summary);
+	layout->addWidget(m_slimButton);
+
+	connect(m_slimButton, &QPushButton::clicked, this, &PartInspector::slim);
+	connect(&m_watcher, &QFutureWatcher<ArchiveSlimmer::Report>::finished, this, &PartInspector::handleReport);
+}
+
+void PartInspector::showFile(const QString &filePath)
+{
+	if (filePath.isEmpty()) {
+		clear();
+		return;
+	}
+	m_filePath = filePath;
+	m_slimming = false;
+	m_slimButton->setEnabled(false);
+	m_summary->setText(tr("Reading %1...").arg(QFileInfo(filePath).fileName()));
+	// The inspection is a dry run; a stale one finishes in the background and is ignored
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "parts.inspect",
+		[filePath](BackgroundJob &) { return ArchiveSlimmer::slimFile(filePath, false); }));
+}
+
+void PartInspector::clear()
+{
+	m_filePath.clear();
+	m_slimming = false;
+	m_tree->clear();
+	m_summary->clear();
+	m_slimButton->setEnabled(false);
+}
+
+void PartInspector::slim()
+{
+	if (m_filePath.isEmpty() || m_watcher.isRunning())
+		return;
+	m_slimButton->setEnabled(false);
+	const QString filePath = m_filePath;
+	m_slimming = true;
+	emit aboutToSlim(filePath);
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "parts.slim",
+		[filePath](BackgroundJob &) { return ArchiveSlimmer::slimFile(filePath, true); }));
+}
+
+void PartInspector::handleReport()
+{
+	const ArchiveSlimmer::Report report = m_watcher.result();
+	if (report.filePath != m_filePath)
+		return;
+	if (m_slimming) {
+		m_slimming = false;
+		emit slimmed(report.filePath);
+	}
+	if (report.applied) {
+		// Shows what is left
+		showFile(report.filePath);
+		return;
+	}
+
+	m_tree->clear();
+	for (const ArchiveSlimmer::Part &part : report.parts) {
+		QTreeWidgetItem *item = new QTreeWidgetItem(m_tree);
+		item->setText(TypeColumn, QString::fromLatin1(part.contentType));
+		item->setText(SizeColumn, kilobytes(part.size));
+		item->setTextAlignment(SizeColumn, Qt::AlignRight | Qt::AlignVCenter);
+		item->setText(ReferencedColumn, part.referenced ? tr("yes") : tr("no"));
+		item->setText(ActionColumn, ArchiveSlimmer::describe(part.action));
+		item->setText(LocationColumn, QString::fromUtf8(part.location));
+		item->setToolTip(LocationColumn, QString::fromUtf8(part.location));
+		if (part.action != ArchiveSlimmer::Keep && part.action != ArchiveSlimmer::StripScripts) {
+			for (int column = TypeColumn; column <= LocationColumn; ++column)
+				item->setForeground(column, Qt::gray);
+		}
+	}
+
+	if (!report.error.isEmpty()) {
+		m_summary->setText(tr("Cannot slim: %1").arg(report.error));
+		return;
+	}
+	const qint64 saved = report.bytesBefore - report.bytesAfter;
+	if (saved <= 0) {
+		m_summary->setText(tr("%1 parts, %2; nothing to slim").arg(report.parts.size()).arg(kilobytes(report.bytesBefore)));
+		return;
+	}
+	m_summary->setText(tr("%1 parts, %2. Slimming saves %3 (%4%): scripts %5, trackers %6, unused parts %7.")
+		.arg(report.parts.size()).arg(kilobytes(report.bytesBefore)).arg(kilobytes(saved))
+		.arg(saved * 100 / qMax<qint64>(1, report.bytesBefore))
+		.arg(kilobytes(report.scriptBytes)).arg(kilobytes(report.trackerBytes)).arg(kilobytes(report.orphanBytes)));
+	m_slimButton->setEnabled(true);
+}
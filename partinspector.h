@@ -0,0 +1,44 @@
+#ifndef PARTINSPECTOR_H
+#define PARTINSPECTOR_H
+
+#include "archiveslimmer.h"
+#include <QFutureWatcher>
+#include <QWidget>
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QPushButton;
+class QTreeWidget;
+QT_END_NAMESPACE
+
+// Lists the parts of the current archive with type, size and whether the page
+// refers to them, together with what slimming would remove and save.
+class PartInspector : public QWidget
+{
+	Q_OBJECT
+
+public:
+	explicit PartInspector(QWidget *parent = nullptr);
+
+	void showFile(const QString &filePath);
+	void clear();
+
+signals:
+	// The file is about to be replaced, nothing may keep it mapped
+	void aboutToSlim(const QString &filePath);
+	// Slimming ended, applied or not; open views of the file are stale
+	void slimmed(const QString &filePath);
+
+private:
+	void slim();
+	void handleReport();
+
+	QTreeWidget *m_tree;
+	QLabel *m_summary;
+	QPushButton *m_slimButton;
+	QString m_filePath;
+	bool m_slimming;
+	QFutureWatcher<ArchiveSlimmer::Report> m_watcher;
+};
+
+#endif // PARTINSPECTOR_H
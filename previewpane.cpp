@@ -0,0 +1,129 @@
+#include "previewpane.h"
+#include "articlecatalog.h"
+#include "backgroundscheduler.h"
+#include "mhtmlarchive.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLabel>
+#include <QPixmap>
+#include <QPushButton>
+#include <QTextBrowser>
+#include <QUrl>
+#include <QVBoxLayout>
+
+// The root part of a saved page almost always fits into the first megabyte
+static const qint64 PreviewReadBytes = 1024 * 1024;
+static const int PreviewTextLength = 3000;
+
+PreviewPane::PreviewPane(QWidget *parent)
+	: QWidget(parent)
+	, m_catalog(nullptr)
+{
+	m_thumbnailLabel = new QLabel;
+	m_thumbnailLabel->hide();
+
+	m_titleLabel = new QLabel;
+	m_titleLabel->setWordWrap(true);
+	m_titleLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+	QFont titleFont = m_titleLabel->font();
+	titleFont.setBold(true);
+	titleFont.setPointSizeF(titleFont.pointSizeF() * 1.3);
+	m_titleLabel->setFont(titleFont);
+
+	m_originLabel = new QLabel;
+	m_originLabel->setTextInteractionFlags(Qt::TextBrowserInteraction);
+	m_originLabel->setOpenExternalLinks(true);
+
+	m_textView = new QTextBrowser;
+	m_textView->setOpenLinks(false);
+
+	m_fullPageButton = new QPushButton(tr("Load Full Page"));
+	m_fullPageButton->setEnabled(false);
+	m_statusLabel = new QLabel;
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->addWidget(m_thumbnailLabel);
+	layout->addWidget(m_titleLabel);
+	layout->addWidget(m_originLabel);
+	layout->addWidget(m_textView, 1);
+	layout->addWidget(m_fullPageButton);
+	layout->addWidget(m_statusLabel);
+
+	connect(m_fullPageButton, &QPushButton::clicked, this, [this]() {
+		if (!m_filePath.isEmpty())
+			emit fullPageRequested(m_filePath);
+	});
+	connect(&m_watcher, &QFutureWatcher<ArticlePreview>::finished, this, &PreviewPane::handleExtracted);
+}
+
+void PreviewPane::showFile(const QString &filePath)
+{
+	m_filePath = filePath;
+	m_fullPageButton->setEnabled(!filePath.isEmpty());
+	if (filePath.isEmpty()) {
+		clear();
+		return;
+	}
+	// A running extraction finishes in the background, its result is ignored
+	const ArticleCatalog *catalog = m_catalog;
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Interactive, "preview",
+		[filePath, catalog](BackgroundJob &) { return extract(filePath, catalog); }));
+}
+
+void PreviewPane::clear()
+{
+	m_filePath.clear();
+	m_thumbnailLabel->hide();
+	m_titleLabel->clear();
+	m_originLabel->clear();
+	m_textView->clear();
+	m_statusLabel->clear();
+	m_fullPageButton->setEnabled(false);
+}
+
+ArticlePreview PreviewPane::extract(const QString &filePath, const ArticleCatalog *catalog)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	ArticlePreview preview;
+	preview.filePath = filePath;
+	ArticleRecord record;
+	MhtmlArchive archive;
+	if (catalog && catalog->find(filePath, &record) && record.valid && record.isCurrent()) {
+		preview.title = record.title;
+		preview.origin = record.origin;
+		preview.thumbnailPath = record.thumbnailPath;
+		QFile text(record.textPath);
+		if (text.open(QIODevice::ReadOnly))
+			preview.text = QString::fromUtf8(text.read(PreviewTextLength * 4)).left(PreviewTextLength);
+	} else if (archive.load(filePath, PreviewReadBytes)) {
+		preview.title = archive.subject();
+		preview.origin = archive.snapshotLocation();
+		preview.text = archive.plainText(PreviewTextLength);
+	}
+	if (preview.title.isEmpty())
+		preview.title = QFileInfo(filePath).completeBaseName();
+	preview.elapsedMs = timer.elapsed();
+	return preview;
+}
+
+void PreviewPane::handleExtracted()
+{
+	ArticlePreview preview = m_watcher.result();
+	if (preview.filePath != m_filePath)
+		return;
+
+	QPixmap thumbnail(preview.thumbnailPath);
+	m_thumbnailLabel->setPixmap(thumbnail);
+	m_thumbnailLabel->setVisible(!thumbnail.isNull());
+	m_titleLabel->setText(preview.title);
+	if (preview.origin.isEmpty())
+		m_originLabel->clear();
+	else
+		m_originLabel->setText(QString("<a href=\"%1\">%2</a>").arg(preview.origin.toHtmlEscaped(),
+			QUrl(preview.origin).host().toHtmlEscaped()));
+	m_textView->setPlainText(preview.text);
+	m_statusLabel->setText(tr("Preview extracted in %1 ms").arg(preview.elapsedMs));
+}
@@ -0,0 +1,58 @@
+#ifndef PREVIEWPANE_H
+#define PREVIEWPANE_H
+
+#include <QFutureWatcher>
+#include <QWidget>
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QPushButton;
+class QTextBrowser;
+QT_END_NAMESPACE
+
+class ArticleCatalog;
+
+struct ArticlePreview
+{
+	QString filePath;
+	QString title;
+	QString origin;
+	QString text;
+	QString thumbnailPath;
+	qint64 elapsedMs = 0;
+};
+
+// Shows title, origin and leading text of an archive, read natively from the
+// head of the file, so an article can be judged before Chromium renders it.
+class PreviewPane : public QWidget
+{
+	Q_OBJECT
+
+public:
+	explicit PreviewPane(QWidget *parent = nullptr);
+
+	void showFile(const QString &filePath);
+	void clear();
+	// Precomputed records are used instead of reading the archive
+	void setCatalog(const ArticleCatalog *catalog) { m_catalog = catalog; }
+
+	static ArticlePreview extract(const QString &filePath, const ArticleCatalog *catalog = nullptr);
+
+signals:
+	void fullPageRequested(const QString &filePath);
+
+private:
+	void handleExtracted();
+
+	const ArticleCatalog *m_catalog;
+	QLabel *m_thumbnailLabel;
+	QLabel *m_titleLabel;
+	QLabel *m_originLabel;
+	QTextBrowser *m_textView;
+	QPushButton *m_fullPageButton;
+	QLabel *m_statusLabel;
+	QString m_filePath;
+	QFutureWatcher<ArticlePreview> m_watcher;
+};
+
+#endif // PREVIEWPANE_H
@@ -0,0 +1,52 @@
+#include "profileconfig.h"
+#include <QDir>
+#include <QSettings>
+#include <QStandardPaths>
+#include <climits>
+
+ProfileConfig ProfileConfig::load()
+{
+	ProfileConfig config;
+	QSettings settings;
+	settings.beginGroup("profile");
+	config.cacheType = settings.value("cacheType", "disk").toString() == "memory"
+		? QWebEngineProfile::MemoryHttpCache
+		: QWebEngineProfile::DiskHttpCache;
+	config.cacheSizeMb = settings.value("cacheSizeMb", config.cacheSizeMb).toInt();
+	config.cachePath = settings.value("cachePath",
+		QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/webengine").toString();
+	// Moving the storage would orphan the cookies and site data already there
+	config.storagePath = settings.value("storagePath").toString();
+	settings.endGroup();
+	return config;
+}
+
+void ProfileConfig::save() const
+{
+	QSettings settings;
+	settings.beginGroup("profile");
+	settings.setValue("cacheType", cacheType == QWebEngineProfile::MemoryHttpCache ? "memory" : "disk");
+	settings.setValue("cacheSizeMb", cacheSizeMb);
+	settings.setValue("cachePath", cachePath);
+	settings.setValue("storagePath", storagePath);
+	settings.endGroup();
+}
+
+void ProfileConfig::apply(QWebEngineProfile *profile) const
+{
+	profile->setHttpCacheMaximumSize(int(qMin<qint64>(qint64(cacheSizeMb) * 1024 * 1024, INT_MAX)));
+
+	// Off-the-record profiles must not touch the disk, Chromium keeps their cache in memory anyway
+	if (profile->isOffTheRecord())
+		return;
+
+	if (!cachePath.isEmpty()) {
+		QDir().mkpath(cachePath);
+		profile->setCachePath(cachePath);
+	}
+	if (!storagePath.isEmpty()) {
+		QDir().mkpath(storagePath);
+		profile->setPersistentStoragePath(storagePath);
+	}
+	profile->setHttpCacheType(cacheType);
+}
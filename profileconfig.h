@@ -0,0 +1,24 @@
+#ifndef PROFILECONFIG_H
+#define PROFILECONFIG_H
+
+#include <QString>
+#include <QWebEngineProfile>
+
+// Cache and storage settings for the web engine profiles, kept in the
+// "profile" group of QSettings. A persistent disk cache lets Chromium reuse
+// fetched resources and compiled script caches between similar archives.
+struct ProfileConfig
+{
+	QWebEngineProfile::HttpCacheType cacheType = QWebEngineProfile::DiskHttpCache;
+	int cacheSizeMb = 512;     // 0 lets Chromium pick the size
+	QString cachePath;         // empty means the platform cache location
+	QString storagePath;       // persistent storage, code caches live here; empty keeps the profile's own
+
+	static ProfileConfig load();
+	void save() const;
+
+	// Must run before the profile creates its first page
+	void apply(QWebEngineProfile *profile) const;
+};
+
+#endif // PROFILECONFIG_H
@@ -0,0 +1,211 @@
+#include "readablepage.h"
+#include "mhtmlarchive.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
+
+// Elements dropped together with their content
+static const char *const droppedElements[] = {
+	"script", "style", "noscript", "template", "iframe", "frame", "object", "embed",
+	"video", "audio", "canvas", "svg", "form", "button", "select", "nav", "aside", "head",
+};
+
+// Elements kept without attributes (except href and src)
+static const char *const keptElements[] = {
+	"p", "br", "h1", "h2", "h3", "h4", "h5", "h6", "ul", "ol", "li", "blockquote",
+	"pre", "code", "em", "strong", "b", "i", "a", "img", "figure", "figcaption",
+	"table", "thead", "tbody", "tr", "td", "th", "hr", "dl", "dt", "dd",
+	"div", "section", "article", "main",
+};
+
+// Rendered pages are read once during triage, only the latest few are kept
+static const int MaxCachedPages = 20;
+
+static QString tagName(const QString &html, int start, int end)
+{
+	int i = start;
+	while (i < end && (html.at(i).isLetterOrNumber()))
+		++i;
+	return html.mid(start, i - start).toLower();
+}
+
+static QString attributeValue(const QString &tag, const QString &name)
+{
+	int pos = 0;
+	while ((pos = tag.indexOf(name, pos, Qt::CaseInsensitive)) >= 0) {
+		bool startsWord = pos > 0 && tag.at(pos - 1).isSpace();
+		int i = pos + name.size();
+		pos = i;
+		if (!startsWord)
+			continue;
+		while (i < tag.size() && tag.at(i).isSpace())
+			++i;
+		if (i >= tag.size() || tag.at(i) != QLatin1Char('='))
+			continue;
+		++i;
+		while (i < tag.size() && tag.at(i).isSpace())
+			++i;
+		if (i >= tag.size())
+			return QString();
+		QChar quote = tag.at(i);
+		if (quote == QLatin1Char('"') || quote == QLatin1Char('\'')) {
+			int close = tag.indexOf(quote, i + 1);
+			return tag.mid(i + 1, close < 0 ? -1 : close - i - 1);
+		}
+		int close = i;
+		while (close < tag.size() && !tag.at(close).isSpace() && tag.at(close) != QLatin1Char('>'))
+			++close;
+		return tag.mid(i, close - i);
+	}
+	return QString();
+}
+
+static QString escaped(const QString &text)
+{
+	return text.toHtmlEscaped();
+}
+
+QString ReadablePage::render(const MhtmlArchive &archive, qint64 imageBudget)
+{
+	const QString html = archive.rootHtml();
+	const QUrl base(archive.snapshotLocation());
+
+	QHash<QString, int> partsByLocation;
+	const QVector<MhtmlPart> &parts = archive.parts();
+	for (int i = 0; i < parts.size(); ++i) {
+		if (!parts.at(i).contentLocation.isEmpty())
+			partsByLocation.insert(QString::fromUtf8(parts.at(i).contentLocation), i);
+		if (!parts.at(i).contentId.isEmpty()) {
+			QByteArray id = parts.at(i).contentId;
+			if (id.startsWith('<') && id.endsWith('>'))
+				id = id.mid(1, id.size() - 2);
+			partsByLocation.insert("cid:" + QString::fromUtf8(id), i);
+		}
+	}
+
+	QString title = archive.subject();
+	QString out;
+	out.reserve(html.size() / 2);
+	out += "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>" + escaped(title) + "</title>"
+		"<style>body{max-width:46em;margin:2em auto;padding:0 1em;font:18px/1.55 Georgia,serif;color:#222}"
+		"img{max-width:100%;height:auto}pre{white-space:pre-wrap}.origin{font:13px sans-serif;color:#777}</style>"
+		"</head><body>";
+	if (base.isValid())
+		out += "<p class=\"origin\"><a href=\"" + escaped(base.toString()) + "\">" + escaped(base.host()) + "</a></p>";
+	if (!title.isEmpty())
+		out += "<h1>" + escaped(title) + "</h1>";
+
+	qint64 imageBytes = 0;
+	int i = 0;
+	const int n = html.size();
+	while (i < n) {
+		int lt = html.indexOf(QLatin1Char('<'), i);
+		if (lt < 0)
+			lt = n;
+		// Text between tags is already HTML, entities included
+		out += html.midRef(i, lt - i);
+		if (lt >= n)
+			break;
+
+		if (html.midRef(lt, 4) == QLatin1String("<!--")) {
+			int close = html.indexOf(QLatin1String("-->"), lt + 4);
+			i = close < 0 ? n : close + 3;
+			continue;
+		}
+		int gt = html.indexOf(QLatin1Char('>'), lt + 1);
+		if (gt < 0)
+			break;
+
+		bool closing = lt + 1 < n && html.at(lt + 1) == QLatin1Char('/');
+		QString name = tagName(html, lt + (closing ? 2 : 1), gt);
+		i = gt + 1;
+
+		bool dropped = false;
+		for (const char *element : droppedElements) {
+			if (name == QLatin1String(element)) {
+				dropped = true;
+				break;
+			}
+		}
+		if (dropped) {
+			if (!closing && html.at(gt - 1) != QLatin1Char('/')) {
+				int close = html.indexOf("</" + name, i, Qt::CaseInsensitive);
+				close = close < 0 ? -1 : html.indexOf(QLatin1Char('>'), close);
+				i = close < 0 ? n : close + 1;
+			}
+			continue;
+		}
+
+		bool kept = false;
+		for (const char *element : keptElements) {
+			if (name == QLatin1String(element)) {
+				kept = true;
+				break;
+			}
+		}
+		if (!kept)
+			continue;
+		if (closing) {
+			out += "</" + name + ">";
+			continue;
+		}
+
+		const QString tag = html.mid(lt, gt - lt);
+		if (name == QLatin1String("a")) {
+			QString href = attributeValue(tag, "href");
+			out += href.isEmpty() ? QString("<a>") : "<a href=\"" + escaped(base.resolved(QUrl(href)).toString()) + "\">";
+		} else if (name == QLatin1String("img")) {
+			QString src = attributeValue(tag, "src");
+			QString location = src.startsWith("cid:") ? src : base.resolved(QUrl(src)).toString();
+			int index = partsByLocation.value(location, -1);
+			QString alt = attributeValue(tag, "alt");
+			if (index >= 0 && parts.at(index).contentType.startsWith("image/")) {
+				QByteArray data = archive.body(index);
+				if (imageBytes + data.size() <= imageBudget) {
+					imageBytes += data.size();
+					out += "<img src=\"data:" + QString::fromLatin1(parts.at(index).contentType)
+						+ ";base64," + QString::fromLatin1(data.toBase64()) + "\" alt=\"" + escaped(alt) + "\">";
+					continue;
+				}
+			}
+			if (!alt.isEmpty())
+				out += "<em>[" + escaped(alt) + "]</em>";
+		} else {
+			out += "<" + name + ">";
+		}
+	}
+
+	out += "</body></html>";
+	return out;
+}
+
+QString ReadablePage::renderToFile(const QString &filePath, qint64 imageBudget)
+{
+	MhtmlArchive archive;
+	if (!archive.load(filePath) || archive.rootHtml().isEmpty())
+		return QString();
+
+	QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/readable";
+	QDir().mkpath(dir);
+	QByteArray key = QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Sha1).toHex();
+	QString outPath = dir + "/" + QString::fromLatin1(key.left(16)) + ".html";
+
+	QSaveFile file(outPath);
+	if (!file.open(QIODevice::WriteOnly))
+		return QString();
+	file.write(render(archive, imageBudget).toUtf8());
+	if (!file.commit())
+		return QString();
+
+	// Newest first, the page just written is always kept
+	const QFileInfoList pages = QDir(dir).entryInfoList(QStringList("*.html"), QDir::Files, QDir::Time);
+	for (int i = MaxCachedPages; i < pages.size(); ++i) {
+		if (pages.at(i).absoluteFilePath() != QFileInfo(outPath).absoluteFilePath())
+			QFile::remove(pages.at(i).absoluteFilePath());
+	}
+	return outPath;
+}
@@ -0,0 +1,18 @@
+#ifndef READABLEPAGE_H
+#define READABLEPAGE_H
+
+#include <QString>
+
+class MhtmlArchive;
+
+// Rewrites the root part of an archive into a plain reading page: no scripts,
+// frames or media, only text markup and the images that fit into imageBudget bytes.
+namespace ReadablePage
+{
+	QString render(const MhtmlArchive &archive, qint64 imageBudget);
+
+	// Renders filePath into the cache folder and returns the written file, empty on failure
+	QString renderToFile(const QString &filePath, qint64 imageBudget);
+}
+
+#endif // READABLEPAGE_H
@@ -0,0 +1,147 @@
+#include "readahead.h"
+#include "backgroundscheduler.h"
+#include "timinglog.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#endif
+
+// Sequential reads go in chunks, each one charged against the disk budget
+static const qint64 ChunkBytes = 1024 * 1024;
+
+ReadAhead::Limits ReadAhead::Limits::load()
+{
+	Limits limits;
+	QSettings settings;
+	settings.beginGroup("readAhead");
+	limits.files = qMax(0, settings.value("files", limits.files).toInt());
+	limits.budgetBytes = settings.value("budgetMB", limits.budgetBytes / (1024 * 1024)).toLongLong() * 1024 * 1024;
+	settings.endGroup();
+	return limits;
+}
+
+ReadAhead::ReadAhead(QObject *parent)
+	: QObject(parent)
+{
+	connect(&m_watcher, &QFutureWatcher<QHash<QString, QDateTime>>::finished, this, &ReadAhead::handleWarmed);
+}
+
+ReadAhead::~ReadAhead()
+{
+	m_watcher.cancel();
+}
+
+void ReadAhead::prefetch(const QString &current, const QStringList &upcoming)
+{
+	// Tells whether the read-ahead paid off for the file being opened now
+	if (m_warmed.contains(current)) {
+		TimingLog::write("readAhead.hit", 0, QFileInfo(current).fileName());
+		m_warmed.remove(current);
+	}
+
+	const Limits limits = Limits::load();
+	const QStringList files = upcoming.mid(0, limits.files);
+	if (files.isEmpty())
+		return;
+	// The previous window is mostly the same files, they are skipped if still warm
+	const QHash<QString, QDateTime> warmed = m_warmed;
+	m_watcher.cancel();
+	m_watcher.setFuture(BackgroundScheduler::instance()->run(BackgroundScheduler::Normal, "readAhead",
+		[files, limits, warmed](BackgroundJob &job) {
+			QElapsedTimer timer;
+			timer.start();
+			QHash<QString, QDateTime> result;
+			qint64 planned = 0;
+			qint64 read = 0;
+			int count = 0;
+			for (const QString &filePath : files) {
+				if (job.isCancelled())
+					break;
+				// Stat happens here too, it can take a while on a network share
+				const QFileInfo info(filePath);
+				if (!info.exists())
+					continue;
+				// The nearest files come first, the rest waits until they are opened
+				planned += info.size();
+				if (planned > limits.budgetBytes)
+					break;
+				const QDateTime modified = info.lastModified();
+				if (warmed.value(filePath) == modified) {
+					result.insert(filePath, modified);
+					continue;
+				}
+				const qint64 bytes = warm(filePath, job);
+				if (bytes > 0) {
+					result.insert(filePath, modified);
+					read += bytes;
+					++count;
+				}
+			}
+			if (count > 0)
+				TimingLog::write("readAhead", timer.elapsed(), QString("%1 files, %2 KB").arg(count).arg(read / 1024));
+			return result;
+		}));
+}
+
+void ReadAhead::handleWarmed()
+{
+	if (!m_watcher.isCanceled())
+		m_warmed = m_watcher.result();
+}
+
+#if defined(Q_OS_LINUX)
+// Network file systems may ignore the read-ahead hint, their files are read instead
+static bool isNetworkFileSystem(long type)
+{
+	switch (static_cast<unsigned long>(type)) {
+	case 0x6969UL:        // NFS
+	case 0x517BUL:        // SMB
+	case 0xFF534D42UL:    // CIFS
+	case 0xFE534D42UL:    // SMB2
+	case 0x65735546UL:    // FUSE, e.g. sshfs
+		return true;
+	default:
+		return false;
+	}
+}
+#endif
+
+qint64 ReadAhead::warm(const QString &filePath, BackgroundJob &job)
+{
+#if defined(Q_OS_LINUX)
+	const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	struct stat status;
+	struct statfs fileSystem;
+	if (fstat(fd, &status) == 0 && fstatfs(fd, &fileSystem) == 0 && !isNetworkFileSystem(long(fileSystem.f_type))) {
+		// The kernel reads the file asynchronously, the call returns at once
+		const qint64 size = status.st_size;
+		const bool advised = job.checkpoint(size) && posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+		::close(fd);
+		return advised ? size : 0;
+	}
+	::close(fd);
+#endif
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return 0;
+	// The data itself is dropped, only the page cache keeps it
+	QByteArray buffer(int(ChunkBytes), Qt::Uninitialized);
+	qint64 total = 0;
+	for (;;) {
+		if (!job.checkpoint(ChunkBytes))
+			return 0;
+		const qint64 read = file.read(buffer.data(), ChunkBytes);
+		if (read <= 0)
+			break;
+		total += read;
+	}
+	return total;
+}
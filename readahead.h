@@ -0,0 +1,47 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+class BackgroundJob;
+
+// Warms the OS page cache with the next queued archives, so the first read by
+// Chromium comes from memory even on spinning disks and network shares.
+// Local files on Linux only get a POSIX_FADV_WILLNEED hint and the kernel
+// reads them itself; elsewhere, and on network mounts that ignore the hint,
+// the files are read sequentially. Reads go through the background scheduler
+// at normal priority and stay within the disk budget while a page loads.
+class ReadAhead : public QObject
+{
+	Q_OBJECT
+
+public:
+	struct Limits
+	{
+		int files = 3;
+		qint64 budgetBytes = 256LL * 1024 * 1024;   // the upcoming files warmed at once
+
+		static Limits load();
+	};
+
+	explicit ReadAhead(QObject *parent = nullptr);
+	~ReadAhead();
+
+	// Called when current is opened; upcoming are the files after it in queue order
+	void prefetch(const QString &current, const QStringList &upcoming);
+
+	// Bytes warmed, 0 if the file could not be read
+	static qint64 warm(const QString &filePath, BackgroundJob &job);
+
+private:
+	void handleWarmed();
+
+	QFutureWatcher<QHash<QString, QDateTime>> m_watcher;
+	QHash<QString, QDateTime> m_warmed;     // path -> modification time when it was read
+};
+
+#endif // READAHEAD_H
@@ -0,0 +1,293 @@
+#include "resourcemonitor.h"
+#include "tabwidget.h"
+#include "timinglog.h"
+#include "webview.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QHeaderView>
+#include <QLabel>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+#include <algorithm>
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#elif defined(Q_OS_LINUX)
+#include <QDir>
+#include <unistd.h>
+#endif
+
+static const int SampleIntervalMs = 2000;
+// A renderer is flagged when it uses this much more than the median renderer
+static const int OutlierFactor = 2;
+static const qint64 OutlierMinimumKb = 300 * 1024;
+static const double OutlierCpuPercent = 50.0;
+
+enum Column { TabColumn, PidColumn, MemoryColumn, CpuColumn };
+
+ResourceMonitor::ResourceMonitor(TabWidget *tabWidget, QWidget *parent)
+	: QWidget(parent)
+	, m_tabWidget(tabWidget)
+{
+	m_tree = new QTreeWidget;
+	m_tree->setRootIsDecorated(false);
+	m_tree->setHeaderLabels(QStringList() << tr("Tab") << tr("PID") << tr("Memory") << tr("CPU"));
+	m_tree->header()->setSectionResizeMode(TabColumn, QHeaderView::Stretch);
+	m_tree->header()->setStretchLastSection(false);
+	m_summary = new QLabel;
+	m_summary->setWordWrap(true);
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->setContentsMargins(4, 4, 4, 4);
+	layout->addWidget(m_tree);
+	layout->addWidget(m_summary);
+
+	m_timer.setInterval(SampleIntervalMs);
+	connect(&m_timer, &QTimer::timeout, this, &ResourceMonitor::sample);
+	connect(&m_watcher, &QFutureWatcher<QHash<qint64, ProcessSample>>::finished, this, &ResourceMonitor::handleSampled);
+}
+
+void ResourceMonitor::setActive(bool active)
+{
+	// Nobody looks at the numbers while the panel is hidden, so it costs nothing then
+	if (active == m_timer.isActive())
+		return;
+	m_previous.clear();
+	m_sinceLast.invalidate();
+	if (active) {
+		m_timer.start();
+		sample();
+	} else {
+		m_timer.stop();
+	}
+}
+
+ProcessSample ResourceMonitor::sampleProcess(qint64 pid)
+{
+	ProcessSample result;
+	result.pid = pid;
+#if defined(Q_OS_WIN)
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, DWORD(pid));
+	if (!process)
+		return result;
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(process, &counters, sizeof(counters)))
+		result.rssKb = qint64(counters.WorkingSetSize / 1024);
+	FILETIME creation, exit, kernel, user;
+	if (GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+		// 100 ns units
+		quint64 kernelTime = (quint64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+		quint64 userTime = (quint64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+		result.cpuMs = qint64((kernelTime + userTime) / 10000);
+		result.valid = true;
+	}
+	CloseHandle(process);
+#elif defined(Q_OS_LINUX)
+	QFile status(QString("/proc/%1/status").arg(pid));
+	if (!status.open(QIODevice::ReadOnly | QIODevice::Text))
+		return result;
+	while (!status.atEnd()) {
+		QByteArray line = status.readLine();
+		if (line.startsWith("VmRSS:")) {
+			result.rssKb = line.mid(6).trimmed().split(' ').value(0).toLongLong();
+			break;
+		}
+	}
+	QFile stat(QString("/proc/%1/stat").arg(pid));
+	if (stat.open(QIODevice::ReadOnly)) {
+		// The command name may contain spaces, the fields start after its closing parenthesis
+		QByteArray line = stat.readAll();
+		QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+		qint64 ticks = fields.value(11).toLongLong() + fields.value(12).toLongLong(); // utime, stime
+		result.cpuMs = ticks * 1000 / sysconf(_SC_CLK_TCK);
+		result.valid = true;
+	}
+#endif
+	return result;
+}
+
+QVector<qint64> ResourceMonitor::chromiumProcesses(qint64 browserPid)
+{
+	QHash<qint64, qint64> parents;
+	QHash<qint64, QString> names;
+#if defined(Q_OS_WIN)
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return QVector<qint64>();
+	PROCESSENTRY32W entry;
+	entry.dwSize = sizeof(entry);
+	for (BOOL found = Process32FirstW(snapshot, &entry); found; found = Process32NextW(snapshot, &entry)) {
+		parents.insert(entry.th32ProcessID, entry.th32ParentProcessID);
+		names.insert(entry.th32ProcessID, QString::fromWCharArray(entry.szExeFile));
+	}
+	CloseHandle(snapshot);
+#elif defined(Q_OS_LINUX)
+	const QStringList entries = QDir(QStringLiteral("/proc")).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+	for (const QString &name : entries) {
+		bool ok = false;
+		const qint64 pid = name.toLongLong(&ok);
+		QFile stat(QString("/proc/%1/stat").arg(name));
+		if (!ok || !stat.open(QIODevice::ReadOnly))
+			continue;
+		// pid (comm) state ppid ...
+		const QByteArray line = stat.readAll();
+		const int open = line.indexOf('(');
+		const int close = line.lastIndexOf(')');
+		if (open < 0 || close < open)
+			continue;
+		parents.insert(pid, line.mid(close + 2).split(' ').value(1).toLongLong());
+		names.insert(pid, QString::fromLocal8Bit(line.mid(open + 1, close - open - 1)));
+	}
+#endif
+	QVector<qint64> result;
+	for (auto it = names.constBegin(); it != names.constEnd(); ++it) {
+		// The kernel cuts command names at 15 characters
+		if (!it.value().startsWith(QLatin1String("QtWebEngineProc")))
+			continue;
+		// On Linux renderers are started by the zygote, a child of the browser
+		qint64 ancestor = parents.value(it.key());
+		for (int depth = 0; depth < 8 && ancestor > 0 && ancestor != browserPid; ++depth)
+			ancestor = parents.value(ancestor);
+		if (ancestor == browserPid)
+			result.append(it.key());
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+void ResourceMonitor::sample()
+{
+	if (m_watcher.isRunning())
+		return;
+	m_tabs.clear();
+	m_tabs.append({ tr("Browser process"), QCoreApplication::applicationPid() });
+	for (int i = 0; i < m_tabWidget->count(); ++i) {
+		WebView *view = m_tabWidget->webView(i);
+		qint64 pid = 0;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+		if (!view->isHibernated())
+			pid = view->page()->renderProcessPid();
+#endif
+		m_tabs.append({ m_tabWidget->tabText(i), pid });
+	}
+
+	QVector<qint64> pids;
+	for (const TabProcess &tab : qAsConst(m_tabs)) {
+		if (tab.pid > 0 && !pids.contains(tab.pid))
+			pids.append(tab.pid);
+	}
+	m_watcher.setFuture(QtConcurrent::run([pids]() {
+		QHash<qint64, ProcessSample> samples;
+		for (qint64 pid : pids)
+			samples.insert(pid, sampleProcess(pid));
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+		const QVector<qint64> chromium = chromiumProcesses(QCoreApplication::applicationPid());
+		for (qint64 pid : chromium)
+			samples.insert(pid, sampleProcess(pid));
+#endif
+		return samples;
+	}));
+}
+
+void ResourceMonitor::handleSampled()
+{
+	const QHash<qint64, ProcessSample> samples = m_watcher.result();
+	qint64 elapsed = m_sinceLast.isValid() ? m_sinceLast.restart() : 0;
+	if (!m_sinceLast.isValid())
+		m_sinceLast.start();
+
+	const qint64 browserPid = QCoreApplication::applicationPid();
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+	// Processes found by the sampler, in pid order
+	QList<qint64> chromium = samples.keys();
+	std::sort(chromium.begin(), chromium.end());
+	for (qint64 pid : qAsConst(chromium)) {
+		if (pid != browserPid)
+			m_tabs.append({ tr("Chromium process"), pid });
+	}
+#endif
+	QHash<qint64, double> cpu;
+	QHash<qint64, int> tabsPerProcess;
+	QVector<qint64> rendererKb;
+	for (const TabProcess &tab : qAsConst(m_tabs))
+		tabsPerProcess[tab.pid]++;
+	for (const ProcessSample &sample : samples) {
+		if (!sample.valid)
+			continue;
+		const ProcessSample previous = m_previous.value(sample.pid);
+		if (previous.valid && elapsed > 0)
+			cpu.insert(sample.pid, (sample.cpuMs - previous.cpuMs) * 100.0 / elapsed);
+		if (sample.pid != browserPid)
+			rendererKb.append(sample.rssKb);
+	}
+	qint64 medianKb = 0;
+	if (!rendererKb.isEmpty()) {
+		std::nth_element(rendererKb.begin(), rendererKb.begin() + rendererKb.size() / 2, rendererKb.end());
+		medianKb = rendererKb[rendererKb.size() / 2];
+	}
+
+	// Rows are updated in place, selection and scroll position stay where they are
+	while (m_tree->topLevelItemCount() > m_tabs.size())
+		delete m_tree->takeTopLevelItem(m_tree->topLevelItemCount() - 1);
+	qint64 totalKb = 0;
+	for (int row = 0; row < m_tabs.size(); ++row) {
+		const TabProcess &tab = m_tabs.at(row);
+		QTreeWidgetItem *item = row < m_tree->topLevelItemCount() ? m_tree->topLevelItem(row) : new QTreeWidgetItem(m_tree);
+		for (int column = TabColumn; column <= CpuColumn; ++column) {
+			item->setText(column, QString());
+			item->setToolTip(column, QString());
+			item->setData(column, Qt::FontRole, QVariant());
+			item->setData(column, Qt::ForegroundRole, QVariant());
+		}
+		item->setText(TabColumn, tab.title);
+		const ProcessSample sample = samples.value(tab.pid);
+		if (!sample.valid) {
+			item->setText(PidColumn, tab.pid > 0 ? QString::number(tab.pid) : tr("-"));
+			continue;
+		}
+		item->setText(PidColumn, QString::number(tab.pid));
+		item->setText(MemoryColumn, tr("%1 MB").arg(sample.rssKb / 1024));
+		if (cpu.contains(tab.pid))
+			item->setText(CpuColumn, tr("%1%").arg(cpu.value(tab.pid), 0, 'f', 1));
+		item->setTextAlignment(MemoryColumn, Qt::AlignRight | Qt::AlignVCenter);
+		item->setTextAlignment(CpuColumn, Qt::AlignRight | Qt::AlignVCenter);
+		if (tabsPerProcess.value(tab.pid) > 1)
+			item->setToolTip(PidColumn, tr("Shared by %1 tabs").arg(tabsPerProcess.value(tab.pid)));
+
+		bool memoryOutlier = tab.pid != browserPid && sample.rssKb > OutlierMinimumKb
+			&& sample.rssKb > OutlierFactor * medianKb;
+		bool cpuOutlier = cpu.value(tab.pid) > OutlierCpuPercent;
+		if (memoryOutlier || cpuOutlier) {
+			QFont font = item->font(TabColumn);
+			font.setBold(true);
+			for (int column = TabColumn; column <= CpuColumn; ++column) {
+				item->setFont(column, font);
+				item->setForeground(column, Qt::red);
+			}
+			item->setToolTip(TabColumn, memoryOutlier ? tr("Uses far more memory than the other tabs")
+				: tr("Keeps the processor busy"));
+		}
+	}
+
+	for (const ProcessSample &sample : samples) {
+		if (!sample.valid)
+			continue;
+		if (sample.pid != browserPid)
+			totalKb += sample.rssKb;
+		// The logged time is the CPU time spent since the previous sample
+		const ProcessSample previous = m_previous.value(sample.pid);
+		TimingLog::write("processResources", previous.valid ? sample.cpuMs - previous.cpuMs : 0,
+			QString("pid=%1 rssKb=%2 cpu=%3% tabs=%4").arg(sample.pid).arg(sample.rssKb)
+				.arg(cpu.value(sample.pid), 0, 'f', 1).arg(sample.pid == browserPid ? 0 : tabsPerProcess.value(sample.pid)));
+	}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+	m_summary->setText(tr("Renderers: %1 MB in %2 processes").arg(totalKb / 1024).arg(rendererKb.size()));
+#else
+	m_summary->setText(tr("Chromium: %1 MB in %2 processes. Tabs are matched to their renderer from Qt 5.15 on.")
+		.arg(totalKb / 1024).arg(rendererKb.size()));
+#endif
+	m_previous = samples;
+}
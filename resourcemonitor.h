@@ -0,0 +1,62 @@
+#ifndef RESOURCEMONITOR_H
+#define RESOURCEMONITOR_H
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QTimer>
+#include <QWidget>
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QTreeWidget;
+QT_END_NAMESPACE
+
+class TabWidget;
+
+struct ProcessSample
+{
+	qint64 pid = 0;
+	qint64 rssKb = 0;
+	qint64 cpuMs = 0;   // user and kernel time since the process started
+	bool valid = false;
+};
+
+// Memory and CPU of the renderer behind every tab, sampled while the panel is shown.
+// Tabs of the same site may share a renderer, such tabs show the same process.
+// Before Qt 5.15 a page does not tell its renderer, every Chromium process of
+// the browser is listed on its own row instead.
+class ResourceMonitor : public QWidget
+{
+	Q_OBJECT
+
+public:
+	explicit ResourceMonitor(TabWidget *tabWidget, QWidget *parent = nullptr);
+
+	void setActive(bool active);
+
+	static ProcessSample sampleProcess(qint64 pid);
+	// QtWebEngineProcess instances started by the browser process, directly or not
+	static QVector<qint64> chromiumProcesses(qint64 browserPid);
+
+private:
+	struct TabProcess
+	{
+		QString title;
+		qint64 pid;
+	};
+
+	void sample();
+	void handleSampled();
+
+	TabWidget *m_tabWidget;
+	QTreeWidget *m_tree;
+	QLabel *m_summary;
+	QTimer m_timer;
+	QVector<TabProcess> m_tabs;
+	QHash<qint64, ProcessSample> m_previous;
+	QElapsedTimer m_sinceLast;
+	QFutureWatcher<QHash<qint64, ProcessSample>> m_watcher;
+};
+
+#endif // RESOURCEMONITOR_H
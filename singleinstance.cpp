@@ -0,0 +1,76 @@
+#include "singleinstance.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+static const int ConnectTimeoutMs = 500;
+
+SingleInstance::SingleInstance(const QString &key, QObject *parent)
+	: QObject(parent)
+	, m_server(nullptr)
+{
+	// The socket name is per user, otherwise two users on one machine would share a browser
+	QByteArray user = QDir::homePath().toUtf8();
+	m_serverName = key + '-' + QCryptographicHash::hash(user, QCryptographicHash::Sha1).toHex().left(12);
+}
+
+bool SingleInstance::forwardToRunningInstance(const QStringList &arguments)
+{
+	QLocalSocket socket;
+	socket.connectToServer(m_serverName);
+	if (!socket.waitForConnected(ConnectTimeoutMs))
+		return false;
+
+	QByteArray block;
+	QDataStream out(&block, QIODevice::WriteOnly);
+	out << arguments;
+	socket.write(block);
+	if (!socket.waitForBytesWritten(ConnectTimeoutMs))
+		return false;
+	// The receiver closes the connection once the arguments are parsed; a hung
+	// instance never does, and this one then has to open the URLs itself
+	return socket.state() == QLocalSocket::UnconnectedState || socket.waitForDisconnected(ConnectTimeoutMs);
+}
+
+bool SingleInstance::listen()
+{
+	m_server = new QLocalServer(this);
+	m_server->setSocketOptions(QLocalServer::UserAccessOption);
+	if (!m_server->listen(m_serverName)) {
+		// A crashed instance may leave a stale socket file behind; one that still
+		// answers belongs to an instance that started meanwhile and is left alone
+		QLocalSocket probe;
+		probe.connectToServer(m_serverName);
+		if (probe.waitForConnected(ConnectTimeoutMs)) {
+			probe.abort();
+			qWarning("Single instance server failed: another instance is listening");
+			return false;
+		}
+		QLocalServer::removeServer(m_serverName);
+		if (!m_server->listen(m_serverName)) {
+			qWarning("Single instance server failed: %s", qPrintable(m_server->errorString()));
+			return false;
+		}
+	}
+	connect(m_server, &QLocalServer::newConnection, this, &SingleInstance::handleNewConnection);
+	return true;
+}
+
+void SingleInstance::handleNewConnection()
+{
+	while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+		connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+		connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+			QDataStream in(socket);
+			in.startTransaction();
+			QStringList arguments;
+			in >> arguments;
+			if (!in.commitTransaction())
+				return; // wait for the rest of the block
+			socket->disconnectFromServer();
+			emit argumentsReceived(arguments);
+		});
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QStringList>
+
+QT_BEGIN_NAMESPACE
+class QLocalServer;
+QT_END_NAMESPACE
+
+// Keeps one browser process per user: later launches hand their
+// arguments over a local socket to the instance that is already running.
+class SingleInstance : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit SingleInstance(const QString &key, QObject *parent = nullptr);
+
+	// Returns true if a running instance accepted the arguments
+	bool forwardToRunningInstance(const QStringList &arguments);
+	bool listen();
+
+signals:
+	void argumentsReceived(const QStringList &arguments);
+
+private:
+	void handleNewConnection();
+
+	QString m_serverName;
+	QLocalServer *m_server;
+};
+
+#endif // SINGLEINSTANCE_H
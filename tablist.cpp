@@ -0,0 +1,92 @@
+#include "tablist.h"
+#include "tabwidget.h"
+#include <QAbstractListModel>
+
+class TabListModel : public QAbstractListModel
+{
+public:
+	explicit TabListModel(TabWidget *tabWidget, QObject *parent)
+		: QAbstractListModel(parent)
+		, m_tabWidget(tabWidget)
+	{
+	}
+
+	int rowCount(const QModelIndex &parent) const override
+	{
+		return parent.isValid() ? 0 : m_tabWidget->count();
+	}
+
+	QVariant data(const QModelIndex &index, int role) const override
+	{
+		switch (role) {
+		case Qt::DisplayRole:
+			return m_tabWidget->tabText(index.row());
+		case Qt::ToolTipRole:
+			return m_tabWidget->tabToolTip(index.row());
+		case Qt::DecorationRole:
+			return m_tabWidget->tabIcon(index.row());
+		default:
+			return QVariant();
+		}
+	}
+
+	// The tab widget has already changed when these are called, the model has no copy to update
+	void insert(int row)
+	{
+		beginInsertRows(QModelIndex(), row, row);
+		endInsertRows();
+	}
+
+	void remove(int row)
+	{
+		beginRemoveRows(QModelIndex(), row, row);
+		endRemoveRows();
+	}
+
+	void move(int from, int to)
+	{
+		if (beginMoveRows(QModelIndex(), from, from, QModelIndex(), to > from ? to + 1 : to))
+			endMoveRows();
+	}
+
+	void update(int first, int last)
+	{
+		emit dataChanged(index(first), index(last));
+	}
+
+private:
+	TabWidget *m_tabWidget;
+};
+
+TabList::TabList(TabWidget *tabWidget, QWidget *parent)
+	: QListView(parent)
+	, m_tabWidget(tabWidget)
+	, m_model(new TabListModel(tabWidget, this))
+{
+	setModel(m_model);
+	// Every row has the same height, so no row outside the viewport is ever measured
+	setUniformItemSizes(true);
+	setLayoutMode(QListView::Batched);
+	setTextElideMode(Qt::ElideRight);
+	setSelectionMode(QAbstractItemView::SingleSelection);
+	setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+	connect(tabWidget, &TabWidget::tabAdded, this, [this](int index) { m_model->insert(index); });
+	connect(tabWidget, &TabWidget::tabClosed, this, [this](int index) { m_model->remove(index); });
+	connect(tabWidget, &TabWidget::tabMoved, this, [this](int from, int to) { m_model->move(from, to); });
+	connect(tabWidget, &TabWidget::tabsUpdated, this, [this](int first, int last) { m_model->update(first, last); });
+	connect(tabWidget, &QTabWidget::currentChanged, this, &TabList::syncCurrent);
+	connect(this, &QListView::clicked, this, [this](const QModelIndex &index) {
+		m_tabWidget->setCurrentIndex(index.row());
+	});
+	syncCurrent(tabWidget->currentIndex());
+}
+
+void TabList::syncCurrent(int index)
+{
+	if (index < 0)
+		return;
+	QModelIndex current = m_model->index(index);
+	setCurrentIndex(current);
+	scrollTo(current);
+}
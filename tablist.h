@@ -0,0 +1,26 @@
+#ifndef TABLIST_H
+#define TABLIST_H
+
+#include <QListView>
+
+class TabWidget;
+class TabListModel;
+
+// Vertical list of the tabs of one window. The list view only lays out and
+// paints the visible rows and the model reads titles straight from the tab bar,
+// so a window with thousands of tabs stays responsive.
+class TabList : public QListView
+{
+	Q_OBJECT
+
+public:
+	explicit TabList(TabWidget *tabWidget, QWidget *parent = nullptr);
+
+private:
+	void syncCurrent(int index);
+
+	TabWidget *m_tabWidget;
+	TabListModel *m_model;
+};
+
+#endif // TABLIST_H
@@ -6,11 +6,24 @@
 #include <QMenu>
 #include <QTabBar>
 #include <QWebEngineProfile>
+#include <memory>
+
+// Background tab titles, icons and URLs are applied in batches at this interval
+static const int UpdateIntervalMs = 100;
+static const int MaxConcurrentLoads = 4;
+// A load that never finishes must not hold its slot forever
+static const int LoadTimeoutMs = 30000;
 
 TabWidget::TabWidget(QWebEngineProfile *profile, QWidget *parent)
     : QTabWidget(parent)
     , m_profile(profile)
+    , m_indexesDirty(true)
+    , m_activeLoads(0)
 {
+    m_updateTimer.setSingleShot(true);
+    m_updateTimer.setInterval(UpdateIntervalMs);
+    connect(&m_updateTimer, &QTimer::timeout, this, &TabWidget::flushUpdates);
+
     QTabBar *tabBar = this->tabBar();
     tabBar->setTabsClosable(true);
     tabBar->setSelectionBehaviorOnRemove(QTabBar::SelectPreviousTab);
@@ -22,6 +35,10 @@ TabWidget::TabWidget(QWebEngineProfile *profile, QWidget *parent)
         if (index == -1)
             createTab();
     });
+    connect(tabBar, &QTabBar::tabMoved, [this](int from, int to) {
+        m_indexesDirty = true;
+        emit tabMoved(from, to);
+    });
 
     setDocumentMode(true);
     setElideMode(Qt::ElideRight);
@@ -41,6 +58,7 @@ void TabWidget::handleCurrentChanged(int index)
 {
     if (index != -1) {
         WebView *view = webView(index);
+        view->wake();
         if (!view->url().isEmpty())
             view->setFocus();
         emit titleChanged(view->title());
@@ -106,54 +124,111 @@ WebView *TabWidget::webView(int index) const
     return qobject_cast<WebView*>(widget(index));
 }
 
+int TabWidget::indexOfView(const WebView *view) const
+{
+    if (m_indexesDirty) {
+        m_indexes.clear();
+        m_indexes.reserve(count());
+        for (int i = 0; i < count(); ++i)
+            m_indexes.insert(widget(i), i);
+        m_indexesDirty = false;
+    }
+    return m_indexes.value(view, -1);
+}
+
+void TabWidget::tabInserted(int index)
+{
+    QTabWidget::tabInserted(index);
+    // Appending, as a restored session does tab by tab, keeps the map valid
+    if (!m_indexesDirty && index == count() - 1)
+        m_indexes.insert(widget(index), index);
+    else
+        m_indexesDirty = true;
+    emit tabAdded(index);
+}
+
+void TabWidget::tabRemoved(int index)
+{
+    QTabWidget::tabRemoved(index);
+    m_indexesDirty = true;
+    emit tabClosed(index);
+}
+
+void TabWidget::scheduleUpdate(WebView *webView, PendingUpdate update)
+{
+    m_pendingUpdates[webView] |= update;
+    if (!m_updateTimer.isActive())
+        m_updateTimer.start();
+}
+
+void TabWidget::flushUpdates()
+{
+    int first = count();
+    int last = -1;
+    for (auto it = m_pendingUpdates.constBegin(); it != m_pendingUpdates.constEnd(); ++it) {
+        // Views closed meanwhile are no longer in the index map and are never touched
+        int index = indexOfView(it.key());
+        if (index == -1)
+            continue;
+        WebView *view = it.key();
+        if (it.value() & TitleUpdate) {
+            setTabText(index, view->title());
+            setTabToolTip(index, view->title());
+        }
+        if (it.value() & UrlUpdate)
+            tabBar()->setTabData(index, view->url());
+        if (it.value() & IconUpdate)
+            setTabIcon(index, view->favIcon());
+        first = qMin(first, index);
+        last = qMax(last, index);
+    }
+    m_pendingUpdates.clear();
+    if (last >= 0)
+        emit tabsUpdated(first, last);
+}
+
 void TabWidget::setupView(WebView *webView)
 {
     QWebEnginePage *webPage = webView->page();
 
+    // Signals of background tabs only touch the tab bar, and that is batched;
+    // the current tab is found by pointer instead of searching the tab list
     connect(webView, &QWebEngineView::titleChanged, [this, webView](const QString &title) {
-        int index = indexOf(webView);
-        if (index != -1) {
-            setTabText(index, title);
-            setTabToolTip(index, title);
-        }
-        if (currentIndex() == index)
+        scheduleUpdate(webView, TitleUpdate);
+        if (currentWidget() == webView)
             emit titleChanged(title);
     });
     connect(webView, &QWebEngineView::urlChanged, [this, webView](const QUrl &url) {
-        int index = indexOf(webView);
-        if (index != -1)
-            tabBar()->setTabData(index, url);
-        if (currentIndex() == index)
+        scheduleUpdate(webView, UrlUpdate);
+        if (currentWidget() == webView)
             emit urlChanged(url);
     });
     connect(webView, &QWebEngineView::loadProgress, [this, webView](int progress) {
-        if (currentIndex() == indexOf(webView))
+        if (currentWidget() == webView)
             emit loadProgress(progress);
     });
     connect(webPage, &QWebEnginePage::linkHovered, [this, webView](const QString &url) {
-        if (currentIndex() == indexOf(webView))
+        if (currentWidget() == webView)
             emit linkHovered(url);
     });
     connect(webView, &WebView::favIconChanged, [this, webView](const QIcon &icon) {
-        int index = indexOf(webView);
-        if (index != -1)
-            setTabIcon(index, icon);
-        if (currentIndex() == index)
+        scheduleUpdate(webView, IconUpdate);
+        if (currentWidget() == webView)
             emit favIconChanged(icon);
     });
     connect(webView, &WebView::webActionEnabledChanged, [this, webView](QWebEnginePage::WebAction action, bool enabled) {
-        if (currentIndex() ==  indexOf(webView))
+        if (currentWidget() == webView)
             emit webActionEnabledChanged(action,enabled);
     });
     connect(webPage, &QWebEnginePage::windowCloseRequested, [this, webView]() {
-        int index = indexOf(webView);
+        int index = indexOfView(webView);
         if (index >= 0)
             closeTab(index);
     });
     connect(webView, &WebView::devToolsRequested, this, &TabWidget::devToolsRequested);
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
     connect(webPage, &QWebEnginePage::findTextFinished, [this, webView](const QWebEngineFindTextResult &result) {
-        if (currentIndex() == indexOf(webView))
+        if (currentWidget() == webView)
             emit findTextFinished(result);
     });
 #endif
@@ -180,10 +255,75 @@ WebView *TabWidget::createBackgroundTab()
     return webView;
 }
 
+WebView *TabWidget::createHibernatedTab(const QUrl &url, const QString &title, qreal zoomFactor, const QPointF &scrollPosition)
+{
+    // No navigation happens, so no render process is started for the tab
+    WebView *webView = createBackgroundTab();
+    webView->hibernate(url, title, zoomFactor, scrollPosition);
+    int index = indexOfView(webView);
+    QString text = title.isEmpty() ? url.toDisplayString() : title;
+    setTabText(index, text);
+    setTabToolTip(index, text);
+    tabBar()->setTabData(index, url);
+    setTabIcon(index, webView->favIcon());
+    emit tabsUpdated(index, index);
+    return webView;
+}
+
+WebView *TabWidget::openInBackground(const QUrl &url)
+{
+    WebView *webView = createBackgroundTab();
+    scheduleLoad(webView, url);
+    return webView;
+}
+
+void TabWidget::scheduleLoad(WebView *webView, const QUrl &url)
+{
+    m_pendingLoads.append({ webView, url });
+    startPendingLoads();
+}
+
+void TabWidget::startPendingLoads()
+{
+    while (m_activeLoads < MaxConcurrentLoads && !m_pendingLoads.isEmpty()) {
+        PendingLoad load = m_pendingLoads.takeFirst();
+        WebView *view = load.view;
+        if (!view)
+            continue;
+        ++m_activeLoads;
+        // Whichever comes first frees the slot: the load finishing, the tab closing or the timeout
+        auto done = std::make_shared<bool>(false);
+        auto connections = std::make_shared<QVector<QMetaObject::Connection>>();
+        auto finish = [this, done, connections]() {
+            if (*done)
+                return;
+            *done = true;
+            for (const QMetaObject::Connection &connection : qAsConst(*connections))
+                disconnect(connection);
+            --m_activeLoads;
+            startPendingLoads();
+        };
+        connections->append(connect(view, &QWebEngineView::loadFinished, this, finish));
+        connections->append(connect(view, &QObject::destroyed, this, finish));
+        QTimer::singleShot(LoadTimeoutMs, this, finish);
+        if (load.url.isEmpty())
+            view->reload();
+        else
+            view->setUrl(load.url);
+    }
+}
+
 void TabWidget::reloadAllTabs()
 {
-    for (int i = 0; i < count(); ++i)
-        webView(i)->reload();
+    // The current tab first, the others follow as slots free up
+    if (WebView *view = currentWebView()) {
+        if (!view->isHibernated())
+            scheduleLoad(view, QUrl());
+    }
+    for (int i = 0; i < count(); ++i) {
+        if (i != currentIndex() && !webView(i)->isHibernated())
+            scheduleLoad(webView(i), QUrl());
+    }
 }
 
 void TabWidget::closeOtherTabs(int index)
@@ -211,7 +351,7 @@ void TabWidget::cloneTab(int index)
 {
     if (WebView *view = webView(index)) {
         WebView *tab = createTab();
-        tab->setUrl(view->url());
+        tab->setUrl(view->sessionUrl());
     }
 }
 
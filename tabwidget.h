@@ -2,13 +2,13 @@
 #ifndef TABWIDGET_H
 #define TABWIDGET_H
 
+#include <QHash>
+#include <QPointer>
 #include <QTabWidget>
+#include <QTimer>
+#include <QUrl>
 #include <QWebEnginePage>
 
-QT_BEGIN_NAMESPACE
-class QUrl;
-QT_END_NAMESPACE
-
 class WebView;
 
 class TabWidget : public QTabWidget
@@ -19,6 +19,9 @@ public:
     TabWidget(QWebEngineProfile *profile, QWidget *parent = nullptr);
 
     WebView *currentWebView() const;
+    WebView *webView(int index) const;
+    // Constant time, the index map is rebuilt once after tabs were added, removed or moved
+    int indexOfView(const WebView *view) const;
 
 signals:
     // current tab/page signals
@@ -32,6 +35,12 @@ signals:
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
     void findTextFinished(const QWebEngineFindTextResult &result);
 #endif
+    // Tab list changes, for views that mirror the tab bar
+    void tabAdded(int index);
+    void tabClosed(int index);
+    void tabMoved(int from, int to);
+    // Titles, icons or URLs of the tabs in the range changed
+    void tabsUpdated(int first, int last);
 
 public slots:
     // current tab/page slots
@@ -40,7 +49,10 @@ public slots:
 
     WebView *createTab();
     WebView *createBackgroundTab();
+    WebView *createHibernatedTab(const QUrl &url, const QString &title, qreal zoomFactor, const QPointF &scrollPosition);
     void closeTab(int index);
+    // Loads are started a few at a time, so bulk operations don't start every renderer at once
+    WebView *openInBackground(const QUrl &url);
     void nextTab();
     void previousTab();
 
@@ -52,11 +64,32 @@ private slots:
     void reloadAllTabs();
     void reloadTab(int index);
 
+protected:
+    void tabInserted(int index) override;
+    void tabRemoved(int index) override;
+
 private:
-    WebView *webView(int index) const;
+    enum PendingUpdate { TitleUpdate = 1, UrlUpdate = 2, IconUpdate = 4 };
+
+    struct PendingLoad
+    {
+        QPointer<WebView> view;
+        QUrl url;          // empty for a reload
+    };
+
     void setupView(WebView *webView);
+    void scheduleUpdate(WebView *webView, PendingUpdate update);
+    void flushUpdates();
+    void scheduleLoad(WebView *webView, const QUrl &url);
+    void startPendingLoads();
 
     QWebEngineProfile *m_profile;
+    mutable QHash<const QWidget *, int> m_indexes;
+    mutable bool m_indexesDirty;
+    QHash<WebView *, int> m_pendingUpdates;
+    QTimer m_updateTimer;
+    QList<PendingLoad> m_pendingLoads;
+    int m_activeLoads;
 };
 
 #endif // TABWIDGET_H
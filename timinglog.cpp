@@ -0,0 +1,36 @@
+#include "timinglog.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QStandardPaths>
+#include <QTextStream>
+
+void TimingLog::write(const QString &event, qint64 ms, const QString &details)
+{
+	static QMutex mutex;
+	QMutexLocker locker(&mutex);
+
+	QFile file(filePath());
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+		return;
+	QTextStream out(&file);
+	out << QDateTime::currentDateTime().toString(Qt::ISODateWithMs) << '\t'
+		<< event << '\t' << ms << '\t' << details << '\n';
+}
+
+QString TimingLog::filePath()
+{
+	static const QString path = [] {
+		QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+		QDir().mkpath(dir);
+		return dir + "/timing.log";
+	}();
+	return path;
+}
+
+QElapsedTimer &TimingLog::startupTimer()
+{
+	static QElapsedTimer timer;
+	return timer;
+}
@@ -0,0 +1,19 @@
+#ifndef TIMINGLOG_H
+#define TIMINGLOG_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+// Append-only timing log, one tab separated line per measured event.
+// Safe to call from worker threads.
+class TimingLog
+{
+public:
+	static void write(const QString &event, qint64 ms, const QString &details = QString());
+	static QString filePath();
+
+	// Started at the very top of main(), used for startup measurements
+	static QElapsedTimer &startupTimer();
+};
+
+#endif // TIMINGLOG_H
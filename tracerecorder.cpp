@@ -0,0 +1,403 @@
+#include "tracerecorder.h"
+#include "timinglog.h"
+#include "webview.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QSaveFile>
+#include <QTimer>
+#include <QWebSocket>
+#include <QtConcurrent>
+#include <algorithm>
+#include <memory>
+
+// Paint and compositing work goes on for a while after loadFinished
+static const int SettleMs = 1000;
+static const int StartTimeoutMs = 3000;
+static const int TraceTimeoutMs = 60000;
+// Collecting a large trace takes a while, a lost tracingComplete must not block the next load
+static const int EndTimeoutMs = 30000;
+static const int SummaryRows = 25;
+
+static quint16 s_port = 0;
+
+struct TraceRecorder::Session
+{
+	QPointer<QWebSocket> socket;
+	int nextId = 1;
+	QHash<int, std::function<void(const QJsonObject &)>> replies;
+	int traceId = 0;
+	bool tracing = false;
+	bool ending = false;
+	QString filePath;
+	QJsonArray events;
+	qint64 startedMs = 0;
+	std::function<void()> pending;      // next record() waiting for the current trace to end
+};
+
+namespace
+{
+	// Self time per event name: complete events minus the events nested in them on the same thread
+	QHash<QString, qint64> selfTimes(const QJsonArray &events)
+	{
+		struct Slice
+		{
+			QString name;
+			qint64 start;
+			qint64 end;
+		};
+		QHash<QString, QVector<Slice>> threads;
+		for (const QJsonValue &value : events) {
+			const QJsonObject event = value.toObject();
+			if (event.value("ph").toString() != QLatin1String("X"))
+				continue;
+			qint64 start = qint64(event.value("ts").toDouble());
+			qint64 duration = qint64(event.value("dur").toDouble());
+			QString thread = QString::number(event.value("pid").toInt()) + ':' + QString::number(event.value("tid").toInt());
+			threads[thread].append({ event.value("name").toString(), start, start + duration });
+		}
+
+		QHash<QString, qint64> result;
+		for (QVector<Slice> &slices : threads) {
+			// Parents first: earlier start, or the longer slice when both start together
+			std::sort(slices.begin(), slices.end(), [](const Slice &a, const Slice &b) {
+				return a.start != b.start ? a.start < b.start : a.end > b.end;
+			});
+			QVector<qint64> self(slices.size());
+			QVector<int> stack;
+			for (int i = 0; i < slices.size(); ++i) {
+				while (!stack.isEmpty() && slices.at(stack.last()).end <= slices.at(i).start)
+					stack.removeLast();
+				self[i] = slices.at(i).end - slices.at(i).start;
+				if (!stack.isEmpty())
+					self[stack.last()] -= self[i];
+				stack.append(i);
+			}
+			for (int i = 0; i < slices.size(); ++i)
+				result[slices.at(i).name] += qMax<qint64>(0, self.at(i));
+		}
+		return result;
+	}
+
+	QList<QPair<QString, qint64>> ranked(const QHash<QString, qint64> &times, int count)
+	{
+		QList<QPair<QString, qint64>> rows;
+		for (auto it = times.constBegin(); it != times.constEnd(); ++it)
+			rows.append(qMakePair(it.key(), it.value()));
+		std::sort(rows.begin(), rows.end(), [](const QPair<QString, qint64> &a, const QPair<QString, qint64> &b) {
+			return a.second > b.second;
+		});
+		return rows.mid(0, count);
+	}
+}
+
+TraceRecorder::TraceRecorder(QObject *parent)
+	: QObject(parent)
+	, m_batchArticles(0)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	qDeleteAll(m_sessions);
+}
+
+void TraceRecorder::enable(quint16 port)
+{
+	// Loopback only, the DevTools protocol gives full control over the pages
+	s_port = port;
+	qputenv("QTWEBENGINE_REMOTE_DEBUGGING", QByteArray("127.0.0.1:") + QByteArray::number(port));
+}
+
+quint16 TraceRecorder::port()
+{
+	return s_port;
+}
+
+QString TraceRecorder::traceFolder()
+{
+	QString folder = QFileInfo(TimingLog::filePath()).absolutePath() + "/traces";
+	QDir().mkpath(folder);
+	return folder;
+}
+
+void TraceRecorder::record(WebView *view, const QString &filePath, const std::function<void()> &load)
+{
+	QPointer<WebView> guard(view);
+	Session *session = m_sessions.value(view);
+	if (session && session->tracing) {
+		// The previous article is still being traced, its trace ends where this one starts
+		session->pending = [this, guard, filePath, load]() {
+			// Goes through record() again, the connection may have dropped meanwhile
+			if (guard)
+				record(guard, filePath, load);
+		};
+		stop(view, session->traceId);
+		return;
+	}
+	if (session && session->socket && session->socket->state() == QAbstractSocket::ConnectedState) {
+		start(view, filePath, load);
+		return;
+	}
+	attach(view, [this, guard, filePath, load](bool attached) {
+		if (guard && attached)
+			start(guard, filePath, load);
+		else
+			load();
+	});
+}
+
+void TraceRecorder::attach(WebView *view, const std::function<void(bool)> &done)
+{
+	// The tab is found in the target list by a unique title it shows first
+	const QString marker = QString("trace-%1-%2").arg(quintptr(view), 0, 16).arg(QDateTime::currentMSecsSinceEpoch());
+	QPointer<WebView> guard(view);
+	auto connection = std::make_shared<QMetaObject::Connection>();
+	*connection = connect(view, &QWebEngineView::loadFinished, this, [this, guard, marker, done, connection]() {
+		QObject::disconnect(*connection);
+		QNetworkReply *reply = m_network.get(QNetworkRequest(QUrl(QString("http://127.0.0.1:%1/json/list").arg(s_port))));
+		connect(reply, &QNetworkReply::finished, this, [this, reply, guard, marker, done]() {
+			reply->deleteLater();
+			QString socketUrl;
+			const QJsonArray targets = QJsonDocument::fromJson(reply->readAll()).array();
+			for (const QJsonValue &target : targets) {
+				if (target.toObject().value("title").toString() == marker)
+					socketUrl = target.toObject().value("webSocketDebuggerUrl").toString();
+			}
+			if (!guard || socketUrl.isEmpty()) {
+				qWarning("Trace recorder: no DevTools target for the tab (%s)", qPrintable(reply->errorString()));
+				done(false);
+				return;
+			}
+
+			WebView *view = guard;
+			Session *session = m_sessions.value(view);
+			if (!session) {
+				session = new Session;
+				m_sessions.insert(view, session);
+				connect(view, &QObject::destroyed, this, [this, view]() {
+					Session *session = m_sessions.take(view);
+					if (session && session->socket)
+						session->socket->deleteLater();
+					delete session;
+				});
+			}
+			if (session->socket)
+				session->socket->deleteLater();
+			QWebSocket *socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+			session->socket = socket;
+			auto answered = std::make_shared<bool>(false);
+			connect(socket, &QWebSocket::connected, this, [answered, done]() {
+				if (!*answered) {
+					*answered = true;
+					done(true);
+				}
+			});
+			connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, [socket, answered, done]() {
+				qWarning("Trace recorder: %s", qPrintable(socket->errorString()));
+				if (!*answered) {
+					*answered = true;
+					done(false);
+				}
+			});
+			connect(socket, &QWebSocket::textMessageReceived, this, [this, guard](const QString &message) {
+				if (guard)
+					handleMessage(guard, message);
+			});
+			connect(socket, &QWebSocket::disconnected, this, [this, guard, socket]() {
+				Session *session = guard ? m_sessions.value(guard) : nullptr;
+				if (session && session->socket == socket)
+					abandonTrace(guard, "DevTools connection closed");
+			});
+			socket->open(QUrl(socketUrl));
+		});
+	});
+	view->setHtml(QString("<title>%1</title>").arg(marker));
+}
+
+void TraceRecorder::start(WebView *view, const QString &filePath, const std::function<void()> &load)
+{
+	Session *session = m_sessions.value(view);
+	const int traceId = ++session->traceId;
+	session->tracing = true;
+	session->ending = false;
+	session->filePath = filePath;
+	session->events = QJsonArray();
+	session->startedMs = QDateTime::currentMSecsSinceEpoch();
+
+	QJsonObject config;
+	config.insert("includedCategories", QJsonArray() << "devtools.timeline" << "disabled-by-default-devtools.timeline"
+		<< "disabled-by-default-devtools.timeline.frame" << "blink.user_timing" << "loading" << "v8");
+	QJsonObject params;
+	params.insert("traceConfig", config);
+	params.insert("transferMode", "ReportEvents");
+
+	// The load starts once tracing runs in every process, or after a short wait if Chromium does not answer
+	QPointer<WebView> guard(view);
+	auto started = std::make_shared<bool>(false);
+	auto begin = [this, guard, traceId, load, started]() {
+		if (*started)
+			return;
+		*started = true;
+		load();
+		if (!guard)
+			return;
+		auto connection = std::make_shared<QMetaObject::Connection>();
+		*connection = connect(guard, &QWebEngineView::loadFinished, this, [this, guard, traceId, connection]() {
+			QObject::disconnect(*connection);
+			QTimer::singleShot(SettleMs, this, [this, guard, traceId]() {
+				if (guard)
+					stop(guard, traceId);
+			});
+		});
+		QTimer::singleShot(TraceTimeoutMs, this, [this, guard, traceId]() {
+			if (guard)
+				stop(guard, traceId);
+		});
+	};
+	send(session, "Tracing.start", params, [this, guard, traceId, begin](const QJsonObject &reply) {
+		if (reply.contains("error")) {
+			qWarning("Trace recorder: %s", qPrintable(reply.value("error").toObject().value("message").toString()));
+			// The load goes ahead untraced
+			Session *session = guard ? m_sessions.value(guard) : nullptr;
+			if (session && session->traceId == traceId)
+				abandonTrace(guard, "Tracing.start failed");
+		}
+		begin();
+	});
+	QTimer::singleShot(StartTimeoutMs, this, begin);
+}
+
+void TraceRecorder::stop(WebView *view, int traceId)
+{
+	Session *session = m_sessions.value(view);
+	if (!session || !session->tracing || session->ending || session->traceId != traceId)
+		return;
+	session->ending = true;
+	send(session, "Tracing.end");
+	QPointer<WebView> guard(view);
+	QTimer::singleShot(EndTimeoutMs, this, [this, guard, traceId]() {
+		Session *session = guard ? m_sessions.value(guard) : nullptr;
+		if (session && session->ending && session->traceId == traceId)
+			abandonTrace(guard, "no tracingComplete after Tracing.end");
+	});
+}
+
+void TraceRecorder::send(Session *session, const QString &method, const QJsonObject &params,
+	const std::function<void(const QJsonObject &)> &reply)
+{
+	if (!session->socket)
+		return;
+	QJsonObject message;
+	const int id = session->nextId++;
+	message.insert("id", id);
+	message.insert("method", method);
+	message.insert("params", params);
+	if (reply)
+		session->replies.insert(id, reply);
+	session->socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact)));
+}
+
+void TraceRecorder::handleMessage(WebView *view, const QString &text)
+{
+	Session *session = m_sessions.value(view);
+	if (!session)
+		return;
+	const QJsonObject message = QJsonDocument::fromJson(text.toUtf8()).object();
+	if (message.contains("id")) {
+		auto reply = session->replies.take(message.value("id").toInt());
+		if (reply)
+			reply(message);
+		return;
+	}
+	const QString method = message.value("method").toString();
+	if (method == QLatin1String("Tracing.dataCollected")) {
+		const QJsonArray events = message.value("params").toObject().value("value").toArray();
+		for (const QJsonValue &event : events)
+			session->events.append(event);
+	} else if (method == QLatin1String("Tracing.tracingComplete")) {
+		finishTrace(view);
+	}
+}
+
+void TraceRecorder::finishTrace(WebView *view)
+{
+	Session *session = m_sessions.value(view);
+	const QString filePath = session->filePath;
+	const QJsonArray events = session->events;
+	const qint64 elapsedMs = QDateTime::currentMSecsSinceEpoch() - session->startedMs;
+	session->tracing = false;
+	session->ending = false;
+	session->events = QJsonArray();
+
+	// Traces run to tens of megabytes, writing and analysing them stays off the GUI thread
+	const QString tracePath = traceFolder() + '/' + QFileInfo(filePath).completeBaseName() + ".trace.json";
+	auto watcher = new QFutureWatcher<QHash<QString, qint64>>(this);
+	connect(watcher, &QFutureWatcher<QHash<QString, qint64>>::finished, this, [this, watcher, filePath, elapsedMs]() {
+		watcher->deleteLater();
+		summarize(filePath, watcher->result(), elapsedMs);
+	});
+	watcher->setFuture(QtConcurrent::run([tracePath, events]() {
+		QJsonObject trace;
+		trace.insert("traceEvents", events);
+		QSaveFile file(tracePath);
+		if (file.open(QIODevice::WriteOnly)) {
+			file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+			file.commit();
+		}
+		return selfTimes(events);
+	}));
+
+	if (session->pending) {
+		std::function<void()> pending = session->pending;
+		session->pending = nullptr;
+		pending();
+	}
+}
+
+void TraceRecorder::abandonTrace(WebView *view, const char *reason)
+{
+	Session *session = m_sessions.value(view);
+	if (!session->tracing)
+		return;
+	qWarning("Trace recorder: %s, trace of %s dropped", reason, qPrintable(QFileInfo(session->filePath).fileName()));
+	session->tracing = false;
+	session->ending = false;
+	session->events = QJsonArray();
+	session->replies.clear();
+
+	if (session->pending) {
+		std::function<void()> pending = session->pending;
+		session->pending = nullptr;
+		pending();
+	}
+}
+
+void TraceRecorder::summarize(const QString &filePath, const QHash<QString, qint64> &selfUs, qint64 elapsedMs)
+{
+	++m_batchArticles;
+	QStringList top;
+	const auto rows = ranked(selfUs, 5);
+	for (const auto &row : rows)
+		top.append(QString("%1=%2ms").arg(row.first).arg(row.second / 1000));
+	TimingLog::write("trace", elapsedMs, QFileInfo(filePath).fileName() + ' ' + top.join(' '));
+
+	for (auto it = selfUs.constBegin(); it != selfUs.constEnd(); ++it)
+		m_batchSelfUs[it.key()] += it.value();
+
+	QString summary = QString("Articles traced: %1\nSelf time by event over the batch:\n").arg(m_batchArticles);
+	const auto batchRows = ranked(m_batchSelfUs, SummaryRows);
+	for (const auto &row : batchRows) {
+		summary += QString("%1 %2 ms  %3 ms per article\n").arg(row.first, -48)
+			.arg(row.second / 1000, 10).arg(double(row.second) / 1000 / m_batchArticles, 10, 'f', 1);
+	}
+	QSaveFile file(traceFolder() + "/summary.txt");
+	if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		file.write(summary.toUtf8());
+		file.commit();
+	}
+}
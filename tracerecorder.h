@@ -0,0 +1,53 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QObject>
+#include <functional>
+
+class QWebSocket;
+class WebView;
+
+// Records a Chromium trace for every article loaded in profiling mode.
+// Chromium is started with its remote debugging port on loopback; the recorder
+// attaches to the page target of the tab over the DevTools protocol, wraps each
+// load in Tracing.start/Tracing.end and saves the trace next to the timing log.
+// Self time per event name is summed over the batch in traces/summary.txt.
+class TraceRecorder : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TraceRecorder(QObject *parent = nullptr);
+	~TraceRecorder();
+
+	// Must run before QApplication is created, Chromium reads the port at start-up
+	static void enable(quint16 port);
+	static quint16 port();
+	static QString traceFolder();
+
+	// Starts tracing in the tab, then calls load; if tracing cannot start the load goes ahead untraced
+	void record(WebView *view, const QString &filePath, const std::function<void()> &load);
+
+private:
+	struct Session;
+
+	void attach(WebView *view, const std::function<void(bool attached)> &done);
+	void start(WebView *view, const QString &filePath, const std::function<void()> &load);
+	void stop(WebView *view, int traceId);
+	void send(Session *session, const QString &method, const QJsonObject &params = QJsonObject(),
+		const std::function<void(const QJsonObject &)> &reply = nullptr);
+	void handleMessage(WebView *view, const QString &text);
+	void finishTrace(WebView *view);
+	void abandonTrace(WebView *view, const char *reason);
+	void summarize(const QString &filePath, const QHash<QString, qint64> &selfUs, qint64 elapsedMs);
+
+	QNetworkAccessManager m_network;
+	QHash<WebView *, Session *> m_sessions;
+	QHash<QString, qint64> m_batchSelfUs;     // event name -> self time over the batch
+	int m_batchArticles;
+};
+
+#endif // TRACERECORDER_H
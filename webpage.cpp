@@ -8,9 +8,11 @@
 #include <QStyle>
 #include <QTimer>
 #include <QWebEngineCertificateError>
+#include <QWebEngineSettings>
 
 WebPage::WebPage(QWebEngineProfile *profile, QObject *parent)
     : QWebEnginePage(profile, parent)
+    , m_triageMode(false)
 {
     connect(this, &QWebEnginePage::featurePermissionRequested, this, &WebPage::handleFeaturePermissionRequested);
     connect(this, &QWebEnginePage::registerProtocolHandlerRequested, this, &WebPage::handleRegisterProtocolHandlerRequested);
@@ -19,6 +21,32 @@ WebPage::WebPage(QWebEngineProfile *profile, QObject *parent)
 #endif
 }
 
+void WebPage::setTriageMode(bool enabled)
+{
+    if (m_triageMode == enabled)
+        return;
+    m_triageMode = enabled;
+
+    // Resetting an attribute makes the page follow the profile defaults again
+    QWebEngineSettings *pageSettings = settings();
+    const QWebEngineSettings::WebAttribute attributes[] = {
+        QWebEngineSettings::JavascriptEnabled,
+        QWebEngineSettings::JavascriptCanOpenWindows,
+        QWebEngineSettings::PluginsEnabled,
+        QWebEngineSettings::WebGLEnabled,
+        QWebEngineSettings::Accelerated2dCanvasEnabled,
+    };
+    for (QWebEngineSettings::WebAttribute attribute : attributes) {
+        if (enabled)
+            pageSettings->setAttribute(attribute, false);
+        else
+            pageSettings->resetAttribute(attribute);
+    }
+    if (enabled)
+        pageSettings->setAttribute(QWebEngineSettings::PlaybackRequiresUserGesture, true);
+    else
+        pageSettings->resetAttribute(QWebEngineSettings::PlaybackRequiresUserGesture);
+}
 
 inline QString questionForFeature(QWebEnginePage::Feature feature)
 {
@@ -12,6 +12,10 @@ class WebPage : public QWebEnginePage
 public:
     WebPage(QWebEngineProfile *profile, QObject *parent = nullptr);
 
+    // Fast triage: no scripts, plugins or autoplaying media on this page
+    void setTriageMode(bool enabled);
+    bool triageMode() const { return m_triageMode; }
+
 private slots:
     void handleFeaturePermissionRequested(const QUrl &securityOrigin, Feature feature);
 
@@ -19,6 +23,9 @@ private slots:
 #if !defined(QT_NO_SSL) || QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
     void handleSelectClientCertificate(QWebEngineClientCertificateSelection clientCertSelection);
 #endif
+
+private:
+    bool m_triageMode;
 };
 
 #endif // WEBPAGE_H
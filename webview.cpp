@@ -1,6 +1,8 @@
 
 #include "browser.h"
+#include "backgroundscheduler.h"
 #include "browserwindow.h"
+#include "faviconstore.h"
 #include "tabwidget.h"
 #include "webpage.h"
 #include "webview.h"
@@ -9,13 +11,19 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QTimer>
+#include <QWebEngineScript>
 
 WebView::WebView(QWidget *parent)
     : QWebEngineView(parent)
     , m_loadProgress(100)
+    , m_hibernated(false)
+    , m_viewStatePending(false)
+    , m_pendingZoomFactor(1.0)
 {
     connect(this, &QWebEngineView::loadStarted, [this]() {
         m_loadProgress = 0;
+        // Background work backs off until the page is in
+        BackgroundScheduler::instance()->setLoading(this, true);
         emit favIconChanged(favIcon());
     });
     connect(this, &QWebEngineView::loadProgress, [this](int progress) {
@@ -23,11 +31,26 @@ WebView::WebView(QWidget *parent)
     });
     connect(this, &QWebEngineView::loadFinished, [this](bool success) {
         m_loadProgress = success ? 100 : -1;
+        BackgroundScheduler::instance()->setLoading(this, false);
         emit favIconChanged(favIcon());
+        if (m_viewStatePending && success) {
+            m_viewStatePending = false;
+            setZoomFactor(m_pendingZoomFactor);
+            // The application world still runs when page scripts are disabled
+            page()->runJavaScript(QStringLiteral("window.scrollTo(%1, %2);")
+                                  .arg(m_pendingScrollPosition.x()).arg(m_pendingScrollPosition.y()),
+                                  QWebEngineScript::ApplicationWorld);
+        }
     });
     connect(this, &QWebEngineView::iconChanged, [this](const QIcon &) {
         emit favIconChanged(favIcon());
     });
+    // The origin of an archive opened for the first time is read in the background
+    connect(FaviconStore::instance(), &FaviconStore::fileResolved, this, [this](const QString &filePath) {
+        const QUrl url = sessionUrl();
+        if (url.isLocalFile() && url.toLocalFile() == filePath)
+            emit favIconChanged(favIcon());
+    });
 
     connect(this, &QWebEngineView::renderProcessTerminated,
             [this](QWebEnginePage::RenderProcessTerminationStatus termStatus, int statusCode) {
@@ -84,6 +107,10 @@ bool WebView::isWebActionEnabled(QWebEnginePage::WebAction webAction) const
 QIcon WebView::favIcon() const
 {
     QIcon favIcon = icon();
+    if (!favIcon.isNull())
+        return favIcon;
+    // Known from an ingested archive, so the tab needs no rendering to show it
+    favIcon = FaviconStore::instance()->iconForUrl(sessionUrl());
     if (!favIcon.isNull())
         return favIcon;
 
@@ -99,6 +126,39 @@ QIcon WebView::favIcon() const
     }
 }
 
+void WebView::hibernate(const QUrl &url, const QString &title, qreal zoomFactor, const QPointF &scrollPosition)
+{
+    m_hibernated = true;
+    m_hibernatedUrl = url;
+    m_hibernatedTitle = title;
+    restoreViewState(zoomFactor, scrollPosition);
+}
+
+void WebView::wake()
+{
+    if (!m_hibernated)
+        return;
+    m_hibernated = false;
+    setUrl(m_hibernatedUrl);
+}
+
+QUrl WebView::sessionUrl() const
+{
+    return m_hibernated ? m_hibernatedUrl : url();
+}
+
+QString WebView::sessionTitle() const
+{
+    return m_hibernated ? m_hibernatedTitle : title();
+}
+
+void WebView::restoreViewState(qreal zoomFactor, const QPointF &scrollPosition)
+{
+    m_viewStatePending = true;
+    m_pendingZoomFactor = zoomFactor;
+    m_pendingScrollPosition = scrollPosition;
+}
+
 QWebEngineView *WebView::createWindow(QWebEnginePage::WebWindowType type)
 {
     BrowserWindow *mainWindow = qobject_cast<BrowserWindow*>(window());
@@ -19,6 +19,16 @@ public:
     bool isWebActionEnabled(QWebEnginePage::WebAction webAction) const;
     QIcon favIcon() const;
 
+    // Session restore: a hibernated view keeps only its URL and title, the page
+    // is loaded when the tab is first shown
+    void hibernate(const QUrl &url, const QString &title, qreal zoomFactor, const QPointF &scrollPosition);
+    bool isHibernated() const { return m_hibernated; }
+    void wake();
+    QUrl sessionUrl() const;
+    QString sessionTitle() const;
+    // Applies zoom and scroll position once the next load finishes
+    void restoreViewState(qreal zoomFactor, const QPointF &scrollPosition);
+
 protected:
     void contextMenuEvent(QContextMenuEvent *event) override;
     QWebEngineView *createWindow(QWebEnginePage::WebWindowType type) override;
@@ -33,6 +43,12 @@ private:
 
 private:
     int m_loadProgress;
+    bool m_hibernated;
+    QUrl m_hibernatedUrl;
+    QString m_hibernatedTitle;
+    bool m_viewStatePending;
+    qreal m_pendingZoomFactor;
+    QPointF m_pendingScrollPosition;
 };
 
 #endif
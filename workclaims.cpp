@@ -0,0 +1,238 @@
+#include "workclaims.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QLockFile>
+#include <cstring>
+
+static const quint32 SegmentMagic = 0x4d484331; // "MHC1"
+static const int SlotCount = 512;
+static const int LockTimeoutMs = 1000;
+
+struct WorkClaims::Slot
+{
+	quint64 key;
+	quint64 owner;
+	qint64 expires;
+};
+
+namespace
+{
+	struct Header
+	{
+		quint32 magic;
+		quint32 slotCount;
+	};
+
+	quint64 nextOwnerId()
+	{
+		// Unique across processes: the pid in the high bits, a window counter below
+		static quint32 counter = 0;
+		return (quint64(QCoreApplication::applicationPid()) << 20) | (++counter & 0xfffff);
+	}
+}
+
+WorkClaims::WorkClaims(QObject *parent)
+	: QObject(parent)
+	, m_lockFile(nullptr)
+	, m_owner(nextOwnerId())
+	, m_claimed(0)
+{
+	m_renewTimer.setInterval(LeaseMs / 3);
+	connect(&m_renewTimer, &QTimer::timeout, this, &WorkClaims::renew);
+}
+
+WorkClaims::~WorkClaims()
+{
+	release();
+	delete m_lockFile;
+}
+
+void WorkClaims::setSourceFolder(const QString &folder)
+{
+	release();
+	if (m_segment.isAttached())
+		m_segment.detach();
+	delete m_lockFile;
+	m_lockFile = nullptr;
+	if (folder.isEmpty())
+		return;
+
+	// One table per user and folder, the same folder opened by another user is another inbox
+	QByteArray id = QDir::homePath().toUtf8() + '\n' + QDir(folder).canonicalPath().toUtf8();
+	QString key = "MhtmlBrowser-claims-" + QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex().left(16);
+	m_lockFile = new QLockFile(QDir::temp().filePath(key + ".lock"));
+	m_segment.setKey(key);
+
+	int size = int(sizeof(Header) + SlotCount * sizeof(Slot));
+	if (!m_segment.create(size) && !m_segment.attach()) {
+		// Claims then stay local to this window, which is the old behaviour
+		qWarning("Work claims unavailable: %s", qPrintable(m_segment.errorString()));
+		return;
+	}
+	if (!lock())
+		return;
+	Header *header = static_cast<Header *>(m_segment.data());
+	if (header->magic != SegmentMagic || header->slotCount != SlotCount) {
+		std::memset(m_segment.data(), 0, size_t(size));
+		header->magic = SegmentMagic;
+		header->slotCount = SlotCount;
+	}
+	unlock();
+}
+
+QString WorkClaims::claimNext(const QStringList &candidates)
+{
+	for (const QString &filePath : candidates) {
+		// The existence check touches the disk, keep it outside the lock
+		if (!QFile::exists(filePath))
+			continue;
+		if (tryClaim(keyOf(filePath)))
+			return filePath;
+	}
+	return QString();
+}
+
+void WorkClaims::release()
+{
+	m_renewTimer.stop();
+	if (!m_claimed && m_held.isEmpty())
+		return;
+	m_claimed = 0;
+	m_held.clear();
+	if (!lock())
+		return;
+	Slot *slot = table();
+	for (int i = 0; i < SlotCount; ++i) {
+		if (slot[i].owner == m_owner)
+			slot[i] = Slot();
+	}
+	unlock();
+}
+
+bool WorkClaims::lock()
+{
+	if (!m_segment.isAttached())
+		return false;
+	if (!m_lockFile->tryLock(LockTimeoutMs)) {
+		qWarning("Work claims lock timed out: %s", qPrintable(m_lockFile->fileName()));
+		return false;
+	}
+	return true;
+}
+
+void WorkClaims::unlock()
+{
+	m_lockFile->unlock();
+}
+
+WorkClaims::Slot *WorkClaims::table() const
+{
+	return reinterpret_cast<Slot *>(static_cast<char *>(const_cast<void *>(m_segment.constData())) + sizeof(Header));
+}
+
+QStringList WorkClaims::hold(const QStringList &filePaths)
+{
+	QStringList refused;
+	QSet<quint64> held;
+	if (!lock()) {
+		for (const QString &filePath : filePaths)
+			held.insert(keyOf(filePath));
+		m_held = held;
+		return refused;
+	}
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	for (const QString &filePath : filePaths) {
+		quint64 key = keyOf(filePath);
+		if (claimKey(key, now))
+			held.insert(key);
+		else
+			refused.append(filePath);
+	}
+	for (quint64 key : qAsConst(m_held)) {
+		if (!held.contains(key) && key != m_claimed)
+			dropKey(key);
+	}
+	unlock();
+	m_held = held;
+	if (m_claimed || !m_held.isEmpty())
+		m_renewTimer.start();
+	return refused;
+}
+
+bool WorkClaims::tryClaim(quint64 key)
+{
+	if (!lock()) {
+		// Without the shared table every file is ours, as before
+		m_claimed = key;
+		return true;
+	}
+	if (!claimKey(key, QDateTime::currentMSecsSinceEpoch())) {
+		unlock();
+		return false;
+	}
+	// Files open in other tabs stay claimed
+	if (m_claimed && m_claimed != key && !m_held.contains(m_claimed))
+		dropKey(m_claimed);
+	unlock();
+	m_claimed = key;
+	m_renewTimer.start();
+	return true;
+}
+
+bool WorkClaims::claimKey(quint64 key, qint64 now)
+{
+	Slot *slot = table();
+	int target = -1;
+	for (int i = 0; i < SlotCount; ++i) {
+		bool live = slot[i].owner && slot[i].expires > now;
+		if (live && slot[i].key == key) {
+			if (slot[i].owner != m_owner)
+				return false;
+			target = i;
+			break;
+		} else if (!live && target < 0) {
+			target = i;
+		}
+	}
+	// A full table only means the claim is not visible to others
+	if (target >= 0) {
+		slot[target].key = key;
+		slot[target].owner = m_owner;
+		slot[target].expires = now + LeaseMs;
+	}
+	return true;
+}
+
+void WorkClaims::dropKey(quint64 key)
+{
+	Slot *slot = table();
+	for (int i = 0; i < SlotCount; ++i) {
+		if (slot[i].owner == m_owner && slot[i].key == key)
+			slot[i] = Slot();
+	}
+}
+
+void WorkClaims::renew()
+{
+	if ((!m_claimed && m_held.isEmpty()) || !lock())
+		return;
+	qint64 expires = QDateTime::currentMSecsSinceEpoch() + LeaseMs;
+	Slot *slot = table();
+	for (int i = 0; i < SlotCount; ++i) {
+		if (slot[i].owner == m_owner)
+			slot[i].expires = expires;
+	}
+	unlock();
+}
+
+quint64 WorkClaims::keyOf(const QString &filePath)
+{
+	// qHash is seeded per process, the key has to be the same everywhere
+	QByteArray digest = QCryptographicHash::hash(QDir::cleanPath(filePath).toLower().toUtf8(), QCryptographicHash::Sha1);
+	quint64 key;
+	std::memcpy(&key, digest.constData(), sizeof(key));
+	return key ? key : 1;
+}
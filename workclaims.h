@@ -0,0 +1,58 @@
+#ifndef WORKCLAIMS_H
+#define WORKCLAIMS_H
+
+#include <QObject>
+#include <QSet>
+#include <QSharedMemory>
+#include <QStringList>
+#include <QTimer>
+
+class QLockFile;
+
+// Claims on queued articles shared by every window and process working on
+// one source folder, so two operators never get the same file.
+// The claim table lives in a shared memory segment guarded by a lock file;
+// a claim is a lease that has to be renewed, a crashed window loses its
+// claims when the lease runs out.
+class WorkClaims : public QObject
+{
+	Q_OBJECT
+
+public:
+	// A claim not renewed for this long is free again
+	static const int LeaseMs = 30000;
+
+	explicit WorkClaims(QObject *parent = nullptr);
+	~WorkClaims();
+
+	void setSourceFolder(const QString &folder);
+
+	// Claims the first existing candidate nobody else holds and drops the previous claim of this window
+	QString claimNext(const QStringList &candidates);
+	// Files this window shows besides the claimed one, e.g. opened from a dialog or another
+	// instance; replaces the previous set and returns the files other windows hold
+	QStringList hold(const QStringList &filePaths);
+	void release();
+
+private:
+	struct Slot;
+
+	bool lock();
+	void unlock();
+	Slot *table() const;
+	bool tryClaim(quint64 key);
+	// With the lock held
+	bool claimKey(quint64 key, qint64 now);
+	void dropKey(quint64 key);
+	void renew();
+	static quint64 keyOf(const QString &filePath);
+
+	QSharedMemory m_segment;
+	QLockFile *m_lockFile;
+	quint64 m_owner;
+	quint64 m_claimed;
+	QSet<quint64> m_held;
+	QTimer m_renewTimer;
+};
+
+#endif // WORKCLAIMS_H